@@ -0,0 +1,217 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+
+#include "DecodedImageBudgetWKC.h"
+
+#include "BitmapImage.h"
+
+#include <wtf/MainThread.h>
+
+namespace WebCore {
+
+WKC_DEFINE_GLOBAL_PTR(DecodedImageBudget*, gDecodedImageBudget, 0);
+
+DecodedImageBudget::DecodedImageBudget(unsigned bytes)
+    : m_budget(bytes)
+    , m_usage(0)
+    , m_peakUsage(0)
+    , m_evictions(0)
+    , m_redecodes(0)
+    , m_evicting(false)
+{
+}
+
+DecodedImageBudget::~DecodedImageBudget()
+{
+}
+
+void DecodedImageBudget::setBudget(unsigned bytes)
+{
+    if (!bytes) {
+        deleteSharedInstance();
+        return;
+    }
+    if (!gDecodedImageBudget) {
+        // images decoded before this are not counted until they decode again
+        gDecodedImageBudget = new DecodedImageBudget(bytes);
+        return;
+    }
+    gDecodedImageBudget->m_budget = bytes;
+    gDecodedImageBudget->evict(bytes, 0);
+}
+
+DecodedImageBudget* DecodedImageBudget::sharedInstance()
+{
+    return gDecodedImageBudget;
+}
+
+void DecodedImageBudget::deleteSharedInstance()
+{
+    delete gDecodedImageBudget;
+    gDecodedImageBudget = 0;
+}
+
+void DecodedImageBudget::forceTerminate()
+{
+    gDecodedImageBudget = 0;
+}
+
+bool DecodedImageBudget::evictForAllocation(unsigned bytes)
+{
+    // the image decoders on worker threads allocate bitmaps too
+    if (!gDecodedImageBudget || !isMainThread())
+        return false;
+
+    DecodedImageBudget* self = gDecodedImageBudget;
+    unsigned limit = self->m_usage > bytes ? self->m_usage - bytes : 0;
+    return self->evict(limit, 0) > 0;
+}
+
+DecodedImageBudget::DecodingScope::DecodingScope(const BitmapImage* image)
+    : m_image(0)
+{
+    // the decoders on worker threads never evict
+    if (!gDecodedImageBudget || !isMainThread())
+        return;
+    m_image = const_cast<BitmapImage*>(image);
+    gDecodedImageBudget->m_decoding.append(m_image);
+}
+
+DecodedImageBudget::DecodingScope::~DecodingScope()
+{
+    if (!m_image || !gDecodedImageBudget)
+        return;
+    Vector<BitmapImage*>& decoding = gDecodedImageBudget->m_decoding;
+    for (size_t i = decoding.size(); i > 0; i--) {
+        if (decoding[i - 1] == m_image) {
+            decoding.remove(i - 1);
+            break;
+        }
+    }
+}
+
+void DecodedImageBudget::willDecode(BitmapImage* image, unsigned bytes)
+{
+    // a frame over the budget alone is still decoded, with nothing else kept
+    evict(m_budget > bytes ? m_budget - bytes : 0, image);
+}
+
+void DecodedImageBudget::setDecodedSize(BitmapImage* image, unsigned decodedSize)
+{
+    HashMap<BitmapImage*, unsigned>::iterator it = m_sizes.find(image);
+    if (it != m_sizes.end()) {
+        m_usage -= it->second;
+        if (!decodedSize) {
+            m_sizes.remove(it);
+            m_images.remove(image);
+            return;
+        }
+        it->second = decodedSize;
+    } else {
+        if (!decodedSize)
+            return;
+        m_sizes.set(image, decodedSize);
+        if (m_evicted.contains(image)) {
+            m_evicted.remove(image);
+            ++m_redecodes;
+        }
+    }
+
+    m_usage += decodedSize;
+    if (m_usage > m_peakUsage)
+        m_peakUsage = m_usage;
+    touch(image);
+    if (!m_evicting)
+        evict(m_budget, image);
+}
+
+void DecodedImageBudget::touch(BitmapImage* image)
+{
+    ListHashSet<BitmapImage*>::iterator it = m_images.find(image);
+    if (it == m_images.end()) {
+        if (m_sizes.contains(image))
+            m_images.add(image);
+        return;
+    }
+    if (image == m_images.last())
+        return;
+    m_images.remove(it);
+    m_images.add(image);
+}
+
+void DecodedImageBudget::remove(BitmapImage* image)
+{
+    m_evicted.remove(image);
+
+    HashMap<BitmapImage*, unsigned>::iterator it = m_sizes.find(image);
+    if (it == m_sizes.end())
+        return;
+    m_usage -= it->second;
+    m_sizes.remove(it);
+    m_images.remove(image);
+}
+
+unsigned DecodedImageBudget::evict(unsigned limit, BitmapImage* keep)
+{
+    if (m_evicting)
+        return 0;
+
+    m_evicting = true;
+    unsigned freed = 0;
+    while (m_usage > limit) {
+        BitmapImage* victim = 0;
+        for (ListHashSet<BitmapImage*>::iterator it = m_images.begin(); it != m_images.end(); ++it) {
+            if (*it != keep && m_decoding.find(*it) == notFound) {
+                victim = *it;
+                break;
+            }
+        }
+        if (!victim)
+            break;
+
+        unsigned usage = m_usage;
+        // keeps the encoded data; setDecodedSize() forgets the image
+        victim->destroyDecodedData(true);
+        // in case some of its size was not reported back
+        remove(victim);
+        m_evicted.add(victim);
+        ++m_evictions;
+        freed += usage - m_usage;
+    }
+    m_evicting = false;
+    return freed;
+}
+
+void DecodedImageBudget::getStatistics(DecodedImageBudgetStatistics& stat) const
+{
+    stat.m_budget = m_budget;
+    stat.m_usage = m_usage;
+    stat.m_peakUsage = m_peakUsage;
+    stat.m_images = m_sizes.size();
+    stat.m_evictions = m_evictions;
+    stat.m_redecodes = m_redecodes;
+}
+
+} // namespace WebCore
+
+#endif // ENABLE(WKC_DECODED_IMAGE_BUDGET)
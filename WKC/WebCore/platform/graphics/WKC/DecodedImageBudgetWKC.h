@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#ifndef DecodedImageBudgetWKC_h
+#define DecodedImageBudgetWKC_h
+
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+
+#include <wtf/FastAllocBase.h>
+#include <wtf/HashMap.h>
+#include <wtf/HashSet.h>
+#include <wtf/ListHashSet.h>
+#include <wtf/Noncopyable.h>
+#include <wtf/Vector.h>
+
+namespace WebCore {
+
+class BitmapImage;
+
+struct DecodedImageBudgetStatistics {
+    unsigned m_budget;
+    unsigned m_usage;
+    unsigned m_peakUsage;
+    int m_images;
+    int m_evictions;
+    int m_redecodes;
+};
+
+// Keeps the decoded frames of the images under one budget. When a decode
+// would go over it, the frames of the least recently drawn images are
+// dropped. Those images keep their encoded data and decode again the next
+// time they are drawn.
+// The frames of other images are also dropped when an image bitmap cannot
+// be allocated, before the allocation error is notified.
+// Main thread only; off until the port sets a budget.
+class DecodedImageBudget {
+    WTF_MAKE_FAST_ALLOCATED;
+public:
+    // in bytes; 0 turns it off and forgets the images
+    static void setBudget(unsigned bytes);
+    // 0 when off
+    static DecodedImageBudget* sharedInstance();
+    static void deleteSharedInstance();
+    static void forceTerminate();
+
+    // Drops the frames of images other than the ones being decoded until
+    // bytes are freed. Returns false when nothing was freed.
+    static bool evictForAllocation(unsigned bytes);
+
+    // Marks image as being decoded while its ImageSource is called: its
+    // decoder may allocate, and is on the stack when it does.
+    class DecodingScope {
+        WTF_MAKE_NONCOPYABLE(DecodingScope);
+    public:
+        DecodingScope(const BitmapImage* image);
+        ~DecodingScope();
+    private:
+        BitmapImage* m_image;
+    };
+
+    // image is about to decode a frame of bytes
+    void willDecode(BitmapImage* image, unsigned bytes);
+    // the decoded size of image changed; also marks it as the latest drawn
+    void setDecodedSize(BitmapImage* image, unsigned decodedSize);
+    // image is drawn
+    void touch(BitmapImage* image);
+    void remove(BitmapImage* image);
+
+    void getStatistics(DecodedImageBudgetStatistics& stat) const;
+
+private:
+    DecodedImageBudget(unsigned bytes);
+    ~DecodedImageBudget();
+
+    // Evicts images other than keep, least recently drawn first, until the
+    // usage fits in limit. Returns the bytes freed.
+    unsigned evict(unsigned limit, BitmapImage* keep);
+
+private:
+    unsigned m_budget;
+    unsigned m_usage;
+    unsigned m_peakUsage;
+    int m_evictions;
+    int m_redecodes;
+
+    // least recently drawn first
+    ListHashSet<BitmapImage*> m_images;
+    HashMap<BitmapImage*, unsigned> m_sizes;
+    // evicted images not decoded again yet
+    HashSet<BitmapImage*> m_evicted;
+    // never evicted while their decoders run; innermost last
+    Vector<BitmapImage*> m_decoding;
+    bool m_evicting;
+};
+
+} // namespace WebCore
+
+#endif // ENABLE(WKC_DECODED_IMAGE_BUDGET)
+
+#endif // DecodedImageBudgetWKC_h
@@ -37,6 +37,7 @@
 #include "Color.h"
 #include "GraphicsContext.h"
 #include "ImageData.h"
+#include "ImageRowKernelsWKC.h"
 #include "ImageWKC.h"
 #include "MIMETypeRegistry.h"
 #include "Pattern.h"
@@ -287,17 +288,7 @@ void ImageBuffer::platformTransformColorSpace(const Vector<int>& lookUpTable)
                 int stride = m_size.width() * 4;
                 for (int y = 0; y < m_size.height(); ++y) {
                     unsigned* row = reinterpret_cast<unsigned*>(dataSrc + stride * y);
-                    for (int x = 0; x < m_size.width(); x++) {
-                        unsigned* pixel = row + x;
-                        Color pixelColor = colorFromPremultipliedARGB(*pixel);
-//                       Color pixelColor(*pixel);
-                        pixelColor = Color(lookUpTable[pixelColor.red()],
-                                           lookUpTable[pixelColor.green()],
-                                           lookUpTable[pixelColor.blue()],
-                                           pixelColor.alpha());
-                        *pixel = premultipliedARGBFromColor(pixelColor);
-//                     *pixel = pixelColor.rgb();
-                    }
+                    ImageRowKernels::transformARGB(row, m_size.width(), lookUpTable.data());
                 }
 
                 wkcOffscreenPutPixelsPeer(wkcDrawContextGetOffscreenPeer(context()->platformContext()),
@@ -318,15 +309,7 @@ void ImageBuffer::platformTransformColorSpace(const Vector<int>& lookUpTable)
     int stride = m_data.m_image->rowbytes();
     for (int y = 0; y < m_size.height(); ++y) {
         unsigned* row = reinterpret_cast<unsigned*>(dataSrc + stride * y);
-        for (int x = 0; x < m_size.width(); x++) {
-            unsigned* pixel = row + x;
-            Color pixelColor = colorFromPremultipliedARGB(*pixel);
-            pixelColor = Color(lookUpTable[pixelColor.red()],
-                               lookUpTable[pixelColor.green()],
-                               lookUpTable[pixelColor.blue()],
-                               pixelColor.alpha());
-            *pixel = premultipliedARGBFromColor(pixelColor);
-        }
+        ImageRowKernels::transformARGB(row, m_size.width(), lookUpTable.data());
     }
 }
 
@@ -371,19 +354,11 @@ PassRefPtr<Uint8ClampedArray> getImageData(const IntRect& rect, const ImageBuffe
     unsigned char* destRows = dataDst + desty * destBytesPerRow + destx * 4;
     for (int y = 0; y < numRows; ++y) {
         unsigned* row = reinterpret_cast<unsigned*>(dataSrc + stride * (y + originy));
-        for (int x = 0; x < numColumns; x++) {
-            int basex = x * 4;
-            unsigned* pixel = row + x + originx;
-            Color pixelColor;
-            if (multiplied == Unmultiplied)
-                pixelColor = colorFromPremultipliedARGB(*pixel);
-            else
-                pixelColor = Color(*pixel);
-            destRows[basex]     = pixelColor.red();
-            destRows[basex + 1] = pixelColor.green();
-            destRows[basex + 2] = pixelColor.blue();
-            destRows[basex + 3] = pixelColor.alpha();
-        }
+        unsigned* dest = reinterpret_cast<unsigned*>(destRows);
+        if (multiplied == Unmultiplied)
+            ImageRowKernels::unpremultiplyARGB(row + originx, dest, numColumns, true);
+        else
+            ImageRowKernels::swapRedBlue(row + originx, dest, numColumns);
         destRows += destBytesPerRow;
     }
 
@@ -483,7 +458,6 @@ PassRefPtr<Uint8ClampedArray> ImageBuffer::getPremultipliedImageData(const IntRe
                 endy = m_size.height();
             int numRows = endy - originy;
 
-            int stride = rect.size().width()*4;         //probably the same with destBytesPerRow
             unsigned destBytesPerRow = 4 * rect.width();
             unsigned char* destRows = dataDst + desty * destBytesPerRow + destx * 4;
 
@@ -496,16 +470,9 @@ PassRefPtr<Uint8ClampedArray> ImageBuffer::getPremultipliedImageData(const IntRe
                     &wkc_rect);
 
             //compute premultiplied data for internal usage - the data read from offscreen is not premultiplied
-            unsigned char* dataSrc = dataDst;
             for (int y = 0; y < numRows; ++y) {
-                unsigned* row = reinterpret_cast<unsigned*>(dataSrc + stride * (y + originy));
-                for (int x = 0; x < numColumns; x++) {
-                    int basex = x * 4;
-                    unsigned* pixel = row + x + originx;
-                    Color pixelColor;
-                       pixelColor = Color(*pixel);
-                    *((unsigned*)(&destRows[basex])) = premultipliedARGBFromColor(pixelColor);
-                }
+                unsigned* row = reinterpret_cast<unsigned*>(destRows);
+                ImageRowKernels::premultiplyARGB(row, row, numColumns, false);
                 destRows += destBytesPerRow;
             }
 
@@ -555,18 +522,11 @@ void putImageData(Uint8ClampedArray* source, const IntRect& sourceRect, const In
     unsigned char* srcRows = source->data() + originy * srcBytesPerRow + originx * 4;
     for (int y = 0; y < numRows; ++y) {
         unsigned* row = reinterpret_cast<unsigned*>(dataDst + stride * (y + desty));
-        for (int x = 0; x < numColumns; x++) {
-            int basex = x * 4;
-            unsigned* pixel = row + x + destx;
-            Color pixelColor(srcRows[basex],
-                    srcRows[basex + 1],
-                    srcRows[basex + 2],
-                    srcRows[basex + 3]);
-            if (multiplied == Unmultiplied)
-                *pixel = premultipliedARGBFromColor(pixelColor);
-            else
-                *pixel = pixelColor.rgb();
-        }
+        const unsigned* src = reinterpret_cast<const unsigned*>(srcRows);
+        if (multiplied == Unmultiplied)
+            ImageRowKernels::premultiplyARGB(src, row + destx, numColumns, true);
+        else
+            ImageRowKernels::swapRedBlue(src, row + destx, numColumns);
         srcRows += srcBytesPerRow;
     }
 }
@@ -632,16 +592,7 @@ void ImageBuffer::putByteArray(Multiply mult, Uint8ClampedArray* source, const I
                     unsigned char* srcRows = source->data() + originy * srcBytesPerRow + originx * 4;
                     for (int y = 0; y < numRows; ++y) {
                         unsigned* row = reinterpret_cast<unsigned*>(pixelsToCopy + stride * (y + desty));
-                        for (int x = 0; x < numColumns; x++) {
-                            int basex = x * 4;
-                            unsigned* pixel = row + x + destx;
-//                        Color pixelColor(srcRows[basex],
-//                                srcRows[basex + 1],
-//                                srcRows[basex + 2],
-//                                srcRows[basex + 3]);
-                            Color pixelColor = colorFromPremultipliedARGB(*((unsigned*)(&srcRows[basex])));
-                            *pixel = pixelColor.rgb();
-                        }
+                        ImageRowKernels::unpremultiplyARGB(reinterpret_cast<const unsigned*>(srcRows), row + destx, numColumns, false);
                         srcRows += srcBytesPerRow;
                     }
                     
@@ -714,15 +665,7 @@ void ImageBuffer::putByteArray(Multiply mult, Uint8ClampedArray* source, const I
                     unsigned char* srcRows = source->data() + originy * srcBytesPerRow + originx * 4;
                     for (int y = 0; y < numRows; ++y) {
                         unsigned* row = reinterpret_cast<unsigned*>(pixelsToCopy + stride * (y + desty));
-                        for (int x = 0; x < numColumns; x++) {
-                            int basex = x * 4;
-                            unsigned* pixel = row + x + destx;
-                            Color pixelColor(srcRows[basex],
-                                             srcRows[basex + 1],
-                                             srcRows[basex + 2],
-                                             srcRows[basex + 3]);
-                            *pixel = pixelColor.rgb();
-                        }
+                        ImageRowKernels::swapRedBlue(reinterpret_cast<const unsigned*>(srcRows), row + destx, numColumns);
                         srcRows += srcBytesPerRow;
                     }
                     
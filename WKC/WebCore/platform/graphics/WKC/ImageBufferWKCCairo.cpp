@@ -39,6 +39,7 @@
 #include "Color.h"
 #include "GraphicsContext.h"
 #include "ImageData.h"
+#include "ImageRowKernelsWKC.h"
 #include "ImageWKC.h"
 #include "image-encoders/JPEGImageEncoder.h"
 #include "MIMETypeRegistry.h"
@@ -237,15 +238,7 @@ void ImageBuffer::platformTransformColorSpace(const Vector<int>& lookUpTable)
     int stride = cairo_image_surface_get_stride(surface);
     for (int y = 0; y < m_size.height(); ++y) {
         unsigned* row = reinterpret_cast<unsigned*>(dataSrc + stride * y);
-        for (int x = 0; x < m_size.width(); x++) {
-            unsigned* pixel = row + x;
-            Color pixelColor = colorFromPremultipliedARGB(*pixel);
-            pixelColor = Color(lookUpTable[pixelColor.red()],
-                               lookUpTable[pixelColor.green()],
-                               lookUpTable[pixelColor.blue()],
-                               pixelColor.alpha());
-            *pixel = premultipliedARGBFromColor(pixelColor);
-        }
+        ImageRowKernels::transformARGB(row, m_size.width(), lookUpTable.data());
     }
 #if (CAIRO_VERSION >= CAIRO_VERSION_ENCODE(1, 12, 0))
     if (type!=CAIRO_SURFACE_TYPE_IMAGE) {
@@ -306,19 +299,11 @@ PassRefPtr<Uint8ClampedArray> getImageData(const IntRect& rect, const ImageBuffe
     unsigned char* destRows = dataDst + desty * destBytesPerRow + destx * 4;
     for (int y = 0; y < numRows; ++y) {
         unsigned* row = reinterpret_cast<unsigned*>(dataSrc + stride * (y + originy));
-        for (int x = 0; x < numColumns; x++) {
-            int basex = x * 4;
-            unsigned* pixel = row + x + originx;
-            Color pixelColor;
-            if (multiplied == Unmultiplied)
-                pixelColor = colorFromPremultipliedARGB(*pixel);
-            else
-                pixelColor = Color(*pixel);
-            destRows[basex]     = pixelColor.red();
-            destRows[basex + 1] = pixelColor.green();
-            destRows[basex + 2] = pixelColor.blue();
-            destRows[basex + 3] = pixelColor.alpha();
-        }
+        unsigned* dest = reinterpret_cast<unsigned*>(destRows);
+        if (multiplied == Unmultiplied)
+            ImageRowKernels::unpremultiplyARGB(row + originx, dest, numColumns, true);
+        else
+            ImageRowKernels::swapRedBlue(row + originx, dest, numColumns);
         destRows += destBytesPerRow;
     }
 
@@ -387,18 +372,11 @@ void putImageData(Uint8ClampedArray*& source, const IntSize& sourceSize, const I
     unsigned char* srcRows = source->data() + originy * srcBytesPerRow + originx * 4;
     for (int y = 0; y < numRows; ++y) {
         unsigned* row = reinterpret_cast<unsigned*>(dataDst + stride * (y + desty));
-        for (int x = 0; x < numColumns; x++) {
-            int basex = x * 4;
-            unsigned* pixel = row + x + destx;
-            Color pixelColor(srcRows[basex],
-                    srcRows[basex + 1],
-                    srcRows[basex + 2],
-                    srcRows[basex + 3]);
-            if (multiplied == Unmultiplied)
-                *pixel = premultipliedARGBFromColor(pixelColor);
-            else
-                *pixel = pixelColor.rgb();
-        }
+        const unsigned* src = reinterpret_cast<const unsigned*>(srcRows);
+        if (multiplied == Unmultiplied)
+            ImageRowKernels::premultiplyARGB(src, row + destx, numColumns, true);
+        else
+            ImageRowKernels::swapRedBlue(src, row + destx, numColumns);
         srcRows += srcBytesPerRow;
     }
 #if (CAIRO_VERSION >= CAIRO_VERSION_ENCODE(1, 12, 0))
@@ -0,0 +1,336 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+
+#include "ImageDecodingServiceWKC.h"
+
+#include "BitmapImage.h"
+#include "ImageDecoder.h"
+#include "ImageWKC.h"
+#include "SharedBuffer.h"
+
+#include <wtf/MainThread.h>
+
+namespace WebCore {
+
+// Smaller images decode faster than a round trip to a worker and back.
+static const unsigned long long cMinPixels = 256 * 256;
+
+WKC_DEFINE_GLOBAL_PTR(ImageDecodingService*, gImageDecodingService, 0);
+
+struct ImageDecodingService::Job {
+    WTF_MAKE_FAST_ALLOCATED;
+public:
+    Job()
+        : m_image(0)
+        , m_distance(0)
+        , m_sequence(0)
+        , m_frame(0)
+        , m_hasAlpha(true)
+    {
+    }
+
+    // 0 once cancelled; main thread only
+    BitmapImage* m_image;
+    // a copy of the encoded data, used by one thread at a time
+    RefPtr<SharedBuffer> m_data;
+    unsigned m_distance;
+    unsigned m_sequence;
+
+    NativeImagePtr m_frame;
+    bool m_hasAlpha;
+};
+
+ImageDecodingService::ImageDecodingService()
+    : m_terminating(false)
+    , m_deliverScheduled(false)
+    , m_sequence(0)
+    , m_paintContext(0)
+{
+}
+
+ImageDecodingService::~ImageDecodingService()
+{
+    stopThreads();
+    cancelCallOnMainThread(deliverProc, this);
+
+    // the images decode on the main thread from now on
+    for (size_t i = 0; i < m_jobs.size(); i++) {
+        Job* job = m_jobs[i];
+        if (job->m_image)
+            job->m_image->didDecodeAsynchronously(0, true);
+        if (job->m_frame)
+            reinterpret_cast<ImageWKC*>(job->m_frame)->unref();
+        delete job;
+    }
+}
+
+bool ImageDecodingService::construct(int threads)
+{
+    for (int i = 0; i < threads; i++) {
+        ThreadIdentifier id = createThread(threadProc, this, "WKC image decoder");
+        if (!id)
+            break;
+        m_threads.append(id);
+    }
+    return !m_threads.isEmpty();
+}
+
+void ImageDecodingService::stopThreads()
+{
+    m_mutex.lock();
+    m_terminating = true;
+    m_condition.broadcast();
+    m_mutex.unlock();
+
+    for (size_t i = 0; i < m_threads.size(); i++)
+        waitForThreadCompletion(m_threads[i]);
+    m_threads.clear();
+}
+
+void ImageDecodingService::setThreadCount(int count)
+{
+    if (count > cMaxThreads)
+        count = cMaxThreads;
+
+    deleteSharedInstance();
+    if (count <= 0)
+        return;
+
+    ImageDecodingService* self = new ImageDecodingService();
+    if (!self->construct(count)) {
+        delete self;
+        return;
+    }
+    gImageDecodingService = self;
+}
+
+ImageDecodingService* ImageDecodingService::sharedInstance()
+{
+    return gImageDecodingService;
+}
+
+void ImageDecodingService::deleteSharedInstance()
+{
+    ImageDecodingService* self = gImageDecodingService;
+    // the images must not cancel into the instance being deleted
+    gImageDecodingService = 0;
+    delete self;
+}
+
+void ImageDecodingService::forceTerminate()
+{
+    // the heap goes away, so only the threads are stopped
+    if (gImageDecodingService)
+        gImageDecodingService->stopThreads();
+    gImageDecodingService = 0;
+}
+
+bool ImageDecodingService::shouldDecodeAsynchronously(const IntSize& size)
+{
+    return static_cast<unsigned long long>(size.width()) * size.height() >= cMinPixels;
+}
+
+void ImageDecodingService::beginPaint(void* drawContext, const IntRect& viewport)
+{
+    m_paintContext = drawContext;
+    m_viewport = viewport;
+}
+
+void ImageDecodingService::endPaint()
+{
+    m_paintContext = 0;
+}
+
+bool ImageDecodingService::isPaintingView(void* drawContext) const
+{
+    return m_paintContext && m_paintContext == drawContext;
+}
+
+unsigned ImageDecodingService::distanceFromViewport(const IntRect& rect) const
+{
+    int dx = 0;
+    if (rect.maxX() < m_viewport.x())
+        dx = m_viewport.x() - rect.maxX();
+    else if (rect.x() > m_viewport.maxX())
+        dx = rect.x() - m_viewport.maxX();
+
+    int dy = 0;
+    if (rect.maxY() < m_viewport.y())
+        dy = m_viewport.y() - rect.maxY();
+    else if (rect.y() > m_viewport.maxY())
+        dy = rect.y() - m_viewport.maxY();
+
+    return dx + dy;
+}
+
+ImageDecodingService::Job* ImageDecodingService::findJob(BitmapImage* image) const
+{
+    for (size_t i = 0; i < m_jobs.size(); i++) {
+        if (m_jobs[i]->m_image == image)
+            return m_jobs[i];
+    }
+    return 0;
+}
+
+void ImageDecodingService::request(BitmapImage* image, SharedBuffer* data, const IntRect& deviceRect)
+{
+    unsigned distance = distanceFromViewport(deviceRect);
+
+    if (Job* job = findJob(image)) {
+        // not yet taken by a worker, so it may move up or down the queue
+        MutexLocker lock(m_mutex);
+        if (m_queued.find(job) != notFound)
+            job->m_distance = distance;
+        return;
+    }
+
+    Job* job = new Job();
+    job->m_image = image;
+    job->m_data = SharedBuffer::create(data->data(), data->size());
+    // the workers ref it in turn, one at a time
+    job->m_data->turnOffVerifier();
+    job->m_distance = distance;
+    job->m_sequence = m_sequence++;
+    m_jobs.append(job);
+
+    MutexLocker lock(m_mutex);
+    m_queued.append(job);
+    m_condition.signal();
+}
+
+void ImageDecodingService::cancel(BitmapImage* image)
+{
+    Job* job = findJob(image);
+    if (!job)
+        return;
+
+    {
+        MutexLocker lock(m_mutex);
+        size_t pos = m_queued.find(job);
+        if (pos == notFound) {
+            // a worker has it; the result is dropped when it comes back
+            job->m_image = 0;
+            return;
+        }
+        m_queued.remove(pos);
+    }
+    m_jobs.remove(m_jobs.find(job));
+    delete job;
+}
+
+ImageDecodingService::Job* ImageDecodingService::takeNearestJob()
+{
+    size_t nearest = 0;
+    for (size_t i = 1; i < m_queued.size(); i++) {
+        const Job* job = m_queued[i];
+        const Job* best = m_queued[nearest];
+        if (job->m_distance < best->m_distance || (job->m_distance == best->m_distance && job->m_sequence < best->m_sequence))
+            nearest = i;
+    }
+    Job* job = m_queued[nearest];
+    m_queued.remove(nearest);
+    return job;
+}
+
+void ImageDecodingService::threadProc(void* self)
+{
+    static_cast<ImageDecodingService*>(self)->decodeLoop();
+}
+
+void ImageDecodingService::decodeLoop()
+{
+    while (true) {
+        m_mutex.lock();
+        while (!m_terminating && m_queued.isEmpty())
+            m_condition.wait(m_mutex);
+        if (m_terminating) {
+            m_mutex.unlock();
+            return;
+        }
+        Job* job = takeNearestJob();
+        m_mutex.unlock();
+
+        decode(job);
+
+        m_mutex.lock();
+        m_done.append(job);
+        bool schedule = !m_deliverScheduled;
+        m_deliverScheduled = true;
+        m_mutex.unlock();
+        if (schedule)
+            callOnMainThread(deliverProc, this);
+    }
+}
+
+void ImageDecodingService::decode(Job* job)
+{
+    // the same options as the ImageSource of a BitmapImage
+    ImageDecoder* decoder = ImageDecoder::create(*job->m_data, ImageSource::AlphaPremultiplied, ImageSource::GammaAndColorProfileApplied, true);
+    if (!decoder)
+        return;
+#if ENABLE(IMAGE_DECODER_DOWN_SAMPLING)
+    if (ImageSource::maxPixelsPerDecodedImage())
+        decoder->setMaxNumPixels(ImageSource::maxPixelsPerDecodedImage());
+#endif
+    decoder->setData(job->m_data.get(), true);
+
+    ImageFrame* buffer = decoder->frameBufferAtIndex(0);
+    if (buffer && buffer->status() == ImageFrame::FrameComplete && !decoder->failed()) {
+        job->m_frame = buffer->asNewNativeImage();
+        job->m_hasAlpha = buffer->hasAlpha();
+    }
+    delete decoder;
+}
+
+void ImageDecodingService::deliverProc(void* self)
+{
+    static_cast<ImageDecodingService*>(self)->deliver();
+}
+
+void ImageDecodingService::deliver()
+{
+    // One job at a time: an image told of its frame may cause others to be
+    // cancelled.
+    while (true) {
+        Job* job = 0;
+        {
+            MutexLocker lock(m_mutex);
+            if (m_done.isEmpty()) {
+                m_deliverScheduled = false;
+                return;
+            }
+            job = m_done.takeFirst();
+        }
+        m_jobs.remove(m_jobs.find(job));
+
+        if (job->m_image)
+            job->m_image->didDecodeAsynchronously(job->m_frame, job->m_hasAlpha);
+        else if (job->m_frame)
+            reinterpret_cast<ImageWKC*>(job->m_frame)->unref();
+        delete job;
+    }
+}
+
+} // namespace WebCore
+
+#endif // ENABLE(WKC_ASYNC_IMAGE_DECODING)
@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ImageDecodingServiceWKC_h
+#define ImageDecodingServiceWKC_h
+
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+
+#include "IntRect.h"
+#include "ImageSource.h"
+
+#include <wtf/Deque.h>
+#include <wtf/FastAllocBase.h>
+#include <wtf/RefPtr.h>
+#include <wtf/Threading.h>
+#include <wtf/Vector.h>
+
+namespace WebCore {
+
+class BitmapImage;
+class SharedBuffer;
+
+// Decodes large single frame images on worker threads, so that painting the
+// view does not wait for the decoders. Until the frame is there, the view
+// paints nothing for the image, and the image asks for the repaint of its
+// rect when the frame arrives.
+// Requests nearest to the viewport are decoded first.
+// The decoders call the wkcMemory peers from the worker threads, so this is
+// off until the port sets a thread count.
+class ImageDecodingService {
+    WTF_MAKE_FAST_ALLOCATED;
+public:
+    // 0 turns it off and drops the requests. At most cMaxThreads.
+    static void setThreadCount(int count);
+    // 0 when off
+    static ImageDecodingService* sharedInstance();
+    static void deleteSharedInstance();
+    static void forceTerminate();
+
+    // whether an image of this size is worth a worker
+    static bool shouldDecodeAsynchronously(const IntSize& size);
+
+    // Marks the paint of the view into drawContext. The viewport is in the
+    // device coordinates of drawContext. Images drawn into other contexts,
+    // as canvas, are decoded on the main thread as before.
+    void beginPaint(void* drawContext, const IntRect& viewport);
+    void endPaint();
+    bool isPaintingView(void* drawContext) const;
+
+    // Decodes the first frame of image from data on a worker. deviceRect is
+    // where the image is painted; a queued request for the same image moves
+    // there. BitmapImage::didDecodeAsynchronously() gets the frame on the
+    // main thread.
+    void request(BitmapImage* image, SharedBuffer* data, const IntRect& deviceRect);
+    void cancel(BitmapImage* image);
+
+    static const int cMaxThreads = 4;
+
+private:
+    ImageDecodingService();
+    ~ImageDecodingService();
+
+    bool construct(int threads);
+    void stopThreads();
+
+    struct Job;
+    Job* findJob(BitmapImage* image) const;
+    unsigned distanceFromViewport(const IntRect& rect) const;
+    // with m_mutex held
+    Job* takeNearestJob();
+
+    static void threadProc(void* self);
+    void decodeLoop();
+    static void decode(Job* job);
+
+    static void deliverProc(void* self);
+    void deliver();
+
+private:
+    Mutex m_mutex;
+    ThreadCondition m_condition;
+    Vector<ThreadIdentifier> m_threads;
+    bool m_terminating;
+
+    // m_queued and m_done are shared with the workers under m_mutex.
+    // m_jobs has every job until it is delivered, main thread only.
+    Vector<Job*> m_jobs;
+    Vector<Job*> m_queued;
+    Deque<Job*> m_done;
+    bool m_deliverScheduled;
+    unsigned m_sequence;
+
+    void* m_paintContext;
+    IntRect m_viewport;
+};
+
+} // namespace WebCore
+
+#endif // ENABLE(WKC_ASYNC_IMAGE_DECODING)
+
+#endif // ImageDecodingServiceWKC_h
@@ -0,0 +1,612 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "ImageRowKernelsWKC.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if CPU(ARM_NEON) && !CPU(BIG_ENDIAN)
+#include <arm_neon.h>
+#define ROW_KERNELS_NEON 1
+#endif
+
+namespace WebCore {
+
+namespace ImageRowKernels {
+
+static const unsigned char cBayer4x4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+// below one step of a 5 bit and of a 6 bit channel
+static inline unsigned dither5(int x, int y)
+{
+    return cBayer4x4[y & 3][x & 3] >> 1;
+}
+
+static inline unsigned dither6(int x, int y)
+{
+    return cBayer4x4[y & 3][x & 3] >> 2;
+}
+
+static inline unsigned addSaturate(unsigned c, unsigned d)
+{
+    c += d;
+    return c > 255 ? 255 : c;
+}
+
+static inline unsigned short packRGB565(unsigned r, unsigned g, unsigned b)
+{
+    return ((r << 8) & 0xf800) | ((g << 3) & 0x07e0) | (b >> 3);
+}
+
+// c * a / 255 rounded down, which is what ImageFrame::setRGBA() gets with
+// c * (a / 255.0f) for every c and a.
+static inline unsigned premultiply(unsigned c, unsigned a)
+{
+    unsigned x = c * a;
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+// Color.cpp rounds up when premultiplying for canvas. The vector versions
+// divide c * a + 254 by 255 as premultiply() does c * a.
+static const unsigned cCanvasPremultiplyBias = 254;
+
+static inline unsigned unpremultipliedPixel(unsigned p)
+{
+    unsigned a = p >> 24;
+    if (!a)
+        return p;
+    unsigned r = ((p >> 16) & 0xff) * 255 / a;
+    unsigned g = ((p >> 8) & 0xff) * 255 / a;
+    unsigned b = (p & 0xff) * 255 / a;
+    return (a << 24) | ((r > 255 ? 255 : r) << 16) | ((g > 255 ? 255 : g) << 8) | (b > 255 ? 255 : b);
+}
+
+static inline unsigned premultipliedPixel(unsigned p)
+{
+    unsigned a = p >> 24;
+    if (a == 255)
+        return p;
+    return (a << 24)
+        | ((((p >> 16) & 0xff) * a + cCanvasPremultiplyBias) / 255) << 16
+        | ((((p >> 8) & 0xff) * a + cCanvasPremultiplyBias) / 255) << 8
+        | (((p & 0xff) * a + cCanvasPremultiplyBias) / 255);
+}
+
+static inline unsigned swappedPixel(unsigned p)
+{
+    return (p & 0xff00ff00) | ((p >> 16) & 0xff) | ((p & 0xff) << 16);
+}
+
+#if defined(__SSE2__)
+// dither for 4 pixels from (x, y), as bytes in the order R G B X or B G R X
+static inline __m128i ditherBytes4(int x, int y)
+{
+    unsigned d[4];
+    for (int i = 0; i < 4; i++)
+        d[i] = dither5(x + i, y) | (dither6(x + i, y) << 8) | (dither5(x + i, y) << 16);
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(d));
+}
+
+// 32 bit lanes holding at most 0xffff to 16 bit lanes
+static inline __m128i packLanes(__m128i lo, __m128i hi)
+{
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16(static_cast<short>(0x8000));
+    return _mm_add_epi16(_mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32)), bias16);
+}
+
+// lanes of 0xXXBBGGRR to RGB565 in 32 bit lanes
+static inline __m128i rgbxToRGB565Lanes(__m128i p)
+{
+    __m128i r = _mm_and_si128(_mm_slli_epi32(p, 8), _mm_set1_epi32(0xf800));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07e0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 19), _mm_set1_epi32(0x001f));
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+// lanes of 0xXXRRGGBB to RGB565 in 32 bit lanes
+static inline __m128i bgrxToRGB565Lanes(__m128i p)
+{
+    __m128i r = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xf800));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07e0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001f));
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+// lanes of 0xAABBGGRR to 0xAARRGGBB
+static inline __m128i swapRB(__m128i p)
+{
+    __m128i r = _mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xff)), 16);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 16), _mm_set1_epi32(0xff));
+    return _mm_or_si128(_mm_or_si128(r, b), _mm_and_si128(p, _mm_set1_epi32(0xff00ff00)));
+}
+
+// 4 pixels with the alpha in the top byte, premultiplied in place. bias is
+// added to c * a before the division by 255.
+static inline __m128i premultiply4(__m128i p, short bias)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i biasLanes = _mm_set1_epi16(bias);
+    const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+    __m128i halves[2] = { _mm_unpacklo_epi8(p, zero), _mm_unpackhi_epi8(p, zero) };
+    for (int i = 0; i < 2; i++) {
+        __m128i v = halves[i];
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xff), 0xff);
+        __m128i m = _mm_add_epi16(_mm_mullo_epi16(v, a), biasLanes);
+        m = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(m, one), _mm_srli_epi16(m, 8)), 8);
+        halves[i] = _mm_or_si128(_mm_andnot_si128(alphaLanes, m), _mm_and_si128(alphaLanes, v));
+    }
+    return _mm_packus_epi16(halves[0], halves[1]);
+}
+
+static inline bool allOpaque4(__m128i p)
+{
+    const __m128i opaque = _mm_set1_epi32(0xff000000);
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(p, opaque), opaque)) == 0xffff;
+}
+
+// c * 255 / a rounded down and clamped to 255, for c and a in 32 bit lanes.
+// Both are below 2^16, so the truncated float quotient is the exact one.
+static inline __m128i unpremultiplyLanes(__m128i c, __m128 a)
+{
+    const __m128i max = _mm_set1_epi32(0xff);
+    c = _mm_sub_epi32(_mm_slli_epi32(c, 8), c);
+    c = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(c), a));
+    __m128i over = _mm_cmpgt_epi32(c, max);
+    return _mm_or_si128(_mm_andnot_si128(over, c), _mm_and_si128(over, max));
+}
+
+// 4 premultiplied pixels with the alpha in the top byte to unpremultiplied.
+// Transparent pixels are kept as they are.
+static inline __m128i unpremultiply4(__m128i p)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    __m128i alpha = _mm_srli_epi32(p, 24);
+    __m128i transparent = _mm_cmpeq_epi32(alpha, _mm_setzero_si128());
+    __m128 a = _mm_cvtepi32_ps(_mm_or_si128(alpha, _mm_and_si128(transparent, _mm_set1_epi32(1))));
+
+    __m128i q = _mm_slli_epi32(alpha, 24);
+    q = _mm_or_si128(q, unpremultiplyLanes(_mm_and_si128(p, mask), a));
+    q = _mm_or_si128(q, _mm_slli_epi32(unpremultiplyLanes(_mm_and_si128(_mm_srli_epi32(p, 8), mask), a), 8));
+    q = _mm_or_si128(q, _mm_slli_epi32(unpremultiplyLanes(_mm_and_si128(_mm_srli_epi32(p, 16), mask), a), 16));
+    return _mm_or_si128(_mm_andnot_si128(transparent, q), _mm_and_si128(transparent, p));
+}
+#endif // __SSE2__
+
+#if defined(__SSSE3__)
+// 4 RGB pixels of the first 12 bytes to 0x00BBGGRR lanes
+static inline __m128i expandRGB4(const unsigned char* src)
+{
+    const __m128i mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), mask);
+}
+#endif
+
+#if ROW_KERNELS_NEON
+// dither for 8 pixels from (x, y)
+static inline uint8x8_t ditherVector5(int x, int y)
+{
+    unsigned char d[8];
+    for (int i = 0; i < 8; i++)
+        d[i] = dither5(x + i, y);
+    return vld1_u8(d);
+}
+
+static inline uint8x8_t ditherVector6(int x, int y)
+{
+    unsigned char d[8];
+    for (int i = 0; i < 8; i++)
+        d[i] = dither6(x + i, y);
+    return vld1_u8(d);
+}
+
+static inline uint16x8_t packRGB565x8(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+    uint16x8_t v = vandq_u16(vshll_n_u8(r, 8), vdupq_n_u16(0xf800));
+    v = vorrq_u16(v, vandq_u16(vshll_n_u8(g, 3), vdupq_n_u16(0x07e0)));
+    return vorrq_u16(v, vmovl_u8(vshr_n_u8(b, 3)));
+}
+
+// bias is added to c * a before the division by 255
+static inline uint8x8_t premultiply8(uint8x8_t c, uint8x8_t a, unsigned short bias)
+{
+    uint16x8_t m = vaddq_u16(vmull_u8(c, a), vdupq_n_u16(bias));
+    m = vaddq_u16(vaddq_u16(m, vdupq_n_u16(1)), vshrq_n_u16(m, 8));
+    return vshrn_n_u16(m, 8);
+}
+
+static inline bool allOpaque8(uint8x8_t minAlpha)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(minAlpha), 0) == 0xffffffffffffffffULL;
+}
+
+// close to 1 / a; there is no float division on ARMv7
+static inline float32x4_t reciprocal4(uint32x4_t a)
+{
+    float32x4_t af = vcvtq_f32_u32(a);
+    float32x4_t r = vrecpeq_f32(af);
+    r = vmulq_f32(vrecpsq_f32(af, r), r);
+    return vmulq_f32(vrecpsq_f32(af, r), r);
+}
+
+// c * 255 / a rounded down. The estimate from the reciprocal is at most one
+// off, and the remainder tells which way.
+static inline uint32x4_t unpremultiplyLanes(uint32x4_t c, uint32x4_t a, float32x4_t reciprocal)
+{
+    uint32x4_t x = vmulq_n_u32(c, 255);
+    uint32x4_t q = vcvtq_u32_f32(vmulq_f32(vcvtq_f32_u32(x), reciprocal));
+    int32x4_t r = vreinterpretq_s32_u32(vmlsq_u32(x, q, a));
+    q = vaddq_u32(q, vcltq_s32(r, vdupq_n_s32(0)));
+    return vsubq_u32(q, vcgeq_s32(r, vreinterpretq_s32_u32(a)));
+}
+
+// 8 color channels, clamped to 255
+static inline uint8x8_t unpremultiply8(uint8x8_t c, uint32x4_t aLow, uint32x4_t aHigh, float32x4_t rLow, float32x4_t rHigh)
+{
+    uint16x8_t c16 = vmovl_u8(c);
+    uint32x4_t low = unpremultiplyLanes(vmovl_u16(vget_low_u16(c16)), aLow, rLow);
+    uint32x4_t high = unpremultiplyLanes(vmovl_u16(vget_high_u16(c16)), aHigh, rHigh);
+    return vqmovn_u16(vcombine_u16(vqmovn_u32(low), vqmovn_u32(high)));
+}
+#endif // ROW_KERNELS_NEON
+
+void rgbToARGB8888(const unsigned char* src, unsigned colorChannels, unsigned* dst, int length)
+{
+#if ROW_KERNELS_NEON
+    if (colorChannels == 3) {
+        for (; length >= 16; length -= 16, src += 48, dst += 16) {
+            uint8x16x3_t s = vld3q_u8(src);
+            uint8x16x4_t d = { { s.val[2], s.val[1], s.val[0], vdupq_n_u8(0xff) } };
+            vst4q_u8(reinterpret_cast<uint8_t*>(dst), d);
+        }
+    } else {
+        for (; length >= 16; length -= 16, src += 64, dst += 16) {
+            uint8x16x4_t s = vld4q_u8(src);
+            uint8x16x4_t d = { { s.val[2], s.val[1], s.val[0], vdupq_n_u8(0xff) } };
+            vst4q_u8(reinterpret_cast<uint8_t*>(dst), d);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i opaque = _mm_set1_epi32(0xff000000);
+    if (colorChannels == 4) {
+        for (; length >= 4; length -= 4, src += 16, dst += 4) {
+            __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(swapRB(p), opaque));
+        }
+    }
+#if defined(__SSSE3__)
+    else {
+        // 16 bytes are read for 12, so stop 4 bytes early
+        const __m128i mask = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+        for (; length >= 6; length -= 4, src += 12, dst += 4) {
+            __m128i p = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), mask);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(p, opaque));
+        }
+    }
+#endif
+#endif
+
+    for (; length > 0; length--, src += colorChannels)
+        *dst++ = 0xff000000 | (src[0] << 16) | (src[1] << 8) | src[2];
+}
+
+bool rgbaToARGB8888(const unsigned char* src, unsigned* dst, int length, bool premultiplyAlpha)
+{
+    bool opaque = true;
+
+#if ROW_KERNELS_NEON
+    uint8x8_t minAlpha = vdup_n_u8(0xff);
+    for (; length >= 8; length -= 8, src += 32, dst += 8) {
+        uint8x8x4_t s = vld4_u8(src);
+        minAlpha = vmin_u8(minAlpha, s.val[3]);
+        if (premultiplyAlpha) {
+            s.val[0] = premultiply8(s.val[0], s.val[3], 0);
+            s.val[1] = premultiply8(s.val[1], s.val[3], 0);
+            s.val[2] = premultiply8(s.val[2], s.val[3], 0);
+        }
+        uint8x8x4_t d = { { s.val[2], s.val[1], s.val[0], s.val[3] } };
+        vst4_u8(reinterpret_cast<uint8_t*>(dst), d);
+    }
+    opaque = allOpaque8(minAlpha);
+#elif defined(__SSE2__)
+    for (; length >= 4; length -= 4, src += 16, dst += 4) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        if (!allOpaque4(p)) {
+            opaque = false;
+            if (premultiplyAlpha)
+                p = premultiply4(p, 0);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), swapRB(p));
+    }
+#endif
+
+    for (; length > 0; length--, src += 4) {
+        unsigned r = src[0];
+        unsigned g = src[1];
+        unsigned b = src[2];
+        unsigned a = src[3];
+        if (a < 255) {
+            opaque = false;
+            if (premultiplyAlpha) {
+                r = premultiply(r, a);
+                g = premultiply(g, a);
+                b = premultiply(b, a);
+            }
+        }
+        *dst++ = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+    return !opaque;
+}
+
+void rgbToRGB565(const unsigned char* src, unsigned colorChannels, unsigned short* dst, int length, bool dither, int x, int y)
+{
+#if ROW_KERNELS_NEON
+    const uint8x8_t d5 = dither ? ditherVector5(x, y) : vdup_n_u8(0);
+    const uint8x8_t d6 = dither ? ditherVector6(x, y) : vdup_n_u8(0);
+    if (colorChannels == 3) {
+        for (; length >= 8; length -= 8, src += 24, dst += 8, x += 8) {
+            uint8x8x3_t s = vld3_u8(src);
+            vst1q_u16(dst, packRGB565x8(vqadd_u8(s.val[0], d5), vqadd_u8(s.val[1], d6), vqadd_u8(s.val[2], d5)));
+        }
+    } else {
+        for (; length >= 8; length -= 8, src += 32, dst += 8, x += 8) {
+            uint8x8x4_t s = vld4_u8(src);
+            vst1q_u16(dst, packRGB565x8(vqadd_u8(s.val[0], d5), vqadd_u8(s.val[1], d6), vqadd_u8(s.val[2], d5)));
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i d = dither ? ditherBytes4(x, y) : _mm_setzero_si128();
+    if (colorChannels == 4) {
+        for (; length >= 8; length -= 8, src += 32, dst += 8, x += 8) {
+            __m128i lo = _mm_adds_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), d);
+            __m128i hi = _mm_adds_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), d);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), packLanes(rgbxToRGB565Lanes(lo), rgbxToRGB565Lanes(hi)));
+        }
+    }
+#if defined(__SSSE3__)
+    else {
+        // 16 bytes are read for 12, so stop 4 bytes early
+        for (; length >= 10; length -= 8, src += 24, dst += 8, x += 8) {
+            __m128i lo = _mm_adds_epu8(expandRGB4(src), d);
+            __m128i hi = _mm_adds_epu8(expandRGB4(src + 12), d);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), packLanes(rgbxToRGB565Lanes(lo), rgbxToRGB565Lanes(hi)));
+        }
+    }
+#endif
+#endif
+
+    for (; length > 0; length--, src += colorChannels, x++) {
+        if (dither)
+            *dst++ = packRGB565(addSaturate(src[0], dither5(x, y)), addSaturate(src[1], dither6(x, y)), addSaturate(src[2], dither5(x, y)));
+        else
+            *dst++ = packRGB565(src[0], src[1], src[2]);
+    }
+}
+
+bool rgbaToRGB565(const unsigned char* src, unsigned short* dst, int length, bool premultiplyAlpha)
+{
+    bool opaque = true;
+
+#if ROW_KERNELS_NEON
+    uint8x8_t minAlpha = vdup_n_u8(0xff);
+    for (; length >= 8; length -= 8, src += 32, dst += 8) {
+        uint8x8x4_t s = vld4_u8(src);
+        minAlpha = vmin_u8(minAlpha, s.val[3]);
+        if (premultiplyAlpha) {
+            s.val[0] = premultiply8(s.val[0], s.val[3], 0);
+            s.val[1] = premultiply8(s.val[1], s.val[3], 0);
+            s.val[2] = premultiply8(s.val[2], s.val[3], 0);
+        }
+        vst1q_u16(dst, packRGB565x8(s.val[0], s.val[1], s.val[2]));
+    }
+    opaque = allOpaque8(minAlpha);
+#elif defined(__SSE2__)
+    for (; length >= 8; length -= 8, src += 32, dst += 8) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+        if (!allOpaque4(lo)) {
+            opaque = false;
+            if (premultiplyAlpha)
+                lo = premultiply4(lo, 0);
+        }
+        if (!allOpaque4(hi)) {
+            opaque = false;
+            if (premultiplyAlpha)
+                hi = premultiply4(hi, 0);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), packLanes(rgbxToRGB565Lanes(lo), rgbxToRGB565Lanes(hi)));
+    }
+#endif
+
+    for (; length > 0; length--, src += 4) {
+        unsigned r = src[0];
+        unsigned g = src[1];
+        unsigned b = src[2];
+        unsigned a = src[3];
+        if (a < 255) {
+            opaque = false;
+            if (premultiplyAlpha) {
+                r = premultiply(r, a);
+                g = premultiply(g, a);
+                b = premultiply(b, a);
+            }
+        }
+        *dst++ = packRGB565(r, g, b);
+    }
+    return !opaque;
+}
+
+void argb8888ToRGB565(const unsigned* src, unsigned short* dst, int length, bool dither, int x, int y)
+{
+#if ROW_KERNELS_NEON
+    const uint8x8_t d5 = dither ? ditherVector5(x, y) : vdup_n_u8(0);
+    const uint8x8_t d6 = dither ? ditherVector6(x, y) : vdup_n_u8(0);
+    for (; length >= 8; length -= 8, src += 8, dst += 8, x += 8) {
+        uint8x8x4_t s = vld4_u8(reinterpret_cast<const uint8_t*>(src));
+        vst1q_u16(dst, packRGB565x8(vqadd_u8(s.val[2], d5), vqadd_u8(s.val[1], d6), vqadd_u8(s.val[0], d5)));
+    }
+#elif defined(__SSE2__)
+    const __m128i d = dither ? ditherBytes4(x, y) : _mm_setzero_si128();
+    for (; length >= 8; length -= 8, src += 8, dst += 8, x += 8) {
+        __m128i lo = _mm_adds_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), d);
+        __m128i hi = _mm_adds_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4)), d);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), packLanes(bgrxToRGB565Lanes(lo), bgrxToRGB565Lanes(hi)));
+    }
+#endif
+
+    for (; length > 0; length--, x++) {
+        const unsigned v = *src++;
+        if (dither)
+            *dst++ = packRGB565(addSaturate((v >> 16) & 0xff, dither5(x, y)), addSaturate((v >> 8) & 0xff, dither6(x, y)), addSaturate(v & 0xff, dither5(x, y)));
+        else
+            *dst++ = (unsigned short)(((v >> 8) & 0xf800) | ((v >> 5) & 0x07e0) | ((v >> 3) & 0x1f));
+    }
+}
+
+void unpremultiplyARGB(const unsigned* src, unsigned* dst, int length, bool swapChannels)
+{
+#if ROW_KERNELS_NEON
+    for (; length >= 8; length -= 8, src += 8, dst += 8) {
+        uint8x8x4_t s = vld4_u8(reinterpret_cast<const uint8_t*>(src));
+        uint8x8_t transparent = vceq_u8(s.val[3], vdup_n_u8(0));
+        uint16x8_t a16 = vmovl_u8(vmax_u8(s.val[3], vdup_n_u8(1)));
+        uint32x4_t aLow = vmovl_u16(vget_low_u16(a16));
+        uint32x4_t aHigh = vmovl_u16(vget_high_u16(a16));
+        float32x4_t rLow = reciprocal4(aLow);
+        float32x4_t rHigh = reciprocal4(aHigh);
+
+        uint8x8x4_t d;
+        for (int i = 0; i < 3; i++)
+            d.val[i] = vbsl_u8(transparent, s.val[i], unpremultiply8(s.val[i], aLow, aHigh, rLow, rHigh));
+        d.val[3] = s.val[3];
+        if (swapChannels) {
+            uint8x8_t b = d.val[0];
+            d.val[0] = d.val[2];
+            d.val[2] = b;
+        }
+        vst4_u8(reinterpret_cast<uint8_t*>(dst), d);
+    }
+#elif defined(__SSE2__)
+    for (; length >= 4; length -= 4, src += 4, dst += 4) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        if (!allOpaque4(p))
+            p = unpremultiply4(p);
+        if (swapChannels)
+            p = swapRB(p);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), p);
+    }
+#endif
+
+    for (; length > 0; length--) {
+        unsigned p = unpremultipliedPixel(*src++);
+        *dst++ = swapChannels ? swappedPixel(p) : p;
+    }
+}
+
+void premultiplyARGB(const unsigned* src, unsigned* dst, int length, bool swapChannels)
+{
+#if ROW_KERNELS_NEON
+    for (; length >= 8; length -= 8, src += 8, dst += 8) {
+        uint8x8x4_t s = vld4_u8(reinterpret_cast<const uint8_t*>(src));
+        uint8x8x4_t d;
+        for (int i = 0; i < 3; i++)
+            d.val[i] = premultiply8(s.val[i], s.val[3], cCanvasPremultiplyBias);
+        d.val[3] = s.val[3];
+        if (swapChannels) {
+            uint8x8_t b = d.val[0];
+            d.val[0] = d.val[2];
+            d.val[2] = b;
+        }
+        vst4_u8(reinterpret_cast<uint8_t*>(dst), d);
+    }
+#elif defined(__SSE2__)
+    for (; length >= 4; length -= 4, src += 4, dst += 4) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        if (!allOpaque4(p))
+            p = premultiply4(p, cCanvasPremultiplyBias);
+        if (swapChannels)
+            p = swapRB(p);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), p);
+    }
+#endif
+
+    for (; length > 0; length--) {
+        unsigned p = *src++;
+        if (swapChannels)
+            p = swappedPixel(p);
+        *dst++ = premultipliedPixel(p);
+    }
+}
+
+void swapRedBlue(const unsigned* src, unsigned* dst, int length)
+{
+#if ROW_KERNELS_NEON
+    for (; length >= 16; length -= 16, src += 16, dst += 16) {
+        uint8x16x4_t s = vld4q_u8(reinterpret_cast<const uint8_t*>(src));
+        uint8x16x4_t d = { { s.val[2], s.val[1], s.val[0], s.val[3] } };
+        vst4q_u8(reinterpret_cast<uint8_t*>(dst), d);
+    }
+#elif defined(__SSE2__)
+    for (; length >= 4; length -= 4, src += 4, dst += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), swapRB(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src))));
+#endif
+
+    for (; length > 0; length--)
+        *dst++ = swappedPixel(*src++);
+}
+
+void transformARGB(unsigned* pixels, int length, const int* lookUpTable)
+{
+    // Color() clamps the table entries
+    unsigned char table[256];
+    for (int i = 0; i < 256; i++)
+        table[i] = lookUpTable[i] < 0 ? 0 : (lookUpTable[i] > 255 ? 255 : lookUpTable[i]);
+
+    // a chunk at a time, so that the vector passes run on cached pixels
+    const int cChunk = 64;
+    unsigned buffer[cChunk];
+    while (length > 0) {
+        int count = length < cChunk ? length : cChunk;
+        unpremultiplyARGB(pixels, buffer, count, false);
+        for (int i = 0; i < count; i++) {
+            unsigned p = buffer[i];
+            buffer[i] = (p & 0xff000000) | (table[(p >> 16) & 0xff] << 16) | (table[(p >> 8) & 0xff] << 8) | table[p & 0xff];
+        }
+        premultiplyARGB(buffer, pixels, count, false);
+        pixels += count;
+        length -= count;
+    }
+}
+
+} // namespace ImageRowKernels
+
+} // namespace WebCore
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#ifndef ImageRowKernelsWKC_h
+#define ImageRowKernelsWKC_h
+
+namespace WebCore {
+
+// Conversions of decoded rows into ImageWKC pixels.
+// SSE2, SSSE3 or NEON versions are chosen at build time from the target, as
+// in VectorMath, and give the same pixels as the scalar loops.
+// For RGB565, dither adds a 4x4 ordered dither pattern taken at (x, y),
+// the position of the first pixel in the image.
+namespace ImageRowKernels {
+
+// RGB, or RGBX with colorChannels 4, to opaque ARGB8888
+void rgbToARGB8888(const unsigned char* src, unsigned colorChannels, unsigned* dst, int length);
+// RGBA to ARGB8888. Returns whether any pixel is not opaque.
+bool rgbaToARGB8888(const unsigned char* src, unsigned* dst, int length, bool premultiply);
+
+// RGB, or RGBX with colorChannels 4, to RGB565
+void rgbToRGB565(const unsigned char* src, unsigned colorChannels, unsigned short* dst, int length, bool dither, int x, int y);
+// RGBA to RGB565, which drops the alpha. Returns whether any pixel is not opaque.
+bool rgbaToRGB565(const unsigned char* src, unsigned short* dst, int length, bool premultiply);
+// ARGB8888 to RGB565, which drops the alpha
+void argb8888ToRGB565(const unsigned* src, unsigned short* dst, int length, bool dither, int x, int y);
+
+// Conversions of ImageBuffer pixels for canvas image data. These round as
+// colorFromPremultipliedARGB() and premultipliedARGBFromColor() do, so
+// getImageData() and putImageData() give the same bytes as with Color.
+// swapChannels turns the result into RGBA bytes, or takes RGBA bytes in.
+// src and dst may be the same.
+
+// premultiplied ARGB8888 to unpremultiplied, as colorFromPremultipliedARGB()
+void unpremultiplyARGB(const unsigned* src, unsigned* dst, int length, bool swapChannels);
+// ARGB8888 to premultiplied, as premultipliedARGBFromColor()
+void premultiplyARGB(const unsigned* src, unsigned* dst, int length, bool swapChannels);
+// ARGB8888 to RGBA bytes or back
+void swapRedBlue(const unsigned* src, unsigned* dst, int length);
+// the color channels of premultiplied ARGB8888 pixels through a table of
+// 256 entries, as ImageBuffer::transformColorSpace() wants
+void transformARGB(unsigned* pixels, int length, const int* lookUpTable);
+
+} // namespace ImageRowKernels
+
+} // namespace WebCore
+
+#endif // ImageRowKernelsWKC_h
@@ -35,10 +35,15 @@
 #include "FastMalloc.h"
 #include "TransformationMatrix.h"
 #include "FloatConversion.h"
+#include "ImageRowKernelsWKC.h"
 #include "ImageSource.h"
 
 #include "NotImplemented.h"
 
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+#include "DecodedImageBudgetWKC.h"
+#endif
+
 #if USE(WKC_CAIRO)
 #include "PlatformContextCairo.h"
 #include "CairoUtilities.h"
@@ -48,6 +53,17 @@
 
 namespace WebCore {
 
+static bool allocateBitmap(int size, void*& bitmap)
+{
+    if (!wkcMemoryCheckMemoryAllocatablePeer(size, wkcMemoryGetAllocationStatePeer()))
+        return false;
+
+    wkcMemorySetAllocatingForImagesPeer(true);
+    WTF::TryMallocReturnValue rv = WTF::tryFastMalloc(size);
+    wkcMemorySetAllocatingForImagesPeer(false);
+    return rv.getValue(bitmap);
+}
+
 static inline void platformRect(const FloatRect& in, WKCFloatRect& out)
 {
     out.fX = in.x();
@@ -93,6 +109,7 @@ ImageWKC::platformOperator(CompositeOperator op)
 
 static int gInternalFormat = ImageWKC::EColorRGB565;
 static bool gReduceTo565IfPossible = false;
+static bool gDitherRGB565 = false;
 
 void
 ImageWKC::setInternalColorFormatARGB8888(bool reduceifpossible)
@@ -108,6 +125,12 @@ ImageWKC::setInternalColorFormatRGB565()
     gReduceTo565IfPossible = false;
 }
 
+void
+ImageWKC::setDitherRGB565(bool flag)
+{
+    gDitherRGB565 = flag;
+}
+
 ImageWKC::ImageWKC(int type, void* bitmap, int rowbytes, const IntSize& size, bool ownbitmap, bool onstack)
     : m_refcount(1)
     , m_type(type)
@@ -187,14 +210,12 @@ ImageWKC::resize(const IntSize& size)
 
     const int len = width * size.height();
     void* newbitmap = 0;
-    bool allocSucceeded = false;
-
-    if (wkcMemoryCheckMemoryAllocatablePeer(len * m_bpp, wkcMemoryGetAllocationStatePeer())) {
-        wkcMemorySetAllocatingForImagesPeer(true);
-        WTF::TryMallocReturnValue rv = WTF::tryFastMalloc(len * m_bpp);
-        wkcMemorySetAllocatingForImagesPeer(false);
-        allocSucceeded = rv.getValue(newbitmap);
-    }
+    bool allocSucceeded = allocateBitmap(len * m_bpp, newbitmap);
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    // the decoded frames of other images go before the allocation fails
+    if (!allocSucceeded && DecodedImageBudget::evictForAllocation(len * m_bpp))
+        allocSucceeded = allocateBitmap(len * m_bpp, newbitmap);
+#endif
     if (!allocSucceeded) {
         wkcMemoryNotifyMemoryAllocationErrorPeer(len * m_bpp, wkcMemoryGetAllocationStatePeer());
         return false;
@@ -315,10 +336,8 @@ ImageWKC::notifyStatus(int status)
     const unsigned int* src = (const unsigned int *)m_bitmap;
     for (int y=0; y<m_size.height(); y++) {
         unsigned short* dest = (unsigned short *)newimg + y*w;
-        for (int x=0; x<m_size.width(); x++) {
-            const unsigned int v = *src++;
-            *dest++ = (unsigned short)(((v>>8)&0xf800) | ((v>>5)&0x07e0) | ((v>>3)&0x1f));
-        }
+        ImageRowKernels::argb8888ToRGB565(src, dest, m_size.width(), gDitherRGB565, 0, y);
+        src += m_size.width();
     }
 
     fastFree(m_bitmap);
@@ -364,9 +383,6 @@ ImageWKC::setRGBLine(int xStart, int xEnd, int y, unsigned char *src, unsigned c
 
     ASSERT(colorChannels == 3 || colorChannels == 4);
 
-    unsigned char r;
-    unsigned char g;
-    unsigned char b;
     int len = xEnd - xStart;
 
     ASSERT(len > 0);
@@ -376,40 +392,32 @@ ImageWKC::setRGBLine(int xStart, int xEnd, int y, unsigned char *src, unsigned c
 
     if (m_type==EColorRGB565) {
         unsigned short* d = reinterpret_cast<unsigned short *>((char *)m_bitmap + y*m_rowbytes + xStart*m_bpp);
-        if (colorChannels == 3) {
-            while (len--) {
-                r = *src++;
-                g = *src++;
-                b = *src++;
-                *d++ = ((r<<8)&0xf800) | ((g<<3)&0x07e0) | ((b>>3)&0x001f);
-            }
-        } else {
-            while (len--) {
-                r = *src++;
-                g = *src++;
-                b = *src++;
-                src++;
-                *d++ = ((r<<8)&0xf800) | ((g<<3)&0x07e0) | ((b>>3)&0x001f);
-            }
-        }
+        ImageRowKernels::rgbToRGB565(src, colorChannels, d, len, gDitherRGB565, xStart, y);
     } else {
         unsigned int*d = reinterpret_cast<unsigned int *>((char *)m_bitmap + y*m_rowbytes + xStart*m_bpp);
-        if (colorChannels == 3) {
-            while (len--) {
-                r = *src++;
-                g = *src++;
-                b = *src++;
-                *d++ = 0xFF000000 | (r<<16) | (g<<8) | b;
-            }
-        } else {
-            while (len--) {
-                r = *src++;
-                g = *src++;
-                b = *src++;
-                src++;
-                *d++ = 0xFF000000 | (r<<16) | (g<<8) | b;
-            }
-        }
+        ImageRowKernels::rgbToARGB8888(src, colorChannels, d, len);
+    }
+}
+
+bool
+ImageWKC::setRGBALine(int xStart, int xEnd, int y, unsigned char *src, bool premultiplyAlpha)
+{
+    if (!m_bitmap)
+        return false;
+
+    int len = xEnd - xStart;
+
+    ASSERT(len > 0);
+
+    if (m_decodedLines < y + 1)
+        m_decodedLines = y + 1;
+
+    if (m_type==EColorRGB565) {
+        unsigned short* d = reinterpret_cast<unsigned short *>((char *)m_bitmap + y*m_rowbytes + xStart*m_bpp);
+        return ImageRowKernels::rgbaToRGB565(src, d, len, premultiplyAlpha);
+    } else {
+        unsigned int*d = reinterpret_cast<unsigned int *>((char *)m_bitmap + y*m_rowbytes + xStart*m_bpp);
+        return ImageRowKernels::rgbaToARGB8888(src, d, len, premultiplyAlpha);
     }
 }
 
@@ -439,6 +447,10 @@ BitmapImage::BitmapImage(void* in_image, ImageObserver* in_observer)
     , m_haveSize(true)
     , m_sizeAvailable(true)
     , m_haveFrameCount(true)
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    , m_decodingAsynchronously(false)
+    , m_asynchronousDecodeFailed(false)
+#endif
 {
     ImageWKC* img = (ImageWKC *)in_image;
     int mul = 1;
@@ -518,6 +530,12 @@ void BitmapImage::draw(GraphicsContext* context, const FloatRect& dst, const Flo
     // causing flicker and wasting CPU.
     startAnimation();
 
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    // nothing until the worker is done; the image repaints itself then
+    if (decodeAsynchronously(context, dst))
+        return;
+#endif
+
     ImageWKC* bitmap = 0;
     if (!isThreeDImage())
         bitmap = (ImageWKC *)frameAtIndex(m_currentFrame);
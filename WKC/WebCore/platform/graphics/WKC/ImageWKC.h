@@ -42,6 +42,8 @@ class ImageWKC {
 public:
     static void setInternalColorFormatARGB8888(bool reduceifpossible=false);
     static void setInternalColorFormatRGB565();
+    // ordered dithering when writing or reducing to RGB565
+    static void setDitherRGB565(bool flag);
 
 public:
     static ImageWKC* create(int type=EColorARGB8888, void* bitmap=0, int rowbytes=0, const IntSize& size=IntSize(), bool ownbitmap=true);
@@ -56,6 +58,8 @@ public:
     void zeroFill();
     bool copyImage(const ImageWKC*);
     void setRGBLine(int xStart, int xEnd, int y, unsigned char *src, unsigned colorChannels);
+    // returns whether any pixel is not opaque
+    bool setRGBALine(int xStart, int xEnd, int y, unsigned char *src, bool premultiplyAlpha);
 
     bool resize(const IntSize&);
     void clear();
@@ -111,6 +111,13 @@ MPOImageDecoder::setData(SharedBuffer* data, bool allDataReceived)
         }
     }
 
+#if ENABLE(IMAGE_DECODER_DOWN_SAMPLING)
+    // the frames are decoded, and downsampled, by the JPEG decoders
+    m_decoderL->setMaxNumPixels(maxNumPixels());
+    if (m_decoderR)
+        m_decoderR->setMaxNumPixels(maxNumPixels());
+#endif
+
     if (!m_decoderR || data->size() < m_rightImageOffset) {
         m_decodingL = true;
         m_decoderL->setData(data, allDataReceived);
@@ -0,0 +1,541 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "CookieStoreWKC.h"
+
+#include "Cookie.h"
+#include "CString.h"
+#include "CurrentTime.h"
+
+#include <algorithm>
+#include <wtf/HashSet.h>
+#include <wtf/text/StringBuilder.h>
+#include <wkc/wkcpeer.h>
+
+#if 1
+# define W_DP(a) ((void)0)
+#else
+# define W_DP(a) wkcDebugPrintfPeer a
+#endif
+
+namespace WebCore {
+
+static const char cHttpOnlyPrefix[] = "#HttpOnly_";
+
+CookieStore::PathNode::~PathNode()
+{
+    HashMap<String, PathNode*>::iterator end = m_children.end();
+    for (HashMap<String, PathNode*>::iterator it = m_children.begin(); it != end; ++it)
+        delete it->second;
+}
+
+CookieStore::CookieStore()
+    : m_dirty(true)
+{
+}
+
+CookieStore::~CookieStore()
+{
+    clear();
+}
+
+void CookieStore::clear()
+{
+    HashMap<String, PathNode*>::iterator end = m_domains.end();
+    for (HashMap<String, PathNode*>::iterator it = m_domains.begin(); it != end; ++it)
+        delete it->second;
+    m_domains.clear();
+
+    deleteAllValues(m_records);
+    m_records.clear();
+}
+
+// RFC 6265 5.1.4
+static bool pathMatches(const String& cookiePath, const String& requestPath)
+{
+    if (!requestPath.startsWith(cookiePath))
+        return false;
+    if (requestPath.length() == cookiePath.length())
+        return true;
+    if (cookiePath.endsWith("/"))
+        return true;
+    return requestPath[cookiePath.length()] == '/';
+}
+
+bool CookieStore::parse(const char* line)
+{
+    // see get_netscape_format() in cURL/lib/cookie.c
+    // domain \t tailmatch \t path \t secure \t expires \t name \t value
+    Record* record = new Record;
+    if (!record)
+        return false;
+
+    record->m_line = String::fromUTF8(line);
+    record->m_httpOnly = false;
+    if (!strncmp(line, cHttpOnlyPrefix, sizeof(cHttpOnlyPrefix) - 1)) {
+        record->m_httpOnly = true;
+        line += sizeof(cHttpOnlyPrefix) - 1;
+    }
+
+    Vector<String> fields;
+    String(String::fromUTF8(line)).split('\t', true, fields);
+    if (fields.size() < 6) {
+        delete record;
+        return false;
+    }
+
+    String domain = fields[0].lower();
+    if (domain.startsWith("."))
+        domain = domain.substring(1);
+    record->m_domain = domain;
+    record->m_tailmatch = equalIgnoringCase(fields[1], "TRUE");
+    record->m_path = fields[2].isEmpty() ? String("/") : fields[2];
+    record->m_secure = equalIgnoringCase(fields[3], "TRUE");
+    record->m_expires = fields[4].toDouble();
+    record->m_name = fields[5];
+    record->m_value = fields.size() > 6 ? fields[6] : String("");
+
+    m_records.add(record);
+
+    PathNode* node;
+    HashMap<String, PathNode*>::iterator it = m_domains.find(domain);
+    if (it == m_domains.end()) {
+        node = new PathNode;
+        m_domains.set(domain, node);
+    } else
+        node = it->second;
+
+    unsigned start = 0;
+    unsigned length = record->m_path.length();
+    while (start < length) {
+        size_t end = record->m_path.find('/', start);
+        if (end == notFound)
+            end = length;
+        if (end > start) {
+            String segment = record->m_path.substring(start, end - start);
+            HashMap<String, PathNode*>::iterator child = node->m_children.find(segment);
+            if (child == node->m_children.end()) {
+                PathNode* next = new PathNode;
+                node->m_children.set(segment, next);
+                node = next;
+            } else
+                node = child->second;
+        }
+        start = end + 1;
+    }
+    node->m_records.append(record);
+    return true;
+}
+
+void CookieStore::rebuild(struct curl_slist* cookies)
+{
+    clear();
+    for (struct curl_slist* current = cookies; current; current = current->next) {
+        if (current->data)
+            parse(current->data);
+    }
+    m_dirty = false;
+    W_DP(("<cookie>index rebuilt: %d cookies in %d domains", m_records.size(), m_domains.size()));
+}
+
+void CookieStore::update(CURLSH* share)
+{
+    if (!m_dirty)
+        return;
+
+    struct curl_slist* cookies = 0;
+    if (CURLSHE_OK != curl_share_cookie_list(share, &cookies))
+        cookies = 0;
+    rebuild(cookies);
+    if (cookies)
+        curl_slist_free_all(cookies);
+}
+
+void CookieStore::removeRecord(Record* record)
+{
+    HashMap<String, PathNode*>::iterator it = m_domains.find(record->m_domain);
+    if (it != m_domains.end()) {
+        PathNode* node = it->second;
+        unsigned start = 0;
+        unsigned length = record->m_path.length();
+        while (node && start < length) {
+            size_t end = record->m_path.find('/', start);
+            if (end == notFound)
+                end = length;
+            if (end > start) {
+                HashMap<String, PathNode*>::iterator child = node->m_children.find(record->m_path.substring(start, end - start));
+                node = child == node->m_children.end() ? 0 : child->second;
+            }
+            start = end + 1;
+        }
+        if (node) {
+            size_t index = node->m_records.find(record);
+            if (index != notFound)
+                node->m_records.remove(index);
+        }
+    }
+    m_records.remove(record);
+    delete record;
+}
+
+void CookieStore::findRecords(const String& domain, const String& path, const String& name, Vector<Record*>& out)
+{
+    HashMap<String, PathNode*>::iterator it = m_domains.find(domain);
+    if (it == m_domains.end())
+        return;
+
+    PathNode* node = it->second;
+    unsigned start = 0;
+    unsigned length = path.length();
+    while (node) {
+        for (size_t i = 0; i < node->m_records.size(); i++) {
+            Record* record = node->m_records[i];
+            if (record->m_name == name && pathMatches(record->m_path, path))
+                out.append(record);
+        }
+
+        PathNode* next = 0;
+        while (start < length && !next) {
+            size_t end = path.find('/', start);
+            if (end == notFound)
+                end = length;
+            if (end > start) {
+                HashMap<String, PathNode*>::iterator child = node->m_children.find(path.substring(start, end - start));
+                if (child == node->m_children.end()) {
+                    start = length;
+                    break;
+                }
+                next = child->second;
+            }
+            start = end + 1;
+        }
+        node = next;
+    }
+}
+
+// Name and domain of the cookie set by a Set-Cookie header or a document.cookie
+// string, and a path that the path of the cookie is a prefix of.
+static bool parseSetCookie(const String& header, const String& host, const String& requestPath, String& name, String& domain, String& path)
+{
+    String line = header.stripWhiteSpace();
+    if (line.startsWith("Set-Cookie:", false))
+        line = line.substring(11);
+
+    Vector<String> attributes;
+    line.split(';', true, attributes);
+    if (attributes.isEmpty())
+        return false;
+    size_t eq = attributes[0].find('=');
+    if (eq == notFound)
+        return false;
+    name = attributes[0].left(eq).stripWhiteSpace();
+    if (name.isEmpty())
+        return false;
+
+    domain = host.lower();
+    // libcurl defaults to a prefix of the request path
+    path = requestPath.isEmpty() ? String("/") : requestPath;
+    for (size_t i = 1; i < attributes.size(); i++) {
+        eq = attributes[i].find('=');
+        if (eq == notFound)
+            continue;
+        String key = attributes[i].left(eq).stripWhiteSpace();
+        String value = attributes[i].substring(eq + 1).stripWhiteSpace();
+        if (equalIgnoringCase(key, "domain") && !value.isEmpty()) {
+            domain = value.lower();
+            if (domain.startsWith("."))
+                domain = domain.substring(1);
+        } else if (equalIgnoringCase(key, "path") && value.startsWith("/"))
+            path = value;
+    }
+    return !domain.isEmpty();
+}
+
+void CookieStore::cookieSet(CURLSH* share, const String& host, const String& path, const String& header)
+{
+    // rebuilt on the next read anyway
+    if (m_dirty)
+        return;
+
+    String name;
+    String domain;
+    String cookiePath;
+    if (!parseSetCookie(header, host, path, name, domain, cookiePath)) {
+        m_dirty = true;
+        return;
+    }
+
+    struct CookieJarIterator* it = curl_share_create_cookies_iterator(share, domain.utf8().data(), cookiePath.utf8().data(), true);
+    if (!it) {
+        m_dirty = true;
+        return;
+    }
+
+    // whatever the jar did with the header, the cookies of this name are now
+    // the ones it returns
+    Vector<Record*> stale;
+    findRecords(domain, cookiePath, name, stale);
+    for (size_t i = 0; i < stale.size(); i++)
+        removeRecord(stale[i]);
+
+    while (CURLSHE_OK == curl_share_advance_cookies_iterator(share, it)) {
+        if (!it->cookie.name || !it->cookie.domain || name != String::fromUTF8(it->cookie.name))
+            continue;
+        String cookieDomain = String::fromUTF8(it->cookie.domain).lower();
+        if (cookieDomain.startsWith("."))
+            cookieDomain = cookieDomain.substring(1);
+        if (cookieDomain != domain)
+            continue;
+
+        // see get_netscape_format() in cURL/lib/cookie.c
+        StringBuilder line;
+        if (it->cookie.httponly)
+            line.append(cHttpOnlyPrefix);
+        if (it->cookie.tailmatch && it->cookie.domain[0] != '.')
+            line.append(".");
+        line.append(String::fromUTF8(it->cookie.domain));
+        line.append(it->cookie.tailmatch ? "\tTRUE\t" : "\tFALSE\t");
+        line.append(it->cookie.path ? String::fromUTF8(it->cookie.path) : String("/"));
+        line.append(it->cookie.secure ? "\tTRUE\t" : "\tFALSE\t");
+        line.append(String::number(static_cast<long long>(it->cookie.expires)));
+        line.append("\t");
+        line.append(name);
+        line.append("\t");
+        if (it->cookie.value)
+            line.append(String::fromUTF8(it->cookie.value));
+        parse(line.toString().utf8().data());
+    }
+    curl_share_delete_cookies_iterator(share, it);
+
+    // the jar may also have dropped other cookies
+    if (curl_share_cookie_num(share) != static_cast<int>(m_records.size()))
+        m_dirty = true;
+}
+
+void CookieStore::didSerialize(struct curl_slist* cookies, struct curl_slist* written)
+{
+    rebuild(cookies);
+
+    HashSet<String> lines;
+    for (struct curl_slist* current = written; current; current = current->next) {
+        if (current->data)
+            lines.add(String::fromUTF8(current->data));
+    }
+    markPersisted(&lines);
+}
+
+void CookieStore::didSerializeAll(CURLSH* share)
+{
+    m_dirty = true;
+    update(share);
+    markPersisted();
+}
+
+bool CookieStore::longerPathFirst(const Record* a, const Record* b)
+{
+    return a->m_path.length() > b->m_path.length();
+}
+
+void CookieStore::collect(const String& host, const String& path, bool secure, bool includeHttpOnly, Vector<Record*>& out)
+{
+    String name = host.lower();
+    String requestPath = path.isEmpty() ? String("/") : path;
+    double now = currentTime();
+    bool numeric = wkcNetCheckCorrectIPAddressPeer(name.utf8().data());
+
+    // the host itself, then each parent domain for tail-matching cookies
+    unsigned pos = 0;
+    bool exact = true;
+    while (true) {
+        HashMap<String, PathNode*>::iterator it = m_domains.find(pos ? name.substring(pos) : name);
+        if (it != m_domains.end()) {
+            PathNode* node = it->second;
+            unsigned start = 0;
+            unsigned length = requestPath.length();
+            while (node) {
+                for (size_t i = 0; i < node->m_records.size(); i++) {
+                    Record* record = node->m_records[i];
+                    if (!exact && !record->m_tailmatch)
+                        continue;
+                    if (record->m_secure && !secure)
+                        continue;
+                    if (record->m_httpOnly && !includeHttpOnly)
+                        continue;
+                    // expired cookies are left to libcurl to remove
+                    if (record->m_expires && record->m_expires < now)
+                        continue;
+                    if (!pathMatches(record->m_path, requestPath))
+                        continue;
+                    out.append(record);
+                }
+
+                PathNode* next = 0;
+                while (start < length && !next) {
+                    size_t end = requestPath.find('/', start);
+                    if (end == notFound)
+                        end = length;
+                    if (end > start) {
+                        HashMap<String, PathNode*>::iterator child = node->m_children.find(requestPath.substring(start, end - start));
+                        if (child == node->m_children.end()) {
+                            start = length;
+                            break;
+                        }
+                        next = child->second;
+                    }
+                    start = end + 1;
+                }
+                node = next;
+            }
+        }
+        if (numeric)
+            break;
+        size_t dot = name.find('.', pos);
+        if (dot == notFound)
+            break;
+        pos = dot + 1;
+        exact = false;
+    }
+
+    // more specific paths first, as libcurl sends them
+    std::stable_sort(out.begin(), out.end(), longerPathFirst);
+}
+
+String CookieStore::cookies(const String& host, const String& path, bool secure, bool includeHttpOnly)
+{
+    Vector<Record*> records;
+    collect(host, path, secure, includeHttpOnly, records);
+
+    StringBuilder result;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (i)
+            result.append("; ");
+        result.append(records[i]->m_name);
+        result.append("=");
+        result.append(records[i]->m_value);
+    }
+    return result.toString();
+}
+
+void CookieStore::rawCookies(const String& host, const String& path, bool secure, Vector<Cookie>& rawCookies)
+{
+    Vector<Record*> records;
+    collect(host, path, secure, true, records);
+
+    rawCookies.reserveCapacity(records.size());
+    for (size_t i = 0; i < records.size(); i++) {
+        Record* record = records[i];
+        // All domains are prefixed with a dot if they allow tailmatching. See also get_netscape_format() in cURL/lib/cookie.c.
+        String domain = record->m_tailmatch ? "." + record->m_domain : record->m_domain;
+        double expires = record->m_expires * 1000;
+        rawCookies.append(Cookie(record->m_name, record->m_value, domain, record->m_path, expires, record->m_httpOnly, record->m_secure, !expires));
+    }
+}
+
+String CookieStore::recordKey(const Record* record)
+{
+    return record->m_domain + "\t" + record->m_path + "\t" + record->m_name;
+}
+
+String CookieStore::expiredLine(const Record* record)
+{
+    String line;
+    if (record->m_httpOnly)
+        line.append(cHttpOnlyPrefix);
+    if (record->m_tailmatch)
+        line.append(".");
+    line.append(record->m_domain);
+    line.append(record->m_tailmatch ? "\tTRUE\t" : "\tFALSE\t");
+    line.append(record->m_path);
+    line.append(record->m_secure ? "\tTRUE\t1\t" : "\tFALSE\t1\t");
+    line.append(record->m_name);
+    line.append("\t");
+    return line;
+}
+
+void CookieStore::buildChanges(Vector<String>& lines)
+{
+    HashSet<String> current;
+    HashSet<Record*>::iterator records = m_records.end();
+    for (HashSet<Record*>::iterator rit = m_records.begin(); rit != records; ++rit) {
+        Record* record = *rit;
+        String key = recordKey(record);
+        HashMap<String, Persisted>::iterator it = m_persisted.find(key);
+        if (it == m_persisted.end() || it->second.m_line != record->m_line)
+            lines.append(record->m_line);
+        current.add(key);
+    }
+
+    HashMap<String, Persisted>::iterator end = m_persisted.end();
+    for (HashMap<String, Persisted>::iterator it = m_persisted.begin(); it != end; ++it) {
+        if (!current.contains(it->first))
+            lines.append(it->second.m_expiredLine);
+    }
+}
+
+int CookieStore::serializeChanges(char* buff, int bufflen)
+{
+    Vector<String> lines;
+    buildChanges(lines);
+
+    Vector<CString> data;
+    int total_len = 0;
+    for (size_t i = 0; i < lines.size(); i++) {
+        data.append(lines[i].utf8());
+        total_len += data[i].length() + 2; // 2: length of '\r' and '\n'.
+    }
+    total_len++; // null termination character
+
+    if (!buff)
+        return total_len;
+    if (bufflen < total_len)
+        return -1;
+
+    int pos = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        memcpy(buff + pos, data[i].data(), data[i].length());
+        pos += data[i].length();
+        buff[pos++] = '\r';
+        buff[pos++] = '\n';
+    }
+    buff[pos] = 0x0;
+
+    // what was handed out is now what the application has saved
+    markPersisted();
+    return total_len;
+}
+
+void CookieStore::markPersisted(const HashSet<String>* lines)
+{
+    m_persisted.clear();
+    HashSet<Record*>::iterator end = m_records.end();
+    for (HashSet<Record*>::iterator it = m_records.begin(); it != end; ++it) {
+        Record* record = *it;
+        // a record left out has to be written with the next changes
+        if (lines && !lines->contains(record->m_line))
+            continue;
+        Persisted persisted;
+        persisted.m_line = record->m_line;
+        persisted.m_expiredLine = expiredLine(record);
+        m_persisted.set(recordKey(record), persisted);
+    }
+}
+
+} // namespace WebCore
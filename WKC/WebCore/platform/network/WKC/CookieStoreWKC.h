@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CookieStoreWKC_h
+#define CookieStoreWKC_h
+
+#include "PlatformString.h"
+
+#include <curl/curl.h>
+#include <wtf/HashMap.h>
+#include <wtf/HashSet.h>
+#include <wtf/Vector.h>
+#include <wtf/text/StringHash.h>
+
+namespace WebCore {
+
+struct Cookie;
+
+// Index over the libcurl cookie jar for reading cookies from the engine.
+// Cookies are bucketed by their domain and, inside a domain, by the
+// segments of their path, so a lookup only visits the domain suffixes of
+// the host and the path prefixes of the request. libcurl stays the owner
+// of the cookies: a cookie set through a header is read back from the jar
+// alone, the whole index is rebuilt only when it has been invalidated, and
+// it remembers which records were last persisted so that only changed
+// records need to be saved again.
+// All functions must be called with the cookie mutex held.
+class CookieStore {
+public:
+    CookieStore();
+    ~CookieStore();
+
+    // the jar may have changed
+    void invalidate() { m_dirty = true; }
+    // rebuilds the index from the jar if needed
+    void update(CURLSH* share);
+    // a Set-Cookie header or a document.cookie string for host and path
+    // has been given to the jar; re-reads only the cookies it may have set
+    void cookieSet(CURLSH* share, const String& host, const String& path, const String& header);
+
+    String cookies(const String& host, const String& path, bool secure, bool includeHttpOnly);
+    void rawCookies(const String& host, const String& path, bool secure, Vector<Cookie>& rawCookies);
+
+    // Records added, changed or removed since the last save, in the format
+    // of the serialized cookies. Removed records are written as expired.
+    // If buff is null, returns the length to write; -1 if buff is too short.
+    int serializeChanges(char* buff, int bufflen);
+    // the jar, as in cookies, has been saved; only the entries from written
+    // on fitted into the buffer
+    void didSerialize(struct curl_slist* cookies, struct curl_slist* written);
+    // the whole jar has been loaded
+    void didSerializeAll(CURLSH* share);
+
+private:
+    struct Record {
+        String m_name;
+        String m_value;
+        String m_domain;    // without the leading dot
+        String m_path;
+        double m_expires;   // seconds, 0 for a session cookie
+        bool m_tailmatch;
+        bool m_secure;
+        bool m_httpOnly;
+        String m_line;      // as serialized
+    };
+    struct PathNode {
+        ~PathNode();
+        HashMap<String, PathNode*> m_children;
+        Vector<Record*> m_records;
+    };
+    struct Persisted {
+        String m_line;
+        String m_expiredLine;
+    };
+
+    void clear();
+    void rebuild(struct curl_slist* cookies);
+    bool parse(const char* line);
+    void removeRecord(Record* record);
+    void findRecords(const String& domain, const String& path, const String& name, Vector<Record*>& out);
+    void collect(const String& host, const String& path, bool secure, bool includeHttpOnly, Vector<Record*>& out);
+    static String recordKey(const Record* record);
+    static String expiredLine(const Record* record);
+    static bool longerPathFirst(const Record* a, const Record* b);
+    void buildChanges(Vector<String>& lines);
+    // all records, or only those whose line is in lines
+    void markPersisted(const HashSet<String>* lines = 0);
+
+    bool m_dirty;
+    HashMap<String, PathNode*> m_domains;
+    HashSet<Record*> m_records;
+    HashMap<String, Persisted> m_persisted;
+};
+
+} // namespace WebCore
+
+#endif // CookieStoreWKC_h
@@ -0,0 +1,367 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+
+#include "CurlSocketWatcherWKC.h"
+
+#include <wtf/MainThread.h>
+
+#if COMPILER(MSVC)
+# include <winsock2.h>
+# include <ws2tcpip.h>
+#else
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+#endif
+#include <wkc/wkcpeer.h>
+#include <wkc/wkcsocket.h>
+
+#if 1
+# define W_DP(a) ((void)0)
+#else
+# define W_DP(a) wkcDebugPrintfPeer a
+#endif
+
+namespace WebCore {
+
+// Used only when the wake-up socket could not be created: the worker then
+// has no way to interrupt a blocking select, so it re-reads the socket list
+// at this interval instead.
+static const int cFallbackPollTimeoutMs = 50;
+// Wait after a failed select, e.g. for a socket closed before libcurl
+// removed it, instead of failing again at once.
+static const unsigned cErrorBackoffMs = 10;
+
+CurlSocketWatcher::CurlSocketWatcher(ReadyProc proc, void* data)
+    : m_readyProc(proc)
+    , m_readyData(data)
+    , m_thread(0)
+    , m_mutex(0)
+    , m_cond(0)
+    , m_quit(false)
+    , m_dispatching(false)
+    , m_wakeUpSocket(-1)
+{
+}
+
+CurlSocketWatcher::~CurlSocketWatcher()
+{
+    if (m_thread) {
+        wkcMutexLockPeer(m_mutex);
+        m_quit = true;
+        wkcCondSignalPeer(m_cond);
+        wkcMutexUnlockPeer(m_mutex);
+        wakeUp();
+        wkcThreadJoinPeer(m_thread, 0);
+        m_thread = 0;
+    }
+    if (m_wakeUpSocket >= 0) {
+        wkcNetClosePeer(m_wakeUpSocket);
+        m_wakeUpSocket = -1;
+    }
+    if (m_cond) {
+        wkcCondDeletePeer(m_cond);
+        m_cond = 0;
+    }
+    if (m_mutex) {
+        wkcMutexDeletePeer(m_mutex);
+        m_mutex = 0;
+    }
+}
+
+CurlSocketWatcher* CurlSocketWatcher::create(ReadyProc proc, void* data)
+{
+    CurlSocketWatcher* self = new CurlSocketWatcher(proc, data);
+    if (!self)
+        return 0;
+    if (!self->construct()) {
+        delete self;
+        return 0;
+    }
+    return self;
+}
+
+bool CurlSocketWatcher::construct()
+{
+    m_mutex = wkcMutexNewPeer();
+    m_cond = wkcCondNewPeer();
+    if (!m_mutex || !m_cond)
+        return false;
+
+    // A loopback UDP socket connected to itself.
+    // Sending one byte to it interrupts wkcNetSelectPeer() in the worker.
+    m_wakeUpSocket = wkcNetSocketPeer(PF_INET, SOCK_DGRAM, 0);
+    if (m_wakeUpSocket >= 0) {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        if (wkcNetBindPeer(m_wakeUpSocket, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || wkcNetGetSockNamePeer(m_wakeUpSocket, (struct sockaddr *)&addr, &len) < 0
+            || wkcNetConnectPeer(m_wakeUpSocket, (struct sockaddr *)&addr, len) < 0) {
+            W_DP(("<csw>wake-up socket is not available, falling back to %dms polling", cFallbackPollTimeoutMs));
+            wkcNetClosePeer(m_wakeUpSocket);
+            m_wakeUpSocket = -1;
+        } else {
+            long v = 1;
+            wkcNetIoctlSocketPeer(m_wakeUpSocket, FIONBIO, &v);
+        }
+    }
+
+    m_thread = wkcThreadCreatePeer(threadProc, this);
+    if (!m_thread)
+        return false;
+
+    return true;
+}
+
+void CurlSocketWatcher::forceTerminate()
+{
+    m_thread = 0;
+    m_mutex = 0;
+    m_cond = 0;
+    m_wakeUpSocket = -1;
+}
+
+void CurlSocketWatcher::watch(curl_socket_t socket, int what, bool paused)
+{
+    wkcMutexLockPeer(m_mutex);
+    bool found = false;
+    for (size_t i = 0; i < m_sockets.size(); i++) {
+        if (m_sockets[i].m_socket == socket) {
+            m_sockets[i].m_what = what;
+            m_sockets[i].m_paused = paused;
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        WatchedSocket ws = { socket, what, paused };
+        m_sockets.append(ws);
+    }
+    wkcCondSignalPeer(m_cond);
+    wkcMutexUnlockPeer(m_mutex);
+
+    wakeUp();
+}
+
+void CurlSocketWatcher::unwatch(curl_socket_t socket)
+{
+    wkcMutexLockPeer(m_mutex);
+    for (size_t i = 0; i < m_sockets.size(); i++) {
+        if (m_sockets[i].m_socket == socket) {
+            m_sockets.remove(i);
+            break;
+        }
+    }
+    for (size_t i = 0; i < m_readySockets.size(); i++) {
+        if (m_readySockets[i].m_socket == socket) {
+            m_readySockets.remove(i);
+            break;
+        }
+    }
+    wkcMutexUnlockPeer(m_mutex);
+
+    // libcurl closes the socket soon after; stop polling it right away.
+    wakeUp();
+}
+
+void CurlSocketWatcher::setPaused(curl_socket_t socket, bool paused)
+{
+    wkcMutexLockPeer(m_mutex);
+    for (size_t i = 0; i < m_sockets.size(); i++) {
+        if (m_sockets[i].m_socket == socket) {
+            m_sockets[i].m_paused = paused;
+            break;
+        }
+    }
+    if (paused) {
+        for (size_t i = 0; i < m_readySockets.size(); i++) {
+            if (m_readySockets[i].m_socket == socket) {
+                m_readySockets.remove(i);
+                break;
+            }
+        }
+    }
+    wkcCondSignalPeer(m_cond);
+    wkcMutexUnlockPeer(m_mutex);
+
+    wakeUp();
+}
+
+bool CurlSocketWatcher::hasActiveSockets() const
+{
+    for (size_t i = 0; i < m_sockets.size(); i++) {
+        if (!m_sockets[i].m_paused)
+            return true;
+    }
+    return false;
+}
+
+void CurlSocketWatcher::unwatchAll()
+{
+    wkcMutexLockPeer(m_mutex);
+    m_sockets.clear();
+    m_readySockets.clear();
+    wkcMutexUnlockPeer(m_mutex);
+
+    wakeUp();
+}
+
+void CurlSocketWatcher::takeReadySockets(Vector<ReadySocket>& sockets)
+{
+    wkcMutexLockPeer(m_mutex);
+    sockets.swap(m_readySockets);
+    m_readySockets.clear();
+    wkcMutexUnlockPeer(m_mutex);
+}
+
+void CurlSocketWatcher::resume()
+{
+    wkcMutexLockPeer(m_mutex);
+    m_dispatching = false;
+    wkcCondSignalPeer(m_cond);
+    wkcMutexUnlockPeer(m_mutex);
+}
+
+void CurlSocketWatcher::wakeUp()
+{
+    if (m_wakeUpSocket < 0)
+        return;
+    char c = 0;
+    (void)wkcNetSendPeer(m_wakeUpSocket, &c, 1, 0);
+}
+
+void CurlSocketWatcher::drainWakeUp()
+{
+    char buf[16];
+    while (wkcNetRecvPeer(m_wakeUpSocket, buf, sizeof(buf), 0) > 0) { }
+}
+
+void* CurlSocketWatcher::threadProc(void* data)
+{
+    static_cast<CurlSocketWatcher*>(data)->run();
+    return 0;
+}
+
+void CurlSocketWatcher::run()
+{
+    // wkcNetSelectPeer() rather than wkcNetPollPeer(): ports have to
+    // implement only one of them, and the rest of WKC uses select.
+    Vector<curl_socket_t> selected;
+
+    wkcMutexLockPeer(m_mutex);
+    while (!m_quit) {
+        if (m_dispatching || !hasActiveSockets()) {
+            wkcCondWaitPeer(m_cond, m_mutex);
+            continue;
+        }
+
+        fd_set rfds, wfds, efds;
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_ZERO(&efds);
+        int maxfd = -1;
+        selected.clear();
+        for (size_t i = 0; i < m_sockets.size(); i++) {
+            const WatchedSocket& ws = m_sockets[i];
+            if (ws.m_paused)
+                continue;
+#if COMPILER(MSVC)
+            if (selected.size() >= FD_SETSIZE - 1)
+                break;
+#else
+            if (ws.m_socket >= FD_SETSIZE)
+                continue;
+#endif
+            if (ws.m_what & CURL_POLL_IN)
+                FD_SET(ws.m_socket, &rfds);
+            if (ws.m_what & CURL_POLL_OUT)
+                FD_SET(ws.m_socket, &wfds);
+            FD_SET(ws.m_socket, &efds);
+            if ((int)ws.m_socket > maxfd)
+                maxfd = ws.m_socket;
+            selected.append(ws.m_socket);
+        }
+        if (m_wakeUpSocket >= 0) {
+            FD_SET(m_wakeUpSocket, &rfds);
+            if (m_wakeUpSocket > maxfd)
+                maxfd = m_wakeUpSocket;
+        }
+        wkcMutexUnlockPeer(m_mutex);
+
+        struct timeval tv = { 0, cFallbackPollTimeoutMs * 1000 };
+        int ret = wkcNetSelectPeer(maxfd + 1, &rfds, &wfds, &efds, (m_wakeUpSocket >= 0) ? 0 : &tv);
+
+        wkcMutexLockPeer(m_mutex);
+        if (m_quit)
+            break;
+        if (ret < 0) {
+            W_DP(("<csw>select failed: %d", wkcNetGetLastErrorPeer()));
+            (void)wkcCondTimedWaitPeer(m_cond, m_mutex, cErrorBackoffMs);
+            continue;
+        }
+        if (!ret)
+            continue;
+
+        if (m_wakeUpSocket >= 0 && FD_ISSET(m_wakeUpSocket, &rfds))
+            drainWakeUp();
+
+        for (size_t i = 0; i < selected.size(); i++) {
+            curl_socket_t socket = selected[i];
+            // the socket may have been removed or paused while we were selecting
+            bool watched = false;
+            for (size_t j = 0; j < m_sockets.size(); j++) {
+                if (m_sockets[j].m_socket == socket) {
+                    watched = !m_sockets[j].m_paused;
+                    break;
+                }
+            }
+            if (!watched)
+                continue;
+
+            ReadySocket rs = { socket, 0 };
+            if (FD_ISSET(socket, &rfds))
+                rs.m_events |= CURL_CSELECT_IN;
+            if (FD_ISSET(socket, &wfds))
+                rs.m_events |= CURL_CSELECT_OUT;
+            if (FD_ISSET(socket, &efds))
+                rs.m_events |= CURL_CSELECT_ERR;
+            if (rs.m_events)
+                m_readySockets.append(rs);
+        }
+
+        if (!m_readySockets.isEmpty()) {
+            W_DP(("<csw>%d socket(s) ready", (int)m_readySockets.size()));
+            m_dispatching = true;
+            callOnMainThread(m_readyProc, m_readyData);
+        }
+    }
+    wkcMutexUnlockPeer(m_mutex);
+}
+
+} // namespace WebCore
+
+#endif // ENABLE(WKC_CURL_MULTI_SOCKET)
@@ -0,0 +1,97 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CurlSocketWatcherWKC_h
+#define CurlSocketWatcherWKC_h
+
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+
+#include <curl/curl.h>
+#include <wtf/Vector.h>
+
+namespace WebCore {
+
+// Watches the sockets libcurl reports through CURLMOPT_SOCKETFUNCTION on a
+// worker thread and hands ready sockets to the main thread, so that
+// curl_multi_socket_action() only runs when something actually happened.
+class CurlSocketWatcher {
+public:
+    struct ReadySocket {
+        curl_socket_t m_socket;
+        int m_events;   // CURL_CSELECT_IN / CURL_CSELECT_OUT / CURL_CSELECT_ERR
+    };
+
+    typedef void (*ReadyProc)(void*);
+
+    static CurlSocketWatcher* create(ReadyProc proc, void* data);
+    ~CurlSocketWatcher();
+
+    // main thread: from CURLMOPT_SOCKETFUNCTION
+    void watch(curl_socket_t socket, int what, bool paused);
+    void unwatch(curl_socket_t socket);
+    void unwatchAll();
+    // main thread: the socket of a paused transfer stays readable, so it is
+    // left out until the transfer resumes
+    void setPaused(curl_socket_t socket, bool paused);
+
+    // main thread: from the ReadyProc. The worker stays idle between
+    // takeReadySockets() and resume() so that sockets which have not been
+    // serviced yet are not reported twice.
+    void takeReadySockets(Vector<ReadySocket>& sockets);
+    void resume();
+
+    // for force terminate
+    void forceTerminate();
+
+private:
+    CurlSocketWatcher(ReadyProc proc, void* data);
+    bool construct();
+
+    static void* threadProc(void* data);
+    void run();
+    void wakeUp();
+    void drainWakeUp();
+
+    struct WatchedSocket {
+        curl_socket_t m_socket;
+        int m_what;     // CURL_POLL_IN / CURL_POLL_OUT / CURL_POLL_INOUT
+        bool m_paused;
+    };
+    bool hasActiveSockets() const;
+
+    ReadyProc m_readyProc;
+    void* m_readyData;
+
+    void* m_thread;
+    void* m_mutex;
+    void* m_cond;
+    bool m_quit;
+    bool m_dispatching;
+    int m_wakeUpSocket;
+
+    // protected by m_mutex
+    Vector<WatchedSocket> m_sockets;
+    Vector<ReadySocket> m_readySockets;
+};
+
+} // namespace WebCore
+
+#endif // ENABLE(WKC_CURL_MULTI_SOCKET)
+
+#endif // CurlSocketWatcherWKC_h
@@ -0,0 +1,321 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "DNSResolverWKC.h"
+
+#include "CString.h"
+#include "CurrentTime.h"
+#include "ResourceHandleManagerWKC.h"
+
+#include <wtf/MainThread.h>
+
+#if COMPILER(MSVC)
+# include <winsock2.h>
+# include <ws2tcpip.h>
+#else
+# include <sys/types.h>
+# include <sys/socket.h>
+#endif
+#include <wkc/wkcpeer.h>
+#include <wkc/wkcsocket.h>
+
+#if 1
+# define W_DP(a) ((void)0)
+#else
+# define W_DP(a) wkcDebugPrintfPeer a
+#endif
+
+namespace WebCore {
+
+// Failures are kept shortly: the network may just have been down.
+static const double cNegativeTimeToLive = 10.0;
+// Entries beyond this are dropped, expired ones first.
+static const int cMaxEntries = 256;
+
+DNSResolver::DNSResolver()
+    : m_timeToLive(60 * 5)
+    , m_thread(0)
+    , m_mutex(0)
+    , m_cond(0)
+    , m_quit(false)
+    , m_resultsPosted(false)
+{
+    memset(&m_stat, 0, sizeof(m_stat));
+}
+
+DNSResolver::~DNSResolver()
+{
+    if (m_thread) {
+        wkcMutexLockPeer(m_mutex);
+        m_quit = true;
+        wkcCondSignalPeer(m_cond);
+        wkcMutexUnlockPeer(m_mutex);
+        wkcThreadJoinPeer(m_thread, 0);
+        m_thread = 0;
+    }
+    if (m_cond) {
+        wkcCondDeletePeer(m_cond);
+        m_cond = 0;
+    }
+    if (m_mutex) {
+        wkcMutexDeletePeer(m_mutex);
+        m_mutex = 0;
+    }
+}
+
+DNSResolver* DNSResolver::create()
+{
+    DNSResolver* self = new DNSResolver();
+    if (!self)
+        return 0;
+    if (!self->construct()) {
+        delete self;
+        return 0;
+    }
+    return self;
+}
+
+bool DNSResolver::construct()
+{
+    m_mutex = wkcMutexNewPeer();
+    m_cond = wkcCondNewPeer();
+    if (!m_mutex || !m_cond)
+        return false;
+
+    m_thread = wkcThreadCreatePeer(threadProc, this);
+    if (!m_thread)
+        return false;
+
+    return true;
+}
+
+void DNSResolver::forceTerminate()
+{
+    m_thread = 0;
+    m_mutex = 0;
+    m_cond = 0;
+}
+
+bool DNSResolver::isNumericHost(const String& host)
+{
+    if (host.find(':') != notFound)
+        return true;    // IPv6 literal
+    return wkcNetInetAddrPeer(host.latin1().data()) != (wkc_addr_t)-1;
+}
+
+void DNSResolver::prefetch(const String& host)
+{
+    if (host.isEmpty() || isNumericHost(host))
+        return;
+
+    String key = host.lower();
+    HashMap<String, Entry>::iterator it = m_entries.find(key);
+    if (it != m_entries.end() && it->second.m_expires > currentTime())
+        return;
+    if (m_resolving.contains(key))
+        return;
+    m_resolving.add(key);
+
+    CString name = key.latin1();
+    Vector<char> buf;
+    buf.append(name.data(), name.length() + 1);
+
+    wkcMutexLockPeer(m_mutex);
+    m_queue.append(buf);
+    wkcCondSignalPeer(m_cond);
+    wkcMutexUnlockPeer(m_mutex);
+}
+
+struct curl_slist* DNSResolver::resolveList(const String& host, int port)
+{
+    if (host.isEmpty() || isNumericHost(host))
+        return 0;
+
+    // libcurl keeps CURLOPT_RESOLVE entries in the shared DNS cache with no
+    // time out, so an entry given before is removed once it expires here,
+    // and before a different address is given for it.
+    String hostPort = host.lower() + ":" + String::number(port);
+    HashMap<String, String>::iterator given = m_givenToCurl.find(hostPort);
+
+    HashMap<String, Entry>::iterator it = m_entries.find(host.lower());
+    if (it == m_entries.end() || it->second.m_expires <= currentTime() || it->second.m_address.isEmpty()) {
+        m_stat.m_misses++;
+        if (given == m_givenToCurl.end())
+            return 0;
+        m_givenToCurl.remove(given);
+        return curl_slist_append(0, ("-" + hostPort).latin1().data());
+    }
+    m_stat.m_hits++;
+
+    struct curl_slist* list = 0;
+    if (given != m_givenToCurl.end() && given->second != it->second.m_address)
+        list = curl_slist_append(list, ("-" + hostPort).latin1().data());
+    list = curl_slist_append(list, (hostPort + ":" + it->second.m_address).latin1().data());
+    m_givenToCurl.set(hostPort, it->second.m_address);
+    return list;
+}
+
+bool DNSResolver::isKnownUnresolvable(const String& host)
+{
+    if (host.isEmpty())
+        return false;
+
+    HashMap<String, Entry>::iterator it = m_entries.find(host.lower());
+    if (it == m_entries.end() || it->second.m_expires <= currentTime() || !it->second.m_failedInCurl)
+        return false;
+    m_stat.m_negativeHits++;
+    return true;
+}
+
+void DNSResolver::setEntry(const String& host, const String& address, bool failedInCurl)
+{
+    double now = currentTime();
+
+    if (m_entries.size() >= cMaxEntries && !m_entries.contains(host)) {
+        Vector<String> expired;
+        HashMap<String, Entry>::iterator end = m_entries.end();
+        for (HashMap<String, Entry>::iterator it = m_entries.begin(); it != end; ++it) {
+            if (it->second.m_expires <= now)
+                expired.append(it->first);
+        }
+        for (size_t i = 0; i < expired.size(); i++)
+            m_entries.remove(expired[i]);
+        if (m_entries.size() >= cMaxEntries)
+            m_entries.remove(m_entries.begin());
+    }
+
+    Entry entry;
+    entry.m_address = address;
+    entry.m_failedInCurl = failedInCurl;
+    entry.m_expires = now + (address.isEmpty() ? cNegativeTimeToLive : m_timeToLive);
+    m_entries.set(host, entry);
+}
+
+void DNSResolver::didResolve(const String& host, const String& address)
+{
+    if (host.isEmpty() || address.isEmpty() || isNumericHost(host))
+        return;
+    // only IPv4 addresses can be given back through CURLOPT_RESOLVE
+    if (address.find(':') != notFound)
+        return;
+    setEntry(host.lower(), address);
+}
+
+void DNSResolver::didFailToResolve(const String& host)
+{
+    if (host.isEmpty() || isNumericHost(host))
+        return;
+    setEntry(host.lower(), String(), true);
+}
+
+void DNSResolver::clear()
+{
+    // m_givenToCurl is kept: those entries are still to be removed from libcurl
+    m_entries.clear();
+}
+
+void DNSResolver::resolvedCallback(void* data)
+{
+    // may be called after the instance is gone; always look it up again.
+    ResourceHandleManager* rhm = ResourceHandleManager::sharedInstance();
+    if (rhm && rhm->dnsResolver())
+        rhm->dnsResolver()->resolved();
+}
+
+void DNSResolver::resolved()
+{
+    Vector<Result> results;
+    wkcMutexLockPeer(m_mutex);
+    results.swap(m_results);
+    m_resultsPosted = false;
+    wkcMutexUnlockPeer(m_mutex);
+
+    for (size_t i = 0; i < results.size(); i++) {
+        String host(results[i].m_host.data());
+        String address(results[i].m_address);
+        m_resolving.remove(host);
+        m_stat.m_resolved++;
+        if (address.isEmpty())
+            m_stat.m_failed++;
+        W_DP(("<dns>%s -> %s", results[i].m_host.data(), results[i].m_address));
+        setEntry(host, address);
+    }
+}
+
+void* DNSResolver::threadProc(void* data)
+{
+    static_cast<DNSResolver*>(data)->run();
+    return 0;
+}
+
+void DNSResolver::run()
+{
+    Vector<Vector<char> > batch;
+
+    wkcMutexLockPeer(m_mutex);
+    while (!m_quit) {
+        if (m_queue.isEmpty()) {
+            wkcCondWaitPeer(m_cond, m_mutex);
+            continue;
+        }
+
+        // everything queued so far is resolved before the main thread hears back
+        batch.swap(m_queue);
+        m_queue.clear();
+        wkcMutexUnlockPeer(m_mutex);
+
+        Vector<Result> results;
+        for (size_t i = 0; i < batch.size() && !m_quit; i++) {
+            Result result;
+            result.m_host.swap(batch[i]);
+            result.m_address[0] = 0;
+
+            struct addrinfo hints;
+            struct addrinfo* res = 0;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            if (!wkcNetGetAddrInfoPeer(result.m_host.data(), 0, &hints, &res) && res) {
+                for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+                    if (ai->ai_family != AF_INET || !ai->ai_addr)
+                        continue;
+                    const unsigned char* a = (const unsigned char*)&((struct sockaddr_in*)ai->ai_addr)->sin_addr;
+                    ::snprintf(result.m_address, sizeof(result.m_address), "%d.%d.%d.%d", a[0], a[1], a[2], a[3]);
+                    break;
+                }
+            }
+            if (res)
+                wkcNetFreeAddrInfoPeer(res);
+            results.append(result);
+        }
+        batch.clear();
+
+        wkcMutexLockPeer(m_mutex);
+        m_results.append(results);
+        if (!m_resultsPosted && !m_quit) {
+            m_resultsPosted = true;
+            callOnMainThread(resolvedCallback, 0);
+        }
+    }
+    wkcMutexUnlockPeer(m_mutex);
+}
+
+} // namespace WebCore
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#ifndef DNSResolverWKC_h
+#define DNSResolverWKC_h
+
+#include "PlatformString.h"
+
+#include <curl/curl.h>
+#include <wtf/HashMap.h>
+#include <wtf/HashSet.h>
+#include <wtf/Vector.h>
+#include <wtf/text/StringHash.h>
+
+namespace WebCore {
+
+struct DNSResolverStatistics {
+    // lookups answered from the cache / with a cached failure / not cached
+    int m_hits;
+    int m_negativeHits;
+    int m_misses;
+    // host names resolved by the worker thread, and how many of them failed
+    int m_resolved;
+    int m_failed;
+};
+
+// Resolves host names on a worker thread, a batch at a time, and keeps the
+// results, failures included, for a limited time. DNS prefetch, resource
+// loads and WebSocket connects all go through this cache; resolved
+// addresses are handed to libcurl with CURLOPT_RESOLVE.
+class DNSResolver {
+public:
+    static DNSResolver* create();
+    ~DNSResolver();
+
+    // main thread
+    void prefetch(const String& host);
+    // CURLOPT_RESOLVE list for host:port, or 0 when there is nothing to
+    // add or remove. The caller frees it with curl_slist_free_all() after
+    // the handle.
+    struct curl_slist* resolveList(const String& host, int port);
+    // libcurl itself failed to resolve host a moment ago; a failed
+    // prefetch never counts, as it looks up IPv4 only
+    bool isKnownUnresolvable(const String& host);
+    // results of lookups libcurl did on its own
+    void didResolve(const String& host, const String& address);
+    void didFailToResolve(const String& host);
+
+    void setTimeToLive(int sec) { m_timeToLive = sec; }
+    void clear();
+    void getStatistics(DNSResolverStatistics& stat) { stat = m_stat; }
+
+    // for force terminate
+    void forceTerminate();
+
+private:
+    DNSResolver();
+    bool construct();
+
+    static bool isNumericHost(const String& host);
+    void setEntry(const String& host, const String& address, bool failedInCurl = false);
+
+    static void resolvedCallback(void* data);
+    void resolved();
+
+    static void* threadProc(void* data);
+    void run();
+
+    struct Entry {
+        String m_address;   // empty for a failed lookup
+        bool m_failedInCurl;
+        double m_expires;
+    };
+    HashMap<String, Entry> m_entries;
+    // host:port to the address last given to libcurl with CURLOPT_RESOLVE
+    HashMap<String, String> m_givenToCurl;
+    HashSet<String> m_resolving;
+    int m_timeToLive;
+    DNSResolverStatistics m_stat;
+
+    struct Result {
+        Vector<char> m_host;
+        char m_address[16];   // dotted IPv4, empty on failure
+    };
+
+    void* m_thread;
+    void* m_mutex;
+    void* m_cond;
+    bool m_quit;
+    bool m_resultsPosted;
+
+    // protected by m_mutex
+    Vector<Vector<char> > m_queue;
+    Vector<Result> m_results;
+};
+
+} // namespace WebCore
+
+#endif // DNSResolverWKC_h
@@ -45,6 +45,15 @@ void prefetchDNS(const String& hostname)
     DNSResolveQueue::shared().add(hostname);
 }
 
+void preconnect(const KURL& url)
+{
+    ResourceHandleManager* mgr = ResourceHandleManager::sharedInstance();
+    if (!mgr)
+        return;
+
+    mgr->preconnect(url);
+}
+
 bool DNSResolveQueue::platformProxyIsEnabledInSystemPreferences()
 {
     ResourceHandleManager* mgr = ResourceHandleManager::sharedInstance();
@@ -56,7 +65,11 @@ bool DNSResolveQueue::platformProxyIsEnabledInSystemPreferences()
 
 void DNSResolveQueue::platformResolve(const String& hostname)
 {
-    wkcNetPrefetchDNSPeer(hostname.utf8().data(), hostname.length());
+    ResourceHandleManager* mgr = ResourceHandleManager::sharedInstance();
+    if (mgr && mgr->dnsResolver())
+        mgr->dnsResolver()->prefetch(hostname);
+    else
+        wkcNetPrefetchDNSPeer(hostname.utf8().data(), hostname.length());
     DNSResolveQueue::shared().decrementRequestCount();
 }
 
@@ -0,0 +1,297 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "DownloadFileWriterWKC.h"
+
+#include <wtf/FastMalloc.h>
+#include <wtf/MainThread.h>
+#include <wkc/wkcpeer.h>
+
+#include <sys/stat.h>
+#include <string.h>
+
+#if 1
+# define W_DP(a) ((void)0)
+#else
+# define W_DP(a) wkcDebugPrintfPeer a
+#endif
+
+namespace WebCore {
+
+DownloadFileWriter::DownloadFileWriter(NotifyProc proc, void* data)
+    : m_notifyProc(proc)
+    , m_notifyData(data)
+    , m_fd(0)
+    , m_thread(0)
+    , m_mutex(0)
+    , m_cond(0)
+    , m_fillLength(0)
+    , m_head(0)
+    , m_count(0)
+    , m_quit(false)
+    , m_failed(false)
+    , m_waitingForRoom(false)
+    , m_notifyPosted(false)
+{
+    for (int i = 0; i < EBuffers; i++) {
+        m_buffers[i] = 0;
+        m_lengths[i] = 0;
+    }
+}
+
+DownloadFileWriter::~DownloadFileWriter()
+{
+    if (m_thread) {
+        // the queued buffers are dropped
+        wkcMutexLockPeer(m_mutex);
+        m_quit = true;
+        wkcCondBroadcastPeer(m_cond);
+        wkcMutexUnlockPeer(m_mutex);
+        wkcThreadJoinPeer(m_thread, 0);
+        m_thread = 0;
+    }
+    cancelCallOnMainThread(notifyProc, this);
+    if (m_fd) {
+        wkcFileFClosePeer(m_fd);
+        m_fd = 0;
+    }
+    for (int i = 0; i < EBuffers; i++)
+        fastFree(m_buffers[i]);
+    if (m_cond) {
+        wkcCondDeletePeer(m_cond);
+        m_cond = 0;
+    }
+    if (m_mutex) {
+        wkcMutexDeletePeer(m_mutex);
+        m_mutex = 0;
+    }
+}
+
+DownloadFileWriter* DownloadFileWriter::create(const char* path, long long offset, NotifyProc proc, void* data)
+{
+    DownloadFileWriter* self = new DownloadFileWriter(proc, data);
+    if (!self)
+        return 0;
+    if (!self->construct(path, offset)) {
+        delete self;
+        return 0;
+    }
+    return self;
+}
+
+bool DownloadFileWriter::construct(const char* path, long long offset)
+{
+    // all the memory a download takes is allocated here
+    for (int i = 0; i < EBuffers; i++) {
+        WTF::TryMallocReturnValue rv = tryFastMalloc(EBufferSize);
+        if (!rv.getValue(m_buffers[i]))
+            return false;
+    }
+
+    m_fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_WEBCORE, path, offset ? "ab" : "wb");
+    if (!m_fd)
+        return false;
+
+    m_mutex = wkcMutexNewPeer();
+    m_cond = wkcCondNewPeer();
+    if (!m_mutex || !m_cond)
+        return false;
+
+    m_thread = wkcThreadCreatePeer(threadProc, this);
+    if (!m_thread)
+        return false;
+
+    return true;
+}
+
+void DownloadFileWriter::forceTerminate()
+{
+    m_thread = 0;
+    m_mutex = 0;
+    m_cond = 0;
+    m_fd = 0;
+}
+
+long long DownloadFileWriter::fileSize(const char* path)
+{
+    struct stat buf;
+    if (wkcFileStatPeer(path, &buf))
+        return -1;
+    return buf.st_size;
+}
+
+void DownloadFileWriter::queueFillBuffer()
+{
+    wkcMutexLockPeer(m_mutex);
+    m_lengths[(m_head + m_count) % EBuffers] = m_fillLength;
+    m_count++;
+    wkcCondBroadcastPeer(m_cond);
+    wkcMutexUnlockPeer(m_mutex);
+    m_fillLength = 0;
+}
+
+int DownloadFileWriter::fill(const char* data, int length)
+{
+    int filled = 0;
+    while (filled < length) {
+        wkcMutexLockPeer(m_mutex);
+        bool full = m_count == EBuffers;
+        if (full)
+            m_waitingForRoom = true;
+        int index = (m_head + m_count) % EBuffers;
+        wkcMutexUnlockPeer(m_mutex);
+        if (full)
+            break;
+
+        int len = std::min(length - filled, EBufferSize - m_fillLength);
+        memcpy(m_buffers[index] + m_fillLength, data + filled, len);
+        m_fillLength += len;
+        filled += len;
+
+        if (m_fillLength == EBufferSize)
+            queueFillBuffer();
+    }
+    return filled;
+}
+
+DownloadFileWriter::WriteResult DownloadFileWriter::write(const char* data, int length)
+{
+    if (failed())
+        return EWriteFailed;
+
+    // keep the order of the data behind what is already held back
+    int filled = m_overflow.isEmpty() ? fill(data, length) : 0;
+    if (filled < length)
+        m_overflow.append(data + filled, length - filled);
+
+    wkcMutexLockPeer(m_mutex);
+    bool full = !m_overflow.isEmpty() || m_count == EBuffers;
+    if (full)
+        m_waitingForRoom = true;
+    wkcMutexUnlockPeer(m_mutex);
+    return full ? EWriteFull : EWriteDone;
+}
+
+bool DownloadFileWriter::failed()
+{
+    wkcMutexLockPeer(m_mutex);
+    bool result = m_failed;
+    wkcMutexUnlockPeer(m_mutex);
+    return result;
+}
+
+bool DownloadFileWriter::finish()
+{
+    while (!m_overflow.isEmpty() && !failed()) {
+        int filled = fill(m_overflow.data(), m_overflow.size());
+        m_overflow.remove(0, filled);
+        if (m_overflow.isEmpty())
+            break;
+        wkcMutexLockPeer(m_mutex);
+        while (m_count == EBuffers && !m_failed)
+            wkcCondWaitPeer(m_cond, m_mutex);
+        wkcMutexUnlockPeer(m_mutex);
+    }
+    if (m_fillLength)
+        queueFillBuffer();
+
+    wkcMutexLockPeer(m_mutex);
+    while (m_count && !m_failed)
+        wkcCondWaitPeer(m_cond, m_mutex);
+    bool result = !m_failed;
+    wkcMutexUnlockPeer(m_mutex);
+
+    if (m_fd) {
+        if (wkcFileFClosePeer(m_fd))
+            result = false;
+        m_fd = 0;
+    }
+    return result;
+}
+
+void DownloadFileWriter::notifyProc(void* data)
+{
+    DownloadFileWriter* self = static_cast<DownloadFileWriter*>(data);
+    wkcMutexLockPeer(self->m_mutex);
+    self->m_notifyPosted = false;
+    bool failed = self->m_failed;
+    wkcMutexUnlockPeer(self->m_mutex);
+
+    if (!failed && !self->m_overflow.isEmpty()) {
+        int filled = self->fill(self->m_overflow.data(), self->m_overflow.size());
+        self->m_overflow.remove(0, filled);
+        // wait for the next buffer to be written out
+        if (!self->m_overflow.isEmpty())
+            return;
+    }
+    (*self->m_notifyProc)(self->m_notifyData);
+}
+
+void* DownloadFileWriter::threadProc(void* data)
+{
+    static_cast<DownloadFileWriter*>(data)->run();
+    return 0;
+}
+
+void DownloadFileWriter::run()
+{
+    wkcMutexLockPeer(m_mutex);
+    while (!m_quit) {
+        if (!m_count) {
+            wkcCondWaitPeer(m_cond, m_mutex);
+            continue;
+        }
+
+        const char* data = m_buffers[m_head];
+        int length = m_lengths[m_head];
+        bool ok = !m_failed;
+        wkcMutexUnlockPeer(m_mutex);
+
+        while (ok && length > 0) {
+            int written = (int)wkcFileFWritePeer(data, sizeof(char), length, m_fd);
+            if (written <= 0)
+                ok = false;
+            else {
+                data += written;
+                length -= written;
+            }
+        }
+        W_DP(("<dw>wrote %d bytes: %d", m_lengths[m_head], ok));
+
+        wkcMutexLockPeer(m_mutex);
+        if (!ok && !m_failed) {
+            m_failed = true;
+            m_waitingForRoom = true;
+        }
+        m_head = (m_head + 1) % EBuffers;
+        m_count--;
+        if (m_waitingForRoom && !m_notifyPosted) {
+            m_waitingForRoom = false;
+            m_notifyPosted = true;
+            callOnMainThread(notifyProc, this);
+        }
+        // for write() and finish()
+        wkcCondBroadcastPeer(m_cond);
+    }
+    wkcMutexUnlockPeer(m_mutex);
+}
+
+} // namespace WebCore
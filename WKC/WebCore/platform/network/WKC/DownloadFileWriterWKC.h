@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#ifndef DownloadFileWriterWKC_h
+#define DownloadFileWriterWKC_h
+
+#include <wtf/Vector.h>
+
+namespace WebCore {
+
+// Writes a download to a file on a worker thread.
+// Received data is copied into a fixed ring of buffers, so the heap used by
+// a download stays the same whatever its size. write() never waits for the
+// worker: when every buffer is waiting for it, the data that does not fit is
+// held back and write() returns EWriteFull, and the caller is expected to
+// stop the transfer until the notify proc is called on the main thread.
+class DownloadFileWriter {
+public:
+    typedef void (*NotifyProc)(void*);
+
+    enum {
+        EBuffers = 4,
+        EBufferSize = 64 * 1024,
+    };
+
+    enum WriteResult {
+        EWriteDone,
+        EWriteFull,
+        EWriteFailed,
+    };
+
+    // The file is appended to when offset is not 0, as when resuming,
+    // and truncated otherwise.
+    static DownloadFileWriter* create(const char* path, long long offset, NotifyProc proc, void* data);
+    ~DownloadFileWriter();
+
+    // main thread
+    // EWriteFull when no buffer is left for the next write(); the notify
+    // proc is called once what has been held back is in the ring again.
+    WriteResult write(const char* data, int length);
+    // writes out what is left and closes the file
+    bool finish();
+    bool failed();
+
+    // -1 when the file does not exist
+    static long long fileSize(const char* path);
+
+    // for force terminate
+    void forceTerminate();
+
+private:
+    DownloadFileWriter(NotifyProc proc, void* data);
+    bool construct(const char* path, long long offset);
+
+    void queueFillBuffer();
+    // returns the length copied into the ring
+    int fill(const char* data, int length);
+    static void notifyProc(void* data);
+    static void* threadProc(void* data);
+    void run();
+
+    NotifyProc m_notifyProc;
+    void* m_notifyData;
+
+    void* m_fd;
+    void* m_thread;
+    void* m_mutex;
+    void* m_cond;
+
+    char* m_buffers[EBuffers];
+    // the buffer after the queued ones is filled by the main thread
+    int m_fillLength;
+    // what did not fit in the ring
+    WTF::Vector<char> m_overflow;
+
+    // protected by m_mutex
+    int m_lengths[EBuffers];
+    int m_head;
+    int m_count;
+    bool m_quit;
+    bool m_failed;
+    bool m_waitingForRoom;
+    bool m_notifyPosted;
+};
+
+} // namespace WebCore
+
+#endif // DownloadFileWriterWKC_h
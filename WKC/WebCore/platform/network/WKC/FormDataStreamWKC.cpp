@@ -52,28 +52,34 @@ FormDataStream::~FormDataStream()
         wkcFileFClosePeer(m_file);
 }
 
-size_t FormDataStream::read(void* ptr, size_t blockSize, size_t numberOfBlocks)
+bool FormDataStream::attach()
 {
-    ResourceHandleInternal* d = m_resourceHandle->getInternal();
-    if (!d->client())
-        return 0;
-
-    // Check for overflow.
-    if (!numberOfBlocks || blockSize > std::numeric_limits<size_t>::max() / numberOfBlocks)
-        return 0;
-
-    Vector<FormDataElement> elements;
-    if (m_resourceHandle->firstRequest().httpBody())
-        elements = m_resourceHandle->firstRequest().httpBody()->elements();
-
-    if (m_formDataElementIndex >= elements.size())
-        return 0;
-
-    FormDataElement element = elements[m_formDataElementIndex];
+    if (!m_formData) {
+        m_formData = m_resourceHandle->firstRequest().httpBody();
+        if (!m_formData)
+            return false;
+    }
+    return true;
+}
 
-    size_t toSend = blockSize * numberOfBlocks;
-    size_t sent;
+void FormDataStream::nextElement()
+{
+    if (m_file) {
+        wkcFileFClosePeer(m_file);
+        m_file = 0;
+    }
+#if ENABLE(BLOB)
+    m_blobData = 0;
+    m_blobItemIndex = 0;
+#endif
+    m_formDataElementDataOffset = 0;
+    m_formDataElementIndex++;
+}
 
+// Returns the bytes copied from the current element, 0 when the element
+// has been finished (or failed) and the cursor moved to the next one.
+size_t FormDataStream::readElement(const FormDataElement& element, char* ptr, size_t length)
+{
     if (element.m_type == FormDataElement::encodedFile) {
         if (!m_file) {
             m_file = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_FORMDATA, element.m_filename.utf8().data(), "rb");
@@ -81,71 +87,108 @@ size_t FormDataStream::read(void* ptr, size_t blockSize, size_t numberOfBlocks)
 #ifndef NDEBUG
                 peerDebugPrintf("Failed while trying to open %s for upload\n", element.m_filename.utf8().data());
 #endif
-                m_file = 0;
-                m_formDataElementIndex++;
+                nextElement();
                 return 0;
             }
         }
 
-        sent = wkcFileFReadPeer(ptr, blockSize, numberOfBlocks, m_file);
+        // straight into libcurl's upload buffer
+        size_t sent = wkcFileFReadPeer(ptr, 1, length, m_file);
         if ((int)sent < 0) {
 #ifndef NDEBUG
             peerDebugPrintf("Failed while trying to read %s for upload\n", element.m_filename.utf8().data());
 #endif
+            nextElement();
             return 0;
         }
-        if (wkcFileFeofPeer(m_file)) {
-            wkcFileFClosePeer(m_file);
-            m_file = 0;
-            m_formDataElementIndex++;
-        }
+        if (sent < length || wkcFileFeofPeer(m_file))
+            nextElement();
+        return sent;
+    }
+
 #if ENABLE(BLOB)
-    } else if (element.m_type == FormDataElement::encodedBlob) {
-        RefPtr<BlobStorageData> blobData = static_cast<BlobRegistryImpl&>(blobRegistry()).getBlobDataFromURL(KURL(ParsedURLString, element.m_blobURL));
-        if (blobData) {
-            for (size_t j = 0; j < blobData->items().size(); ++j) {
-                const BlobDataItem& blobItem = blobData->items()[j];
-                if (blobItem.type == BlobDataItem::Data) {
-                    size_t elementSize = static_cast<int>(blobItem.length) - m_formDataElementDataOffset;
-                    sent = elementSize > toSend ? toSend : elementSize;
-                    const char* p = blobItem.data->data() + static_cast<int>(blobItem.offset);
-                    memcpy(ptr, p + m_formDataElementDataOffset, sent);
-                    if (elementSize > sent)
-                        m_formDataElementDataOffset += sent;
-                    else {
-                        m_formDataElementDataOffset = 0;
-                        m_formDataElementIndex++;
-                    }
-                }
+    if (element.m_type == FormDataElement::encodedBlob) {
+        if (!m_blobData) {
+            m_blobData = static_cast<BlobRegistryImpl&>(blobRegistry()).getBlobDataFromURL(KURL(ParsedURLString, element.m_blobURL));
+            if (!m_blobData) {
+                nextElement();
+                return 0;
             }
         }
-#endif
-    } else {
-        size_t elementSize = element.m_data.size() - m_formDataElementDataOffset;
-        sent = elementSize > toSend ? toSend : elementSize;
-        memcpy(ptr, element.m_data.data() + m_formDataElementDataOffset, sent);
-        if (elementSize > sent)
-            m_formDataElementDataOffset += sent;
-        else {
+
+        // only data items are counted in the request size; see setupMethod()
+        const BlobDataItemList& items = m_blobData->items();
+        while (m_blobItemIndex < items.size()) {
+            const BlobDataItem& blobItem = items[m_blobItemIndex];
+            if (blobItem.type == BlobDataItem::Data && m_formDataElementDataOffset < static_cast<size_t>(blobItem.length)) {
+                size_t itemSize = static_cast<size_t>(blobItem.length) - m_formDataElementDataOffset;
+                size_t sent = itemSize > length ? length : itemSize;
+                memcpy(ptr, blobItem.data->data() + static_cast<size_t>(blobItem.offset) + m_formDataElementDataOffset, sent);
+                m_formDataElementDataOffset += sent;
+                return sent;
+            }
+            m_blobItemIndex++;
             m_formDataElementDataOffset = 0;
-            m_formDataElementIndex++;
         }
+        nextElement();
+        return 0;
     }
+#endif
 
+    size_t elementSize = element.m_data.size() - m_formDataElementDataOffset;
+    size_t sent = elementSize > length ? length : elementSize;
+    memcpy(ptr, element.m_data.data() + m_formDataElementDataOffset, sent);
+    if (elementSize > sent)
+        m_formDataElementDataOffset += sent;
+    else
+        nextElement();
     return sent;
 }
 
-bool FormDataStream::hasMoreElements() const
+size_t FormDataStream::read(void* ptr, size_t blockSize, size_t numberOfBlocks)
 {
-    Vector<FormDataElement> elements;
-    if (m_resourceHandle->firstRequest().httpBody())
-        elements = m_resourceHandle->firstRequest().httpBody()->elements();
+    ResourceHandleInternal* d = m_resourceHandle->getInternal();
+    if (!d->client())
+        return 0;
 
-    return m_formDataElementIndex < elements.size();
+    // Check for overflow.
+    if (!numberOfBlocks || blockSize > std::numeric_limits<size_t>::max() / numberOfBlocks)
+        return 0;
+
+    if (!attach())
+        return 0;
+
+    const Vector<FormDataElement>& elements = m_formData->elements();
+    char* p = static_cast<char*>(ptr);
+    size_t toSend = blockSize * numberOfBlocks;
+    size_t sent = 0;
+
+    // fill the whole buffer, across element boundaries
+    while (sent < toSend && m_formDataElementIndex < elements.size())
+        sent += readElement(elements[m_formDataElementIndex], p + sent, toSend - sent);
+
+    return sent;
+}
+
+bool FormDataStream::hasMoreElements() const
+{
+    const FormData* formData = m_formData ? m_formData.get() : m_resourceHandle->firstRequest().httpBody();
+    if (!formData)
+        return false;
+    return m_formDataElementIndex < formData->elements().size();
 }
 
 void FormDataStream::refresh()
 {
+    if (m_file) {
+        wkcFileFClosePeer(m_file);
+        m_file = 0;
+    }
+#if ENABLE(BLOB)
+    m_blobData = 0;
+    m_blobItemIndex = 0;
+#endif
+    m_formData = 0;
     m_formDataElementIndex = 0;
     m_formDataElementDataOffset = 0;
 }
@@ -29,11 +29,17 @@
 #include "config.h"
 
 #include "FileSystem.h"
+#include "FormData.h"
 #include "ResourceHandle.h"
 #include <stdio.h>
+#include <wtf/RefPtr.h>
 
 namespace WebCore {
 
+#if ENABLE(BLOB)
+class BlobStorageData;
+#endif
+
 class FormDataStream {
 public:
     FormDataStream(ResourceHandle* handle)
@@ -41,6 +47,9 @@ public:
         , m_file(0)
         , m_formDataElementIndex(0)
         , m_formDataElementDataOffset(0)
+#if ENABLE(BLOB)
+        , m_blobItemIndex(0)
+#endif
     {
     }
 
@@ -48,16 +57,28 @@ public:
 
     size_t read(void* ptr, size_t blockSize, size_t numberOfBlocks);
     bool hasMoreElements() const;
+    // rewinds to the beginning of the body
     void refresh();
 
 private:
+    bool attach();
+    void nextElement();
+    size_t readElement(const FormDataElement& element, char* ptr, size_t length);
+
     // We can hold a weak reference to our ResourceHandle as it holds a strong reference
     // to us through its ResourceHandleInternal.
     ResourceHandle* m_resourceHandle;
 
+    // the body being sent; its elements are read in place
+    RefPtr<FormData> m_formData;
     void* m_file;
     size_t m_formDataElementIndex;
     size_t m_formDataElementDataOffset;
+#if ENABLE(BLOB)
+    // the blob of the current element, resolved once
+    RefPtr<BlobStorageData> m_blobData;
+    size_t m_blobItemIndex;
+#endif
 };
 
 } // namespace WebCore
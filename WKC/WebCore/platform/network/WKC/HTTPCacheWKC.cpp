@@ -28,6 +28,8 @@
 #include "FileSystem.h"
 #include "ResourceResponse.h"
 #include "ResourceHandleClient.h"
+#include <wtf/ASCIICType.h>
+#include <wtf/HashSet.h>
 #include <wtf/MathExtras.h>
 #include <wtf/MD5.h>
 #include <wkc/wkcclib.h>
@@ -52,8 +54,10 @@ namespace WebCore {
 
 HTTPCachedResource::HTTPCachedResource()
 {
-    m_used = false;
     m_httpequivflags = 0;
+    m_writeCancelled = false;
+    m_lruPrev = 0;
+    m_lruNext = 0;
     m_resourceData = 0;
 
     m_expectedContentLength = 0;
@@ -62,6 +66,7 @@ HTTPCachedResource::HTTPCachedResource()
     m_mustRevalidate = false;
     m_expires = 0;
     m_maxAge = 0;
+    m_staleWhileRevalidate = 0;
     m_date = 0;
     m_lastModified = 0;
 
@@ -71,8 +76,10 @@ HTTPCachedResource::HTTPCachedResource()
 
 HTTPCachedResource::HTTPCachedResource(const KURL &url, const ResourceResponse &response)
 {
-    m_used = false;
     m_httpequivflags = 0;
+    m_writeCancelled = false;
+    m_lruPrev = 0;
+    m_lruNext = 0;
 
     m_contentLength = 0;
     m_resourceSize = 0;
@@ -112,6 +119,58 @@ bool HTTPCachedResource::needRevalidate()
     return m_mustRevalidate || m_noCache || isExpired();
 }
 
+// "stale-while-revalidate=<seconds>" of Cache-Control, 0 if not given
+static double parseStaleWhileRevalidate(const String& cacheControl)
+{
+    static const char cDirective[] = "stale-while-revalidate";
+
+    size_t pos = cacheControl.findIgnoringCase(reinterpret_cast<const LChar*>(cDirective));
+    if (pos == notFound)
+        return 0;
+    pos += sizeof(cDirective) - 1;
+    while (pos < cacheControl.length() && cacheControl[pos] == ' ')
+        pos++;
+    if (pos >= cacheControl.length() || cacheControl[pos] != '=')
+        return 0;
+    pos++;
+    while (pos < cacheControl.length() && cacheControl[pos] == ' ')
+        pos++;
+
+    double value = 0;
+    for (; pos < cacheControl.length() && isASCIIDigit(cacheControl[pos]); pos++)
+        value = value * 10 + (cacheControl[pos] - '0');
+    return value;
+}
+
+bool HTTPCachedResource::isUsableWhileRevalidating()
+{
+    if (m_mustRevalidate || m_noCache || m_staleWhileRevalidate <= 0)
+        return false;
+    return (currentTime() - m_date <= freshnessLifetime() + m_staleWhileRevalidate);
+}
+
+void HTTPCachedResource::didRevalidate(const ResourceResponse &response)
+{
+    // RFC 7234 4.3.4: the stored entry takes the headers of the 304 response
+    m_date = isfinite(response.date()) ? response.date() : currentTime();
+    if (isfinite(response.expires()))
+        m_expires = response.expires();
+    if (!(m_httpequivflags&EHTTPEquivMaxAge) && isfinite(response.cacheControlMaxAge()))
+        m_maxAge = response.cacheControlMaxAge();
+    const String& cacheControl = response.httpHeaderField("Cache-Control");
+    if (!cacheControl.isEmpty())
+        m_staleWhileRevalidate = parseStaleWhileRevalidate(cacheControl);
+    const String& etag = response.httpHeaderField("ETag");
+    if (!etag.isEmpty())
+        m_eTagHeader = etag;
+    const String& lastModified = response.httpHeaderField("Last-Modified");
+    if (!lastModified.isEmpty()) {
+        m_lastModifiedHeader = lastModified;
+        m_lastModified = response.lastModified();
+    }
+    calcResourceSize();
+}
+
 void HTTPCachedResource::update(bool noCache, bool mustRevalidate, double expires, double maxAge, int httpequivflags)
 {
     if ((!(m_httpequivflags&EHTTPEquivNoCache)) || (httpequivflags&EHTTPEquivNoCache))
@@ -153,6 +212,7 @@ bool HTTPCachedResource::setResourceResponse(const ResourceResponse &response)
         m_mustRevalidate |= response.cacheControlContainsMustRevalidate();
     if (!(m_httpequivflags&EHTTPEquivMaxAge))
         m_maxAge = response.cacheControlMaxAge();
+    m_staleWhileRevalidate = parseStaleWhileRevalidate(response.httpHeaderField("Cache-Control"));
 
     return true;
 }
@@ -188,11 +248,7 @@ bool HTTPCachedResource::writeFile(const String& filename, const String& filepat
     }
     W_DP(("cache write %s", m_url.utf8().data()));
 
-    m_contentLength = m_resourceData->size();
     m_fileName = filename;
-    calcResourceSize();
-
-    m_resourceData = 0;
 
     result = true;
 error_end:
@@ -202,34 +258,26 @@ error_end:
     return result;
 }
 
-bool HTTPCachedResource::readFile(char *out_buf, const String& filepath)
+void HTTPCachedResource::didWriteFile()
 {
-    void *fd = 0;
-    bool result = false;
-    char *buf = out_buf;
+    if (m_resourceData)
+        m_contentLength = m_resourceData->size();
+    calcResourceSize();
 
-    String fileFullPath = pathByAppendingComponent(filepath, m_fileName);
+    m_resourceData = 0;
+}
 
-    fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_CACHE, fileFullPath.utf8().data(), "rb");
-    if (!fd)
-        goto error_end;
+void* HTTPCachedResource::openFile(const String& filepath)
+{
+    if (m_fileName.isEmpty())
+        return 0;
 
-    int len, read;
-    for (len = m_contentLength; len > 0; len -= read) {
-        read = wkcFileFReadPeer(buf, sizeof(char), len, fd);
-        if (read < 0)
-            break;
-        buf += read; 
-    }
-    W_DP(("cache read %s", m_url.utf8().data()));
+    String fileFullPath = pathByAppendingComponent(filepath, m_fileName);
 
-    m_used = true;
-    result = true;
-error_end:
-    if (fd)
-        wkcFileFClosePeer(fd);
+    void *fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_CACHE, fileFullPath.utf8().data(), "rb");
+    W_DP(("cache open %s", m_url.utf8().data()));
 
-    return result;
+    return fd;
 }
 
 #define ROUNDUP(x, y)   (((x)+((y)-1))/(y)*(y))
@@ -239,14 +287,15 @@ void HTTPCachedResource::calcResourceSize()
 {
     int size = sizeof(long long) * 2
         + sizeof(int) * 3
-        + sizeof(double) * 4
+        + sizeof(double) * 5
         + sizeof(int) + ROUNDUP(m_url.utf8().length(), ROUNDUP_UNIT)
         + sizeof(int) + ROUNDUP(m_mimeType.utf8().length(), ROUNDUP_UNIT)
         + sizeof(int) + ROUNDUP(m_textEncodingName.utf8().length(), ROUNDUP_UNIT)
         + sizeof(int) + ROUNDUP(m_suggestedFilename.utf8().length(), ROUNDUP_UNIT)
         + sizeof(int) + ROUNDUP(m_fileName.utf8().length(), ROUNDUP_UNIT)
         + sizeof(int) + ROUNDUP(m_lastModifiedHeader.utf8().length(), ROUNDUP_UNIT)
-        + sizeof(int) + ROUNDUP(m_eTagHeader.utf8().length(), ROUNDUP_UNIT);
+        + sizeof(int) + ROUNDUP(m_eTagHeader.utf8().length(), ROUNDUP_UNIT)
+        + sizeof(int) + ROUNDUP(m_contentDigest.utf8().length(), ROUNDUP_UNIT);
 
     m_resourceSize = ROUNDUP(size, ROUNDUP_UNIT);
 }
@@ -275,6 +324,7 @@ int HTTPCachedResource::serialize(char *buffer)
     (*(int*)buffer) = m_mustRevalidate ? 1 : 0; buffer += sizeof(int);
     (*(double*)buffer) = m_expires; buffer += sizeof(double);
     (*(double*)buffer) = m_maxAge; buffer += sizeof(double);
+    (*(double*)buffer) = m_staleWhileRevalidate; buffer += sizeof(double);
     (*(double*)buffer) = m_date; buffer += sizeof(double);
     (*(double*)buffer) = m_lastModified; buffer += sizeof(double);
     // string field
@@ -285,6 +335,7 @@ int HTTPCachedResource::serialize(char *buffer)
     buffer += writeString(buffer, m_fileName);
     buffer += writeString(buffer, m_lastModifiedHeader);
     buffer += writeString(buffer, m_eTagHeader);
+    buffer += writeString(buffer, m_contentDigest);
 
     return ROUNDUP(buffer - buf, ROUNDUP_UNIT);
 }
@@ -311,6 +362,7 @@ int HTTPCachedResource::deserialize(char *buffer)
     m_mustRevalidate = (*(int*)buffer); buffer += sizeof(int);
     m_expires = (*(double*)buffer); buffer += sizeof(double);
     m_maxAge = (*(double*)buffer); buffer += sizeof(double);
+    m_staleWhileRevalidate = (*(double*)buffer); buffer += sizeof(double);
     m_date = (*(double*)buffer); buffer += sizeof(double);
     m_lastModified = (*(double*)buffer); buffer += sizeof(double);
     // string field
@@ -321,6 +373,7 @@ int HTTPCachedResource::deserialize(char *buffer)
     buffer += readString(buffer, m_fileName);
     buffer += readString(buffer, m_lastModifiedHeader);
     buffer += readString(buffer, m_eTagHeader);
+    buffer += readString(buffer, m_contentDigest);
 
     calcResourceSize();
 
@@ -331,6 +384,8 @@ int HTTPCachedResource::deserialize(char *buffer)
 // HTTPCache
 
 #define DEFAULT_FAT_FILENAME        "cache.fat"
+#define DEFAULT_JOURNAL_FILENAME    "cache.jnl"
+#define CHECKPOINT_FILENAME_SUFFIX  ".new"
 #define DEFAULT_FILEPATH            "cache/"
 #define DEFAULT_CONTENTENTRIES_LIMIT     (1024)
 #define DEFAULT_CONTENTSIZE_LIMIT        (10 * 1024 * 1024)
@@ -339,10 +394,22 @@ int HTTPCachedResource::deserialize(char *buffer)
 HTTPCache::HTTPCache()
     : m_fatFileName(DEFAULT_FAT_FILENAME)
     , m_filePath(DEFAULT_FILEPATH)
+    , m_journalFileName(DEFAULT_JOURNAL_FILENAME)
+    , m_journalSize(0)
+    , m_fatGeneration(0)
 {
+    m_deduplication = true;
+    m_staleWhileRevalidate = true;
+    m_bodyFiles = 0;
+    m_dedupLookups = 0;
+    m_dedupHits = 0;
     m_disabled = false;
+    m_lruHead = 0;
+    m_lruTail = 0;
+    m_resourceCount = 0;
     m_fileNumber = 0;
     m_totalResourceSize = 0;
+    m_freeFilesSize = 0;
 
     m_totalContentsSize = 0;
     m_limitContentEntries = DEFAULT_CONTENTENTRIES_LIMIT;
@@ -357,14 +424,23 @@ HTTPCache::~HTTPCache()
 
 void HTTPCache::reset()
 {
-    HTTPCachedResource *resource;
+    HTTPCachedResource *resource = m_lruHead;
 
-    for (int num = 0; num < m_resourceList.size(); num++) {
-        resource = m_resourceList[num];
+    while (resource) {
+        HTTPCachedResource *next = resource->m_lruNext;
         delete resource;
+        resource = next;
     }
-    m_resourceList.clear();
+    m_lruHead = 0;
+    m_lruTail = 0;
+    m_resourceCount = 0;
     m_resources.clear();
+    deleteAllValues(m_blobs);
+    m_blobs.clear();
+    m_bodyFiles = 0;
+    m_journalPending.clear();
+
+    removeFreeFiles();
 
     m_totalResourceSize = 0;
     m_totalContentsSize = 0;
@@ -380,12 +456,16 @@ HTTPCachedResource* HTTPCache::createHTTPCachedResource(KURL &url, RefPtr<Shared
         return 0;   // size over
     if (m_limitTotalContentsSize < contentLength)
         return 0;   // size over
+    if (m_limitTotalContentsSize < m_totalContentsSize + m_freeFilesSize + contentLength)
+        removeFreeFiles();
     if (m_limitTotalContentsSize < m_totalContentsSize + contentLength)
         if (purgeBySize(contentLength)==0)
             return 0; // total size over
-    if (m_resourceList.size() >= m_limitContentEntries)
-        if (purgeOldest()==0)
+    if (m_resourceCount >= m_limitContentEntries) {
+        purgeOldest();
+        if (m_resourceCount >= m_limitContentEntries)
             return 0; // entry limit over
+    }
 
     const KURL kurl = removeFragmentIdentifierIfNeeded(url);
     HTTPCachedResource *resource = new HTTPCachedResource(kurl, response);
@@ -402,10 +482,10 @@ bool HTTPCache::addCachedResource(HTTPCachedResource *resource)
     if (disabled())
         return false;
 
+    retainBody(resource);
     m_resources.set(resource->url(), resource);
-    m_resourceList.append(resource);
+    appendToLRU(resource);
     m_totalResourceSize += resource->resourceSize();
-    m_totalContentsSize += resource->contentLength();
 
     return true;
 }
@@ -417,58 +497,221 @@ void HTTPCache::updateCachedResource(HTTPCachedResource *resource, RefPtr<Shared
     resource->update(noCache, mustRevalidate, expires, maxAge);
 }
 
-void HTTPCache::removeResource(HTTPCachedResource *resource)
+void HTTPCache::revalidated(HTTPCachedResource *resource, const ResourceResponse &response)
+{
+    m_totalResourceSize -= resource->resourceSize();
+    resource->didRevalidate(response);
+    m_totalResourceSize += resource->resourceSize();
+    moveToMostRecentlyUsed(resource);
+    // the body may still be being written; finishWrite() records it then
+    if (!resource->fileName().isEmpty())
+        journalAdd(resource);
+}
+
+bool HTTPCache::removeResource(HTTPCachedResource *resource)
 {
     m_resources.remove(resource->url());
-    for (int num = 0; num < m_resourceList.size(); num++) {
-        if (m_resourceList[num] == resource) {
-            m_resourceList.remove(num);
-            break;
+    removeFromLRU(resource);
+    m_totalResourceSize -= resource->resourceSize();
+    return releaseBody(resource);
+}
+
+void HTTPCache::remove(HTTPCachedResource *resource)
+{
+    journalRemove(resource);
+    if (removeResource(resource)) {
+        W_DP(("remove cache file %s", resource->fileName().utf8().data()));
+        recycleFile(resource->fileName(), resource->contentLength());
+    }
+
+    delete resource;
+}
+
+void HTTPCache::detach(HTTPCachedResource *resource)
+{
+    journalRemove(resource);
+    if (removeResource(resource))
+        recycleFile(resource->fileName(), resource->contentLength());
+}
+
+void HTTPCache::retainBody(HTTPCachedResource *resource)
+{
+    if (!resource->m_contentDigest.isEmpty()) {
+        HTTPCachedBlob *blob = m_blobs.get(resource->m_contentDigest);
+        if (blob && blob->m_fileName == resource->m_fileName) {
+            blob->m_refCount++;
+            return;
         }
+        if (!blob) {
+            blob = new HTTPCachedBlob;
+            if (blob) {
+                blob->m_fileName = resource->m_fileName;
+                blob->m_contentLength = resource->contentLength();
+                blob->m_refCount = 1;
+                m_blobs.set(resource->m_contentDigest, blob);
+                m_bodyFiles++;
+                m_totalContentsSize += resource->contentLength();
+                return;
+            }
+        }
+        // the digest is already owned by another file: keep this one unshared
+        resource->m_contentDigest = String();
+        resource->calcResourceSize();
     }
-    m_totalResourceSize -= resource->resourceSize();
+    m_bodyFiles++;
+    m_totalContentsSize += resource->contentLength();
+}
+
+bool HTTPCache::releaseBody(HTTPCachedResource *resource)
+{
+    if (!resource->m_contentDigest.isEmpty()) {
+        HTTPCachedBlobMap::iterator it = m_blobs.find(resource->m_contentDigest);
+        if (it != m_blobs.end() && it->second->m_fileName == resource->m_fileName) {
+            HTTPCachedBlob *blob = it->second;
+            if (--blob->m_refCount > 0)
+                return false;
+            m_blobs.remove(it);
+            delete blob;
+        }
+    }
+    m_bodyFiles--;
     m_totalContentsSize -= resource->contentLength();
+    return true;
 }
 
-void HTTPCache::removeResourceByNumber(int listNumber)
+void HTTPCache::appendToLRU(HTTPCachedResource *resource)
 {
-    HTTPCachedResource *resource = m_resourceList[listNumber];
+    ASSERT(!resource->m_lruPrev && !resource->m_lruNext && m_lruHead != resource);
 
-    W_DP(("remove cache file %s", resource->fileName().utf8().data()));
+    resource->m_lruPrev = m_lruTail;
+    resource->m_lruNext = 0;
+    if (m_lruTail)
+        m_lruTail->m_lruNext = resource;
+    else
+        m_lruHead = resource;
+    m_lruTail = resource;
+    m_resourceCount++;
+}
 
-    m_resources.remove(resource->url());
-    m_resourceList.remove(listNumber);
-    m_totalResourceSize -= resource->resourceSize();
-    m_totalContentsSize -= resource->contentLength();
+void HTTPCache::removeFromLRU(HTTPCachedResource *resource)
+{
+    if (resource->m_lruPrev)
+        resource->m_lruPrev->m_lruNext = resource->m_lruNext;
+    else if (m_lruHead == resource)
+        m_lruHead = resource->m_lruNext;
+    else
+        return; // not in the list
 
-    const String fileFullPath = pathByAppendingComponent(m_filePath, resource->fileName());
-    wkcFileUnlinkPeer(fileFullPath.utf8().data());
+    if (resource->m_lruNext)
+        resource->m_lruNext->m_lruPrev = resource->m_lruPrev;
+    else
+        m_lruTail = resource->m_lruPrev;
 
-    delete resource;
+    resource->m_lruPrev = 0;
+    resource->m_lruNext = 0;
+    m_resourceCount--;
 }
 
-void HTTPCache::remove(HTTPCachedResource *resource)
+void HTTPCache::moveToMostRecentlyUsed(HTTPCachedResource *resource)
 {
-    removeResource(resource);
+    if (m_lruTail == resource)
+        return;
+    removeFromLRU(resource);
+    appendToLRU(resource);
+}
 
-    W_DP(("remove cache file %s", resource->fileName().utf8().data()));
+int HTTPCache::freeFileBucket(long long contentLength)
+{
+    // 0: < 4KB, 1: < 8KB, ... , EFreeFileBuckets-1: the rest
+    int bucket = 0;
+    for (long long size = contentLength >> 12; size && bucket < EFreeFileBuckets - 1; size >>= 1)
+        bucket++;
+    return bucket;
+}
 
-    const String fileFullPath = pathByAppendingComponent(m_filePath, resource->fileName());
-    wkcFileUnlinkPeer(fileFullPath.utf8().data());
+String HTTPCache::takeFileName(long long contentLength)
+{
+    Vector<FreeFile>& bucket = m_freeFiles[freeFileBucket(contentLength)];
+    if (bucket.isEmpty())
+        return makeFileName();
 
-    delete resource;
+    String fileName = bucket.last().m_fileName;
+    m_freeFilesSize -= bucket.last().m_contentLength;
+    bucket.removeLast();
+    return fileName;
 }
 
-void HTTPCache::detach(HTTPCachedResource *resource)
+void HTTPCache::recycleFile(const String& fileName, long long contentLength)
 {
-    removeResource(resource);
+    if (fileName.isEmpty())
+        return;
 
-    if (resource->fileName().isEmpty())
+    // a file still being streamed must not be overwritten
+    if (isOpenForRead(fileName)) {
+        const String fileFullPath = pathByAppendingComponent(m_filePath, fileName);
+        wkcFileUnlinkPeer(fileFullPath.utf8().data());
         return;
-    const String fileFullPath = pathByAppendingComponent(m_filePath, resource->fileName());
+    }
+
+    // large files are not worth keeping around, nor any beyond the total size
+    int num = freeFileBucket(contentLength);
+    if (num < EFreeFileBuckets - 1 && m_freeFiles[num].size() < EFreeFilesPerBucket
+        && m_totalContentsSize + m_freeFilesSize + contentLength <= m_limitTotalContentsSize) {
+        // until the journal is flushed, a crash would bring back the old resource on this file
+        FreeFile file = { fileName, contentLength };
+        m_recycledFiles.append(file);
+        m_freeFilesSize += contentLength;
+        return;
+    }
+
+    const String fileFullPath = pathByAppendingComponent(m_filePath, fileName);
     wkcFileUnlinkPeer(fileFullPath.utf8().data());
 }
 
+void HTTPCache::releaseRecycledFiles()
+{
+    for (size_t i = 0; i < m_recycledFiles.size(); i++) {
+        const FreeFile& file = m_recycledFiles[i];
+        Vector<FreeFile>& bucket = m_freeFiles[freeFileBucket(file.m_contentLength)];
+        if (bucket.size() < EFreeFilesPerBucket) {
+            bucket.append(file);
+            continue;
+        }
+        m_freeFilesSize -= file.m_contentLength;
+        const String fileFullPath = pathByAppendingComponent(m_filePath, file.m_fileName);
+        wkcFileUnlinkPeer(fileFullPath.utf8().data());
+    }
+    m_recycledFiles.clear();
+}
+
+bool HTTPCache::isOpenForRead(const String& fileName)
+{
+    HashMap<void*, String>::iterator end = m_openFiles.end();
+    for (HashMap<void*, String>::iterator it = m_openFiles.begin(); it != end; ++it) {
+        if (it->second == fileName)
+            return true;
+    }
+    return false;
+}
+
+void HTTPCache::removeFreeFiles()
+{
+    for (int i = 0; i < EFreeFileBuckets; i++) {
+        Vector<FreeFile>& bucket = m_freeFiles[i];
+        for (size_t num = 0; num < bucket.size(); num++) {
+            const String fileFullPath = pathByAppendingComponent(m_filePath, bucket[num].m_fileName);
+            wkcFileUnlinkPeer(fileFullPath.utf8().data());
+        }
+        bucket.clear();
+    }
+    for (size_t num = 0; num < m_recycledFiles.size(); num++) {
+        const String fileFullPath = pathByAppendingComponent(m_filePath, m_recycledFiles[num].m_fileName);
+        wkcFileUnlinkPeer(fileFullPath.utf8().data());
+    }
+    m_recycledFiles.clear();
+    m_freeFilesSize = 0;
+}
+
 void HTTPCache::removeAll()
 {
     reset();
@@ -488,6 +731,13 @@ void HTTPCache::removeAll()
     int ret = wkcFilePathByAppendingComponentPeer(m_filePath.utf8().data(), m_fatFileName.utf8().data(), fullpath, MAX_PATH);
     if (ret)
         wkcFileUnlinkPeer(fullpath);
+    ret = wkcFilePathByAppendingComponentPeer(m_filePath.utf8().data(), (m_fatFileName + CHECKPOINT_FILENAME_SUFFIX).utf8().data(), fullpath, MAX_PATH);
+    if (ret)
+        wkcFileUnlinkPeer(fullpath);
+    ret = wkcFilePathByAppendingComponentPeer(m_filePath.utf8().data(), m_journalFileName.utf8().data(), fullpath, MAX_PATH);
+    if (ret)
+        wkcFileUnlinkPeer(fullpath);
+    m_journalSize = 0;
 }
 
 void HTTPCache::setDisabled(bool disabled)
@@ -517,9 +767,11 @@ void HTTPCache::setMaxTotalCacheSize(long long limit)
         limit = 0x7fffffffffffffffLL; // LONG_LONG_MAX
     m_limitTotalContentsSize = limit;
 
+    if (limit < m_totalContentsSize + m_freeFilesSize)
+        removeFreeFiles();
     if (limit < m_totalContentsSize) {
         purgeBySize(m_totalContentsSize - limit);
-        writeFATFile();
+        flushJournal();
     }
 }
 
@@ -532,6 +784,7 @@ void HTTPCache::setFilePath(const char* path)
     if (m_filePath == path)
         return;
 
+    removeFreeFiles();
     m_filePath = String::fromUTF8(path);
 
     // ensure the destination path is exist
@@ -584,80 +837,158 @@ String HTTPCache::makeFileName()
     return fileName;
 }
 
-long long HTTPCache::purgeBySizeInternal(long long size)
+long long HTTPCache::purgeBySize(long long size)
 {
-    HTTPCachedResource *resource;
     long long purgedSize = 0;
 
-    for (int num = 0; num < m_resourceList.size(); ) {
-        resource = m_resourceList[num];
-        if (resource->isUsed())
-            num++;
-        else {
-            purgedSize += resource->contentLength();
-            removeResourceByNumber(num);
-            if (purgedSize > size)
-                break;
-        }
+    while (m_lruHead) {
+        purgedSize += purgeOldest();
+        if (purgedSize > size)
+            break;
     }
     return purgedSize;
 }
 
-long long HTTPCache::purgeBySize(long long size)
+long long HTTPCache::purgeOldest()
 {
-    long long purgedSize = purgeBySizeInternal(size);
-    if (purgedSize < size) {
-        for (int num = 0; num < m_resourceList.size(); num++)
-            m_resourceList[num]->setUsed(false);
-        purgedSize +=purgeBySizeInternal(size - purgedSize);
-    }
-    return purgedSize;
+    HTTPCachedResource *resource = m_lruHead;
+    if (!resource)
+        return 0;
+
+    // a body shared with other entries stays on disk
+    long long totalContentsSize = m_totalContentsSize;
+    remove(resource);
+    return totalContentsSize - m_totalContentsSize;
 }
 
-long long HTTPCache::purgeOldest()
+bool HTTPCache::write(HTTPCachedResource *resource)
 {
-    HTTPCachedResource *resource;
-    long long purgedSize = 0;
+    prepareWrite(resource);
+    bool written = resource->writeFile(resource->fileName(), m_filePath);
 
-    for (int num = 0; num < m_resourceList.size(); ) {
-        resource = m_resourceList[num];
-        if (resource->isUsed())
-            num++;
-        else {
-            purgedSize += resource->contentLength();
-            removeResourceByNumber(num);
-            break;
+    Vector<uint8_t, 16> digest;
+    SharedBuffer* data = resource->resourceData();
+    if (written && data) {
+        MD5 md5;
+        const char *buf;
+        unsigned position = 0;
+        while (unsigned length = data->getSomeData(buf, position)) {
+            md5.addBytes((const uint8_t*)buf, length);
+            position += length;
         }
+        md5.checksum(digest);
     }
-    return purgedSize;
+    return finishWrite(resource, written, digest.size() ? digest.data() : 0);
 }
 
-bool HTTPCache::write(HTTPCachedResource *resource)
+String HTTPCache::prepareWrite(HTTPCachedResource *resource)
 {
     long long contentLength = resource->contentLength();
+    resource->m_fileName = takeFileName(contentLength);
+    // the free files go before any resource
+    if (m_totalContentsSize + m_freeFilesSize + contentLength > m_limitTotalContentsSize)
+        removeFreeFiles();
     if (m_totalContentsSize + contentLength > m_limitTotalContentsSize)
         purgeBySize(contentLength);
 
-    if (!resource->writeFile(makeFileName(), m_filePath))
+    resource->m_contentDigest = String();
+    return pathByAppendingComponent(m_filePath, resource->m_fileName);
+}
+
+bool HTTPCache::finishWrite(HTTPCachedResource *resource, bool written, const unsigned char* digest)
+{
+    if (!written || resource->writeCancelled()) {
+        const String fileFullPath = pathByAppendingComponent(m_filePath, resource->fileName());
+        wkcFileUnlinkPeer(fileFullPath.utf8().data());
         return false;
-    
-    m_resources.add(resource->url(), resource);
-    m_resourceList.append(resource);
+    }
+
+    resource->didWriteFile();
+
+    if (digest && m_deduplication) {
+        resource->m_contentDigest = String::format("%08x%08x%08x%08x",
+            (digest[0] << 24) | (digest[1] << 16) | (digest[2] << 8) | digest[3],
+            (digest[4] << 24) | (digest[5] << 16) | (digest[6] << 8) | digest[7],
+            (digest[8] << 24) | (digest[9] << 16) | (digest[10] << 8) | digest[11],
+            (digest[12] << 24) | (digest[13] << 16) | (digest[14] << 8) | digest[15]);
+        m_dedupLookups++;
+        HTTPCachedBlob *blob = m_blobs.get(resource->m_contentDigest);
+        if (blob && blob->m_contentLength == resource->contentLength()) {
+            // the same bytes are already stored for another URL
+            W_DP(("cache dedup %s -> %s", resource->url().utf8().data(), blob->m_fileName.utf8().data()));
+            recycleFile(resource->m_fileName, resource->contentLength());
+            resource->m_fileName = blob->m_fileName;
+            m_dedupHits++;
+        }
+        resource->calcResourceSize();
+    }
+
+    // before the old entry goes: both may share the body
+    retainBody(resource);
+
+    // a newer response for the same URL may have been written meanwhile
+    HTTPCachedResource *old = m_resources.get(resource->url());
+    if (old)
+        remove(old);
+
+    m_resources.set(resource->url(), resource);
+    appendToLRU(resource);
     m_totalResourceSize += resource->resourceSize();
-    m_totalContentsSize += resource->contentLength();
+
+    journalAdd(resource);
 
     return true;
 }
 
-bool HTTPCache::read(HTTPCachedResource *resource, char *buf)
+void* HTTPCache::openForRead(HTTPCachedResource *resource)
+{
+    void* fd = resource->openFile(m_filePath);
+    if (!fd)
+        return 0;
+
+    m_openFiles.set(fd, resource->fileName());
+    if (m_lruTail != resource) {
+        moveToMostRecentlyUsed(resource);
+        journalTouch(resource);
+    }
+    return fd;
+}
+
+int HTTPCache::readChunk(void* fd, char *buf, int length)
+{
+    int read = (int)wkcFileFReadPeer(buf, sizeof(char), length, fd);
+    if (read < 0)
+        return -1;
+    return read;
+}
+
+void HTTPCache::closeForRead(void* fd)
+{
+    if (!fd)
+        return;
+    m_openFiles.remove(fd);
+    wkcFileFClosePeer(fd);
+}
+
+void HTTPCache::getStatistics(HTTPCacheStatistics& stat)
 {
-    return resource->readFile(buf, m_filePath);
+    stat.m_entries = m_resourceCount;
+    stat.m_bodyFiles = m_bodyFiles;
+    stat.m_totalContentsSize = m_totalContentsSize;
+    stat.m_dedupLookups = m_dedupLookups;
+    stat.m_dedupHits = m_dedupHits;
+
+    stat.m_dedupBytesSaved = 0;
+    HTTPCachedBlobMap::iterator end = m_blobs.end();
+    for (HTTPCachedBlobMap::iterator it = m_blobs.begin(); it != end; ++it)
+        stat.m_dedupBytesSaved += (it->second->m_refCount - 1) * it->second->m_contentLength;
 }
 
 void HTTPCache::serializeFATData(char *buffer)
 {
-    for (int num = 0; num < m_resourceList.size(); num++)
-        buffer += m_resourceList[num]->serialize(buffer);
+    // least recently used first, so that deserializeFATData() restores the order
+    for (HTTPCachedResource *resource = m_lruHead; resource; resource = resource->m_lruNext)
+        buffer += resource->serialize(buffer);
 }
 
 bool HTTPCache::deserializeFATData(char *buffer, int length)
@@ -678,7 +1009,8 @@ bool HTTPCache::deserializeFATData(char *buffer, int length)
 }
 
 #define DEFAULT_CACHEFAT_FILENAME   "cache.fat"
-#define CACHEFAT_FORMAT_VERSION     3  // Number of int. Increment this if you changed the content format in the fat file.
+#define CACHEFAT_FORMAT_VERSION     6  // Number of int. Increment this if you changed the content format in the fat file.
+#define CACHEJOURNAL_FORMAT_VERSION 4  // Increment this if you changed the record format in the journal file.
 
 #define MD5_DIGESTSIZE 16
 
@@ -691,6 +1023,29 @@ void HTTPCache::writeDigest(unsigned char *data, int length)
     memcpy(data, digest.data(), MD5_DIGESTSIZE);
 }
 
+static bool writeWholeFile(const String& fileFullPath, const char *data, int length, bool sync)
+{
+    void *fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_CACHE, fileFullPath.utf8().data(), "wb");
+    if (!fd)
+        return false;
+
+    int len, written = 0;
+    for (len = length; len > 0;  len -= written) {
+        written = wkcFileFWritePeer(data, sizeof(char), len, fd);
+        if (written <= 0)
+            break;
+        data += written;
+    }
+    if (!len && sync && (wkcFileFFlushPeer(fd) || wkcFileFSyncPeer(fd)))
+        len = -1;
+    wkcFileFClosePeer(fd);
+    return !len;
+}
+
+// A checkpoint is written to <FAT file>.new first and then copied over the
+// FAT file, as the file peers have no rename. Until the copy is done, a
+// complete .new file is the current FAT file: readFATFile() finishes the
+// copy, and a torn one is dropped.
 bool HTTPCache::writeFATFile()
 {
     char *buf = 0, *buffer = 0;
@@ -699,44 +1054,48 @@ bool HTTPCache::writeFATFile()
     int totalSize = 0;
     int headerSize = 0;
 
-    headerSize = sizeof(int) * 2 + MD5_DIGESTSIZE;
+    headerSize = sizeof(int) * 3 + MD5_DIGESTSIZE;
     totalSize = headerSize + m_totalResourceSize;
 
     WTF::TryMallocReturnValue rv = tryFastZeroedMalloc(totalSize);
     if (!rv.getValue(buf))
         return false;
 
+    // a journal written against an older generation is ignored on replay
+    m_fatGeneration++;
+
     buffer = buf + MD5_DIGESTSIZE;
     (*(int*)buffer) = CACHEFAT_FORMAT_VERSION; buffer += sizeof(int);
     (*(int*)buffer) = m_fileNumber; buffer += sizeof(int);
+    (*(int*)buffer) = m_fatGeneration; buffer += sizeof(int);
 
     serializeFATData(buffer);
 
     writeDigest((unsigned char*)buf, totalSize);
 
     String fileFullPath = pathByAppendingComponent(m_filePath, m_fatFileName);
+    String checkpointFullPath = pathByAppendingComponent(m_filePath, m_fatFileName + CHECKPOINT_FILENAME_SUFFIX);
 
-    void *fd = 0;
-    int len, written = 0;
-    fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_CACHE, fileFullPath.utf8().data(), "wb");
-    if (!fd)
+    if (!writeWholeFile(checkpointFullPath, buf, totalSize, true)) {
+        // the FAT file and the journal on disk are still good; keep appending to them
+        wkcFileUnlinkPeer(checkpointFullPath.utf8().data());
+        m_fatGeneration--;
         goto error_end;
-
-    buffer = buf;
-    for (len = totalSize; len > 0;  len -= written) {
-        written = wkcFileFWritePeer(buffer, sizeof(char), len, fd);
-        if (written <= 0)
-            break;
-        buffer += written;
     }
-    if (len > 0)
+
+    // everything pending is in the checkpoint now
+    m_journalPending.clear();
+    releaseRecycledFiles();
+
+    if (!writeWholeFile(fileFullPath, buf, totalSize, true)) {
+        // the checkpoint stays the FAT file; write a new one at the next flush
+        m_journalSize = 0;
         goto error_end;
+    }
+    wkcFileUnlinkPeer(checkpointFullPath.utf8().data());
 
-    result = true;
+    result = resetJournal();
 error_end:
-    if (fd)
-        wkcFileFClosePeer(fd);
-
     fastFree(buf);
     return result;
 }
@@ -758,6 +1117,39 @@ bool HTTPCache::verifyDigest(unsigned char *data, int length)
     return result;
 }
 
+void HTTPCache::finishCheckpoint()
+{
+    String checkpointFullPath = pathByAppendingComponent(m_filePath, m_fatFileName + CHECKPOINT_FILENAME_SUFFIX);
+
+    void *fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_CACHE, checkpointFullPath.utf8().data(), "rb");
+    if (!fd)
+        return;
+
+    struct stat st;
+    char *buf = 0;
+    int len = -1;
+    if (!wkcFileFStatPeer(fd, &st) && st.st_size > MD5_DIGESTSIZE) {
+        WTF::TryMallocReturnValue rv = tryFastMalloc(st.st_size);
+        if (rv.getValue(buf))
+            len = (int)wkcFileFReadPeer(buf, sizeof(char), st.st_size, fd);
+    }
+    wkcFileFClosePeer(fd);
+
+    if (buf && len == st.st_size && verifyDigest((unsigned char*)buf, len)) {
+        // crashed while copying the checkpoint over the FAT file
+        W_DP(("finishing the copy of the FAT checkpoint"));
+        if (!writeWholeFile(pathByAppendingComponent(m_filePath, m_fatFileName), buf, len, true)) {
+            fastFree(buf);
+            return;
+        }
+    } else
+        W_DP(("dropping a torn FAT checkpoint"));
+
+    if (buf)
+        fastFree(buf);
+    wkcFileUnlinkPeer(checkpointFullPath.utf8().data());
+}
+
 bool HTTPCache::readFATFile()
 {
     void *fd = 0;
@@ -768,6 +1160,8 @@ bool HTTPCache::readFATFile()
 
     String fileFullPath = pathByAppendingComponent(m_filePath, m_fatFileName);
 
+    finishCheckpoint();
+
     fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_CACHE, fileFullPath.utf8().data(), "rb");
     if (!fd)
         return false;
@@ -778,7 +1172,7 @@ bool HTTPCache::readFATFile()
         wkcFileFClosePeer(fd);
         return false;
     }
-    if (st.st_size <= MD5_DIGESTSIZE + sizeof(int)*2) {
+    if (st.st_size < MD5_DIGESTSIZE + sizeof(int)*3) {
         W_DP(("FAT file read error: size is too small"));
         wkcFileFClosePeer(fd);
         return false;
@@ -816,17 +1210,20 @@ bool HTTPCache::readFATFile()
     }
 
     m_fileNumber = (*(int*)buffer); buffer += sizeof(int);
-    len -= sizeof(int) + sizeof(int) + MD5_DIGESTSIZE;
+    m_fatGeneration = (*(int*)buffer); buffer += sizeof(int);
+    len -= sizeof(int) * 3 + MD5_DIGESTSIZE;
 
-    if (len<=0) {
+    if (len<0) {
         W_DP(("FAT file read error: size is too small"));
         remove = true;
         goto error_end;
     }
 
-    if (deserializeFATData(buffer, len))
+    if (deserializeFATData(buffer, len)) {
+        replayJournal();
+        removeUnreferencedFiles();
         result = true;
-    else
+    } else
         remove = true;
 
 error_end:
@@ -840,6 +1237,242 @@ error_end:
     return result;
 }
 
+// Journal
+//
+// header: [int version][int FAT generation]
+// record: [int type][int length][payload (length bytes)][MD5 of type, length and payload]
+// Replay stops at the first record that is truncated or does not match its digest.
+
+#define JOURNAL_HEADER_SIZE         (sizeof(int) * 2)
+#define JOURNAL_RECORD_HEADER_SIZE  (sizeof(int) * 2)
+#define JOURNAL_COMPACTION_MIN      (64 * 1024)
+
+size_t HTTPCache::beginJournalRecord(int type, int length)
+{
+    size_t offset = m_journalPending.size();
+    m_journalPending.grow(offset + JOURNAL_RECORD_HEADER_SIZE + length + MD5_DIGESTSIZE);
+
+    char *buffer = m_journalPending.data() + offset;
+    memset(buffer, 0, JOURNAL_RECORD_HEADER_SIZE + length + MD5_DIGESTSIZE);
+    (*(int*)buffer) = type; buffer += sizeof(int);
+    (*(int*)buffer) = length; buffer += sizeof(int);
+
+    return offset;
+}
+
+void HTTPCache::endJournalRecord(size_t offset, int length)
+{
+    unsigned char *record = (unsigned char*)m_journalPending.data() + offset;
+
+    MD5 md5;
+    md5.addBytes(record, JOURNAL_RECORD_HEADER_SIZE + length);
+    Vector<uint8_t, 16> digest;
+    md5.checksum(digest);
+    memcpy(record + JOURNAL_RECORD_HEADER_SIZE + length, digest.data(), MD5_DIGESTSIZE);
+}
+
+void HTTPCache::journalAdd(HTTPCachedResource *resource)
+{
+    int length = sizeof(int) + resource->resourceSize();
+    size_t offset = beginJournalRecord(EJournalAdd, length);
+    char *payload = m_journalPending.data() + offset + JOURNAL_RECORD_HEADER_SIZE;
+    (*(int*)payload) = m_fileNumber; payload += sizeof(int);
+    resource->serialize(payload);
+    endJournalRecord(offset, length);
+}
+
+void HTTPCache::journalURL(int type, HTTPCachedResource *resource)
+{
+    int length = sizeof(int) + ROUNDUP(resource->url().utf8().length(), ROUNDUP_UNIT);
+    size_t offset = beginJournalRecord(type, length);
+    writeString(m_journalPending.data() + offset + JOURNAL_RECORD_HEADER_SIZE, resource->url());
+    endJournalRecord(offset, length);
+}
+
+void HTTPCache::journalRemove(HTTPCachedResource *resource)
+{
+    journalURL(EJournalRemove, resource);
+}
+
+void HTTPCache::journalTouch(HTTPCachedResource *resource)
+{
+    journalURL(EJournalTouch, resource);
+}
+
+bool HTTPCache::resetJournal()
+{
+    String fileFullPath = pathByAppendingComponent(m_filePath, m_journalFileName);
+
+    void *fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_CACHE, fileFullPath.utf8().data(), "wb");
+    if (!fd) {
+        m_journalSize = 0;
+        return false;
+    }
+
+    int header[2] = { CACHEJOURNAL_FORMAT_VERSION, m_fatGeneration };
+    int written = (int)wkcFileFWritePeer(header, sizeof(char), JOURNAL_HEADER_SIZE, fd);
+    wkcFileFClosePeer(fd);
+
+    if (written != JOURNAL_HEADER_SIZE) {
+        m_journalSize = 0;
+        return false;
+    }
+    m_journalSize = JOURNAL_HEADER_SIZE;
+    return true;
+}
+
+bool HTTPCache::flushJournal()
+{
+    if (m_journalPending.isEmpty())
+        return true;
+
+    // No journal for the current FAT file yet, or the journal has grown
+    // beyond the size of the index itself: write a new checkpoint instead.
+    int limit = m_totalResourceSize > JOURNAL_COMPACTION_MIN ? m_totalResourceSize : JOURNAL_COMPACTION_MIN;
+    if (!m_journalSize || m_journalSize + (int)m_journalPending.size() > limit)
+        return writeFATFile();
+
+    String fileFullPath = pathByAppendingComponent(m_filePath, m_journalFileName);
+
+    void *fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_CACHE, fileFullPath.utf8().data(), "ab");
+    if (!fd)
+        return writeFATFile();
+
+    const char *buffer = m_journalPending.data();
+    int len, written = 0;
+    for (len = m_journalPending.size(); len > 0; len -= written) {
+        written = (int)wkcFileFWritePeer(buffer, sizeof(char), len, fd);
+        if (written <= 0)
+            break;
+        buffer += written;
+    }
+    // the removals have to be on disk before their files are reused
+    if (!len && !m_recycledFiles.isEmpty()) {
+        if (wkcFileFFlushPeer(fd) || wkcFileFSyncPeer(fd))
+            len = 1;
+    }
+    wkcFileFClosePeer(fd);
+
+    if (len > 0) {
+        // a torn record would hide every record after it
+        return writeFATFile();
+    }
+
+    m_journalSize += m_journalPending.size();
+    m_journalPending.clear();
+    releaseRecycledFiles();
+    return true;
+}
+
+bool HTTPCache::replayJournal()
+{
+    m_journalSize = 0;
+
+    String fileFullPath = pathByAppendingComponent(m_filePath, m_journalFileName);
+
+    void *fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_CACHE, fileFullPath.utf8().data(), "rb");
+    if (!fd)
+        return false;
+
+    struct stat st;
+    if (wkcFileFStatPeer(fd, &st) || st.st_size < JOURNAL_HEADER_SIZE) {
+        wkcFileFClosePeer(fd);
+        return false;
+    }
+
+    char *buf = 0;
+    WTF::TryMallocReturnValue rv = tryFastMalloc(st.st_size);
+    if (!rv.getValue(buf)) {
+        wkcFileFClosePeer(fd);
+        return false;
+    }
+
+    int len = (int)wkcFileFReadPeer(buf, sizeof(char), st.st_size, fd);
+    wkcFileFClosePeer(fd);
+
+    if (len != st.st_size || ((int*)buf)[0] != CACHEJOURNAL_FORMAT_VERSION || ((int*)buf)[1] != m_fatGeneration) {
+        W_DP(("journal is not for the current FAT file"));
+        fastFree(buf);
+        return false;
+    }
+
+    int pos = JOURNAL_HEADER_SIZE;
+    while (pos + (int)JOURNAL_RECORD_HEADER_SIZE + MD5_DIGESTSIZE <= len) {
+        char *record = buf + pos;
+        int type = ((int*)record)[0];
+        int length = ((int*)record)[1];
+        if (length < 0 || pos + (int)JOURNAL_RECORD_HEADER_SIZE + length + MD5_DIGESTSIZE > len)
+            break;
+
+        MD5 md5;
+        md5.addBytes((unsigned char*)record, JOURNAL_RECORD_HEADER_SIZE + length);
+        Vector<uint8_t, 16> digest;
+        md5.checksum(digest);
+        if (memcmp(record + JOURNAL_RECORD_HEADER_SIZE + length, digest.data(), MD5_DIGESTSIZE))
+            break;
+
+        char *payload = record + JOURNAL_RECORD_HEADER_SIZE;
+        if (type == EJournalAdd) {
+            HTTPCachedResource *resource = new HTTPCachedResource();
+            if (!resource)
+                break;
+            int fileNumber = (*(int*)payload);
+            resource->deserialize(payload + sizeof(int));
+            HTTPCachedResource *old = m_resources.get(resource->url());
+            if (old) {
+                removeResource(old);
+                delete old;
+            }
+            addCachedResource(resource);
+            m_fileNumber = fileNumber;
+        } else if (type == EJournalRemove) {
+            String url;
+            readString(payload, url);
+            HTTPCachedResource *old = m_resources.get(url);
+            if (old) {
+                removeResource(old);
+                delete old;
+            }
+        } else if (type == EJournalTouch) {
+            String url;
+            readString(payload, url);
+            HTTPCachedResource *resource = m_resources.get(url);
+            if (resource)
+                moveToMostRecentlyUsed(resource);
+        }
+        pos += JOURNAL_RECORD_HEADER_SIZE + length + MD5_DIGESTSIZE;
+    }
+    fastFree(buf);
+
+    m_journalSize = len;
+    if (pos < len) {
+        // crashed in the middle of a record: keep what was valid and start over
+        W_DP(("journal is torn at %d/%d", pos, len));
+        writeFATFile();
+    }
+    return true;
+}
+
+void HTTPCache::removeUnreferencedFiles()
+{
+    // bodies written or recycled after the last record that made it to the journal
+    HashSet<String> referenced;
+    for (HTTPCachedResource *resource = m_lruHead; resource; resource = resource->m_lruNext)
+        referenced.add(resource->fileName());
+    for (int i = 0; i < EFreeFileBuckets; i++) {
+        for (size_t num = 0; num < m_freeFiles[i].size(); num++)
+            referenced.add(m_freeFiles[i][num].m_fileName);
+    }
+    for (size_t num = 0; num < m_recycledFiles.size(); num++)
+        referenced.add(m_recycledFiles[num].m_fileName);
+
+    Vector<String> items(listDirectory(m_filePath, "*.dcf"));
+    for (size_t i = 0; i < items.size(); i++) {
+        if (!referenced.contains(pathGetFileName(items[i])))
+            wkcFileUnlinkPeer(items[i].utf8().data());
+    }
+}
+
 } // namespace
 
 #endif // ENABLE(WKC_HTTPCACHE)
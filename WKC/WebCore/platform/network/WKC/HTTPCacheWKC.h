@@ -46,6 +46,10 @@ public:
     double freshnessLifetime();
     bool isExpired();
     bool needRevalidate();
+    // RFC 5861: may still be served while it is revalidated in the background
+    bool isUsableWhileRevalidating();
+    // a 304 response arrived for this resource
+    void didRevalidate(const ResourceResponse &response);
     enum {
         EHTTPEquivNone           = 0x00000000,
         EHTTPEquivNoCache        = 0x00000001,
@@ -66,11 +70,14 @@ public:
     inline bool mustRevalidate() const { return m_mustRevalidate; }
     inline double expires() const { return m_expires; }
     inline double maxAge() const { return m_maxAge; }
+    inline double staleWhileRevalidate() const { return m_staleWhileRevalidate; }
     inline const String& lastModifiedHeader() const { return m_lastModifiedHeader; }
     inline const String& eTagHeader() const { return m_eTagHeader; }
+    inline const String& contentDigest() const { return m_contentDigest; }
 
     bool writeFile(const String& filename, const String& filepath);
-    bool readFile(char *buf, const String& filepath);
+    void didWriteFile();
+    void* openFile(const String& filepath);
 
     void calcResourceSize();
     inline int resourceSize() const { return m_resourceSize; }
@@ -79,11 +86,15 @@ public:
     int deserialize(char *buffer);
 
     void setResourceData(RefPtr<SharedBuffer> resourceData) { m_resourceData = resourceData, m_contentLength = resourceData->size(); }
+    SharedBuffer* resourceData() const { return m_resourceData.get(); }
 
-    inline bool isUsed() const { return m_used; }
-    inline void setUsed(bool used) { m_used = used; }
+    // set when a newer response arrived while the body was being written
+    inline bool writeCancelled() const { return m_writeCancelled; }
+    inline void setWriteCancelled() { m_writeCancelled = true; }
 
 private:
+    friend class HTTPCache;
+
     String m_url;
     String m_mimeType;
     long long m_expectedContentLength;
@@ -94,23 +105,50 @@ private:
     bool m_mustRevalidate;
     double m_expires;
     double m_maxAge;
+    double m_staleWhileRevalidate;
     double m_date;
     double m_lastModified;
     String m_lastModifiedHeader;
     String m_eTagHeader;
     String m_fileName;
+    // hex MD5 of the body; entries with the same digest share one file
+    String m_contentDigest;
 
     RefPtr<SharedBuffer> m_resourceData;
     long long m_contentLength;
     int m_resourceSize;
-    bool m_used;
 
     int m_httpequivflags;
+    bool m_writeCancelled;
+
+    // LRU list maintained by HTTPCache
+    HTTPCachedResource* m_lruPrev;
+    HTTPCachedResource* m_lruNext;
 };
 
 typedef HashMap<String, HTTPCachedResource*> HTTPCachedResourceMap;
 typedef HashMap<String, HTTPCachedResource*>::iterator HTTPCachedResourceMapIterator;
 
+// A body file shared by every HTTPCachedResource with the same content digest.
+struct HTTPCachedBlob {
+    String m_fileName;
+    long long m_contentLength;
+    int m_refCount;
+};
+
+typedef HashMap<String, HTTPCachedBlob*> HTTPCachedBlobMap;
+
+struct HTTPCacheStatistics {
+    int m_entries;
+    int m_bodyFiles;
+    long long m_totalContentsSize;
+    // writes that were looked up by digest / found an identical body
+    int m_dedupLookups;
+    int m_dedupHits;
+    // bytes currently not stored thanks to shared bodies
+    long long m_dedupBytesSaved;
+};
+
 class HTTPCache {
 public:
     HTTPCache();
@@ -120,8 +158,8 @@ public:
     HTTPCachedResource* createHTTPCachedResource(KURL &url, RefPtr<SharedBuffer> resourceData, ResourceResponse &response, bool noCache, bool mustRevalidate, double expires, double maxAge);
     bool addCachedResource(HTTPCachedResource *resource);
     void updateCachedResource(HTTPCachedResource *resource, RefPtr<SharedBuffer> resourceData, ResourceResponse &response, bool noCache, bool mustRevalidate, double expires, double maxAge);
-    void removeResource(HTTPCachedResource *resource);
-    void removeResourceByNumber(int listNumber);
+    void revalidated(HTTPCachedResource *resource, const ResourceResponse &response);
+    bool removeResource(HTTPCachedResource *resource);
     void remove(HTTPCachedResource *resource);
     void detach(HTTPCachedResource *resource);
     void removeAll();
@@ -132,30 +170,107 @@ public:
     void setMaxContentSize(long long limit);
     void setMaxTotalCacheSize(long long limit);
     void setFilePath(const char* path);
+    void setDeduplication(bool enable) { m_deduplication = enable; }
+    // serve entries within their stale-while-revalidate window at once
+    void setStaleWhileRevalidate(bool enable) { m_staleWhileRevalidate = enable; }
+    bool staleWhileRevalidate() const { return m_staleWhileRevalidate; }
 
     KURL removeFragmentIdentifierIfNeeded(const KURL& originalURL);
     HTTPCachedResource* resourceForURL(const KURL& resourceURL);
     bool equalHTTPCachedResourceURL(HTTPCachedResource *resource, KURL& resourceURL);
 
     String makeFileName();
-    long long purgeBySizeInternal(long long size);
     long long purgeBySize(long long size);
     long long purgeOldest();
     bool write(HTTPCachedResource *resource);
-    bool read(HTTPCachedResource *resource, char *buf);
+    // write() split for HTTPCacheWriter: prepareWrite() returns the full path to write to
+    String prepareWrite(HTTPCachedResource *resource);
+    // digest is the MD5 of the written body, or 0 to store it unshared
+    bool finishWrite(HTTPCachedResource *resource, bool written, const unsigned char* digest);
+
+    // streaming read of a cached body
+    void* openForRead(HTTPCachedResource *resource);
+    int readChunk(void* fd, char *buf, int length);
+    void closeForRead(void* fd);
 
     void serializeFATData(char *buffer);
     bool deserializeFATData(char *buffer, int length);
     bool writeFATFile();
     bool readFATFile();
+    bool flushJournal();
 
     void writeDigest(unsigned char *data, int length);
     bool verifyDigest(unsigned char *data, int length);
 
+    int resourceCount() const { return m_resourceCount; }
+    void getStatistics(HTTPCacheStatistics& stat);
+
+private:
+    // body reference counting; releaseBody() returns true when no entry uses the file any more
+    void retainBody(HTTPCachedResource *resource);
+    bool releaseBody(HTTPCachedResource *resource);
+
+    // LRU list: m_lruHead is the least recently used resource.
+    void appendToLRU(HTTPCachedResource *resource);
+    void removeFromLRU(HTTPCachedResource *resource);
+    void moveToMostRecentlyUsed(HTTPCachedResource *resource);
+
+    // Files of evicted resources are kept and overwritten by later writes
+    // of a similar size instead of being unlinked and created again. A file
+    // is reused only once the journal record removing its resource is on
+    // disk, and free files count against the total cache size.
+    enum {
+        EFreeFileBuckets = 8,
+        EFreeFilesPerBucket = 4,
+    };
+    struct FreeFile {
+        String m_fileName;
+        long long m_contentLength;
+    };
+    static int freeFileBucket(long long contentLength);
+    String takeFileName(long long contentLength);
+    void recycleFile(const String& fileName, long long contentLength);
+    // the removals of the recycled files are durable now
+    void releaseRecycledFiles();
+    void removeFreeFiles();
+    bool isOpenForRead(const String& fileName);
+
+    // Changes since the last writeFATFile() are appended to a journal
+    // instead of rewriting the whole FAT file.
+    enum {
+        EJournalAdd = 1,
+        EJournalRemove = 2,
+        EJournalTouch = 3,  // moved to the most recently used end
+    };
+    size_t beginJournalRecord(int type, int length);
+    void endJournalRecord(size_t offset, int length);
+    void journalAdd(HTTPCachedResource *resource);
+    void journalRemove(HTTPCachedResource *resource);
+    void journalTouch(HTTPCachedResource *resource);
+    void journalURL(int type, HTTPCachedResource *resource);
+    bool replayJournal();
+    bool resetJournal();
+    // completes a writeFATFile() cut short by a crash
+    void finishCheckpoint();
+    void removeUnreferencedFiles();
+
 private:
     bool m_disabled;
     HTTPCachedResourceMap m_resources;
-    Vector<HTTPCachedResource*> m_resourceList;
+    HTTPCachedResource* m_lruHead;
+    HTTPCachedResource* m_lruTail;
+    int m_resourceCount;
+    Vector<FreeFile> m_freeFiles[EFreeFileBuckets];
+    Vector<FreeFile> m_recycledFiles;
+    long long m_freeFilesSize;
+    HashMap<void*, String> m_openFiles;
+
+    bool m_deduplication;
+    bool m_staleWhileRevalidate;
+    HTTPCachedBlobMap m_blobs;
+    int m_bodyFiles;
+    int m_dedupLookups;
+    int m_dedupHits;
 
     int m_fileNumber;
     int m_totalResourceSize;
@@ -163,6 +278,11 @@ private:
     String m_fatFileName;
     String m_filePath;
 
+    String m_journalFileName;
+    Vector<char> m_journalPending;
+    int m_journalSize;
+    int m_fatGeneration;
+
     int m_limitContentEntries;
     long long m_limitContentSize;
     long long m_limitTotalContentsSize;
@@ -0,0 +1,225 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#if ENABLE(WKC_HTTPCACHE)
+
+#include "HTTPCacheWriterWKC.h"
+
+#include <wtf/MainThread.h>
+#include <wtf/MD5.h>
+#include <wkc/wkcpeer.h>
+
+#if 1
+# define W_DP(a) ((void)0)
+#else
+# define W_DP(a) wkcDebugPrintfPeer a
+#endif
+
+namespace WebCore {
+
+HTTPCacheWriter::HTTPCacheWriter(FinishedProc proc, void* data)
+    : m_finishedProc(proc)
+    , m_finishedData(data)
+    , m_thread(0)
+    , m_mutex(0)
+    , m_cond(0)
+    , m_quit(false)
+    , m_busy(false)
+    , m_finishedPosted(false)
+    , m_queuedBytes(0)
+{
+}
+
+HTTPCacheWriter::~HTTPCacheWriter()
+{
+    if (m_thread) {
+        wkcMutexLockPeer(m_mutex);
+        m_quit = true;
+        wkcCondBroadcastPeer(m_cond);
+        wkcMutexUnlockPeer(m_mutex);
+        wkcThreadJoinPeer(m_thread, 0);
+        m_thread = 0;
+    }
+    for (size_t i = 0; i < m_queue.size(); i++)
+        delete m_queue[i];
+    m_queue.clear();
+    if (m_cond) {
+        wkcCondDeletePeer(m_cond);
+        m_cond = 0;
+    }
+    if (m_mutex) {
+        wkcMutexDeletePeer(m_mutex);
+        m_mutex = 0;
+    }
+}
+
+HTTPCacheWriter* HTTPCacheWriter::create(FinishedProc proc, void* data)
+{
+    HTTPCacheWriter* self = new HTTPCacheWriter(proc, data);
+    if (!self)
+        return 0;
+    if (!self->construct()) {
+        delete self;
+        return 0;
+    }
+    return self;
+}
+
+bool HTTPCacheWriter::construct()
+{
+    m_mutex = wkcMutexNewPeer();
+    m_cond = wkcCondNewPeer();
+    if (!m_mutex || !m_cond)
+        return false;
+
+    m_thread = wkcThreadCreatePeer(threadProc, this);
+    if (!m_thread)
+        return false;
+
+    return true;
+}
+
+void HTTPCacheWriter::forceTerminate()
+{
+    m_thread = 0;
+    m_mutex = 0;
+    m_cond = 0;
+}
+
+bool HTTPCacheWriter::canEnqueue(int length)
+{
+    wkcMutexLockPeer(m_mutex);
+    // a single large entry is always accepted when the queue is empty
+    bool result = m_queue.isEmpty()
+        || (m_queue.size() < EMaxQueuedEntries && m_queuedBytes + length <= EMaxQueuedBytes);
+    wkcMutexUnlockPeer(m_mutex);
+    return result;
+}
+
+bool HTTPCacheWriter::enqueue(HTTPCachedResource* resource, const char* fullPath, const char* data, int length)
+{
+    Job* job = new Job;
+    if (!job)
+        return false;
+    job->m_resource = resource;
+    job->m_fullPath.append(fullPath, strlen(fullPath) + 1);
+    if (length > 0) {
+        WTF::TryMallocReturnValue rv = tryFastMalloc(length);
+        if (!rv.getValue(job->m_data)) {
+            delete job;
+            return false;
+        }
+        memcpy(job->m_data, data, length);
+    }
+    job->m_length = length;
+
+    wkcMutexLockPeer(m_mutex);
+    m_queue.append(job);
+    m_queuedBytes += length;
+    wkcCondBroadcastPeer(m_cond);
+    wkcMutexUnlockPeer(m_mutex);
+    return true;
+}
+
+void HTTPCacheWriter::takeFinished(Vector<Finished>& finished)
+{
+    wkcMutexLockPeer(m_mutex);
+    finished.swap(m_finished);
+    m_finished.clear();
+    m_finishedPosted = false;
+    wkcMutexUnlockPeer(m_mutex);
+}
+
+void HTTPCacheWriter::waitForIdle()
+{
+    wkcMutexLockPeer(m_mutex);
+    while (!m_queue.isEmpty() || m_busy)
+        wkcCondWaitPeer(m_cond, m_mutex);
+    wkcMutexUnlockPeer(m_mutex);
+}
+
+bool HTTPCacheWriter::writeData(const char* fullPath, const char* data, int length, unsigned char* digest)
+{
+    MD5 md5;
+    md5.addBytes((const uint8_t*)data, length);
+    Vector<uint8_t, 16> checksum;
+    md5.checksum(checksum);
+    memcpy(digest, checksum.data(), sizeof(unsigned char) * 16);
+
+    void* fd = wkcFileFOpenPeer(WKC_FILEOPEN_USAGE_CACHE, fullPath, "wb");
+    if (!fd)
+        return false;
+
+    int len, written = 0;
+    for (len = length; len > 0; len -= written) {
+        written = (int)wkcFileFWritePeer(data, sizeof(char), len, fd);
+        if (written <= 0)
+            break;
+        data += written;
+    }
+    wkcFileFClosePeer(fd);
+
+    return len <= 0;
+}
+
+void* HTTPCacheWriter::threadProc(void* data)
+{
+    static_cast<HTTPCacheWriter*>(data)->run();
+    return 0;
+}
+
+void HTTPCacheWriter::run()
+{
+    wkcMutexLockPeer(m_mutex);
+    while (!m_quit) {
+        if (m_queue.isEmpty()) {
+            wkcCondWaitPeer(m_cond, m_mutex);
+            continue;
+        }
+
+        Job* job = m_queue.first();
+        m_queue.remove(0);
+        m_busy = true;
+        wkcMutexUnlockPeer(m_mutex);
+
+        Finished f;
+        f.m_resource = job->m_resource;
+        f.m_written = writeData(job->m_fullPath.data(), job->m_data, job->m_length, f.m_digest);
+        W_DP(("<cw>wrote %s (%d bytes): %d", job->m_fullPath.data(), job->m_length, f.m_written));
+
+        wkcMutexLockPeer(m_mutex);
+        m_busy = false;
+        m_queuedBytes -= job->m_length;
+        m_finished.append(f);
+        delete job;
+        if (!m_finishedPosted) {
+            m_finishedPosted = true;
+            callOnMainThread(m_finishedProc, m_finishedData);
+        }
+        // for waitForIdle()
+        wkcCondBroadcastPeer(m_cond);
+    }
+    wkcMutexUnlockPeer(m_mutex);
+}
+
+} // namespace WebCore
+
+#endif // ENABLE(WKC_HTTPCACHE)
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#ifndef HTTPCacheWriterWKC_h
+#define HTTPCacheWriterWKC_h
+
+#if ENABLE(WKC_HTTPCACHE)
+
+#include <wtf/FastMalloc.h>
+#include <wtf/Vector.h>
+
+namespace WebCore {
+
+class HTTPCachedResource;
+
+// Writes cached bodies to files on a worker thread.
+// The worker only sees its own copy of the bytes and a file path, so the
+// SharedBuffer of the HTTPCachedResource may change or go away meanwhile;
+// all reference counting and index updates happen on the main thread.
+class HTTPCacheWriter {
+public:
+    struct Finished {
+        HTTPCachedResource* m_resource;
+        bool m_written;
+        // MD5 of the body, for HTTPCache::finishWrite()
+        unsigned char m_digest[16];
+    };
+
+    typedef void (*FinishedProc)(void*);
+
+    static HTTPCacheWriter* create(FinishedProc proc, void* data);
+    ~HTTPCacheWriter();
+
+    // back-pressure: the main thread keeps resources on its own list
+    // while the writer is full.
+    enum {
+        EMaxQueuedEntries = 8,
+        EMaxQueuedBytes = 1024 * 1024,
+    };
+    bool canEnqueue(int length);
+
+    // main thread
+    // data is copied; false when the copy cannot be allocated
+    bool enqueue(HTTPCachedResource* resource, const char* fullPath, const char* data, int length);
+    void takeFinished(Vector<Finished>& finished);
+    void waitForIdle();
+
+    // for force terminate
+    void forceTerminate();
+
+private:
+    HTTPCacheWriter(FinishedProc proc, void* data);
+    bool construct();
+
+    static void* threadProc(void* data);
+    void run();
+    static bool writeData(const char* fullPath, const char* data, int length, unsigned char* digest);
+
+    struct Job {
+        Job() : m_resource(0), m_data(0), m_length(0) { }
+        ~Job() { fastFree(m_data); }
+        HTTPCachedResource* m_resource;
+        Vector<char> m_fullPath;
+        char* m_data;
+        int m_length;
+    };
+
+    FinishedProc m_finishedProc;
+    void* m_finishedData;
+
+    void* m_thread;
+    void* m_mutex;
+    void* m_cond;
+    bool m_quit;
+    bool m_busy;
+    bool m_finishedPosted;
+
+    // protected by m_mutex
+    Vector<Job*> m_queue;
+    int m_queuedBytes;
+    Vector<Finished> m_finished;
+};
+
+} // namespace WebCore
+
+#endif // ENABLE(WKC_HTTPCACHE)
+
+#endif // HTTPCacheWriterWKC_h
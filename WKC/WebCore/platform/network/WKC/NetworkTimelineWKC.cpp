@@ -0,0 +1,213 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "NetworkTimelineWKC.h"
+
+#include "CString.h"
+
+#include <wtf/DateMath.h>
+#include <wtf/text/StringBuilder.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace WebCore {
+
+// Loads beyond this are dropped, oldest first.
+static const size_t cMaxEntries = 256;
+
+NetworkTimelineEntry::NetworkTimelineEntry()
+    : m_status(0)
+    , m_fromCache(false)
+    , m_reusedConnection(false)
+    , m_bodySize(0)
+    , m_startedDateTime(0)
+    , m_blocked(-1)
+    , m_dns(-1)
+    , m_connect(-1)
+    , m_ssl(-1)
+    , m_send(-1)
+    , m_wait(-1)
+    , m_receive(-1)
+    , m_cacheRead(-1)
+    , m_cacheWrite(-1)
+{
+}
+
+NetworkTimeline::NetworkTimeline()
+    : m_enabled(false)
+    , m_lastId(0)
+{
+}
+
+NetworkTimeline::~NetworkTimeline()
+{
+}
+
+void NetworkTimeline::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (!enabled)
+        clear();
+}
+
+unsigned NetworkTimeline::add(const NetworkTimelineEntry& entry)
+{
+    if (!m_enabled)
+        return 0;
+
+    if (m_entries.size() >= cMaxEntries)
+        m_entries.removeFirst();
+    m_entries.append(entry);
+
+    // 0 is never an id
+    if (!++m_lastId)
+        ++m_lastId;
+    return m_lastId;
+}
+
+NetworkTimelineEntry* NetworkTimeline::entry(unsigned id)
+{
+    if (!id || m_entries.isEmpty())
+        return 0;
+
+    // the entries asked for are among the latest ones
+    unsigned back = m_lastId - id;
+    if (back >= m_entries.size())
+        return 0;
+
+    Deque<NetworkTimelineEntry>::iterator it = m_entries.end();
+    for (unsigned i = 0; i <= back; i++)
+        --it;
+    return &*it;
+}
+
+void NetworkTimeline::clear()
+{
+    m_entries.clear();
+}
+
+static void appendJSONString(StringBuilder& builder, const String& string)
+{
+    builder.append('"');
+    for (unsigned i = 0; i < string.length(); i++) {
+        UChar c = string[i];
+        if (c == '"' || c == '\\') {
+            builder.append('\\');
+            builder.append(c);
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            builder.append(escaped);
+        } else
+            builder.append(c);
+    }
+    builder.append('"');
+}
+
+static void appendJSONNumber(StringBuilder& builder, const char* name, double value)
+{
+    char buf[64];
+    if (value < 0)
+        snprintf(buf, sizeof(buf), "\"%s\":-1", name);
+    else
+        snprintf(buf, sizeof(buf), "\"%s\":%.3f", name, value);
+    builder.append(buf);
+}
+
+// ISO 8601 in UTC, as HAR wants for startedDateTime
+static void appendDateTime(StringBuilder& builder, double seconds)
+{
+    double ms = seconds * msPerSecond;
+    int year = msToYear(ms);
+    int day = dayInYear(ms, year);
+    bool leap = isLeapYear(year);
+    int msInDay = static_cast<int>(ms - msToDays(ms) * msPerDay);
+
+    char buf[40];
+    snprintf(buf, sizeof(buf), "\"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\"",
+        year, monthFromDayInYear(day, leap) + 1, dayInMonthFromDayInYear(day, leap),
+        msToHours(ms), msToMinutes(ms), (msInDay / 1000) % 60, msInDay % 1000);
+    builder.append(buf);
+}
+
+int NetworkTimeline::serialize(char* buff, int bufflen)
+{
+    StringBuilder builder;
+    builder.append("{\"log\":{\"version\":\"1.2\",\"creator\":{\"name\":\"WKC\",\"version\":\"1.0\"},\"entries\":[");
+
+    bool first = true;
+    for (Deque<NetworkTimelineEntry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (!first)
+            builder.append(',');
+        first = false;
+
+        char buf[128];
+        double total = 0;
+        const double phases[] = { it->m_blocked, it->m_dns, it->m_connect, it->m_send, it->m_wait, it->m_receive, it->m_cacheRead };
+        for (size_t i = 0; i < WTF_ARRAY_LENGTH(phases); i++) {
+            if (phases[i] > 0)
+                total += phases[i];
+        }
+
+        builder.append("{\"startedDateTime\":");
+        appendDateTime(builder, it->m_startedDateTime);
+        builder.append(',');
+        appendJSONNumber(builder, "time", total);
+        builder.append(",\"request\":{\"method\":");
+        appendJSONString(builder, it->m_method);
+        builder.append(",\"url\":");
+        appendJSONString(builder, it->m_url);
+        snprintf(buf, sizeof(buf), "},\"response\":{\"status\":%d,\"bodySize\":%lld},\"_fromCache\":%s,\"_reusedConnection\":%s,\"timings\":{",
+            it->m_status, it->m_bodySize, it->m_fromCache ? "true" : "false", it->m_reusedConnection ? "true" : "false");
+        builder.append(buf);
+        appendJSONNumber(builder, "blocked", it->m_blocked);
+        builder.append(',');
+        appendJSONNumber(builder, "dns", it->m_dns);
+        builder.append(',');
+        appendJSONNumber(builder, "connect", it->m_connect);
+        builder.append(',');
+        appendJSONNumber(builder, "ssl", it->m_ssl);
+        builder.append(',');
+        appendJSONNumber(builder, "send", it->m_send);
+        builder.append(',');
+        appendJSONNumber(builder, "wait", it->m_wait);
+        builder.append(',');
+        appendJSONNumber(builder, "receive", it->m_receive);
+        builder.append(',');
+        appendJSONNumber(builder, "_cacheRead", it->m_cacheRead);
+        builder.append(',');
+        appendJSONNumber(builder, "_cacheWrite", it->m_cacheWrite);
+        builder.append("}}");
+    }
+    builder.append("]}}");
+
+    CString json = builder.toString().utf8();
+    int len = json.length();
+    if (!buff)
+        return len + 1;
+    if (bufflen < len + 1)
+        return -1;
+    memcpy(buff, json.data(), len + 1);
+    return len;
+}
+
+} // namespace WebCore
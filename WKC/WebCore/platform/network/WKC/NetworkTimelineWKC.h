@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2015 ACCESS CO., LTD. All rights reserved.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ */
+
+#ifndef NetworkTimelineWKC_h
+#define NetworkTimelineWKC_h
+
+#include "PlatformString.h"
+
+#include <wtf/Deque.h>
+
+namespace WebCore {
+
+// One finished load. The phases are in milliseconds, -1 when the load
+// did not go through them, as the "timings" of a HAR entry.
+struct NetworkTimelineEntry {
+    NetworkTimelineEntry();
+
+    String m_url;
+    String m_method;
+    int m_status;
+    bool m_fromCache;
+    bool m_reusedConnection;
+    long long m_bodySize;
+    // wall clock time the load was queued, in seconds
+    double m_startedDateTime;
+
+    double m_blocked;   // waiting in the job queue
+    double m_dns;
+    double m_connect;   // TCP and TLS handshake, as in HAR
+    double m_ssl;       // TLS handshake alone
+    double m_send;
+    double m_wait;      // request sent to the first response byte
+    double m_receive;
+    double m_cacheRead;
+    double m_cacheWrite; // main thread time to hand the body to the cache
+};
+
+// The latest loads, for finding out where the time of a page load goes.
+// Nothing is recorded until it is enabled.
+class NetworkTimeline {
+public:
+    NetworkTimeline();
+    ~NetworkTimeline();
+
+    void setEnabled(bool enabled);
+    bool enabled() const { return m_enabled; }
+
+    // returns an id for entry(), 0 when not recorded
+    unsigned add(const NetworkTimelineEntry& entry);
+    // 0 when the entry has been dropped
+    NetworkTimelineEntry* entry(unsigned id);
+    void clear();
+
+    // HAR-like JSON of the recorded loads, oldest first. Returns the
+    // length written, the length needed when buff is 0, or -1 when buff
+    // is too short.
+    int serialize(char* buff, int bufflen);
+
+private:
+    bool m_enabled;
+    unsigned m_lastId;
+    // id of the oldest entry is m_lastId - m_entries.size() + 1
+    Deque<NetworkTimelineEntry> m_entries;
+};
+
+} // namespace WebCore
+
+#endif // NetworkTimelineWKC_h
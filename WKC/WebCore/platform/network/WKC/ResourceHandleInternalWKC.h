@@ -63,7 +63,10 @@ public:
         , m_dataLoading(false)
         , m_matchProxyFilter(false)
         , m_composition(WKC::EInclusionContentComposition)
+        , m_priority(0)
+        , m_preconnect(false)
         , m_customHeaders(0)
+        , m_resolveList(0)
         , m_formDataStream(loader)
         , m_isSSL(false)
         , m_SSLHandshaked(false)
@@ -86,10 +89,20 @@ public:
         , m_enableOCSP(true)
         , m_enableCRLDP(true)
         , m_recvDataLength(0)
+        , m_receivedDataBatchSince(0)
+        , m_receivedDataDelivered(false)
+        , m_timelineQueued(0)
+        , m_timelineQueuedDate(0)
+        , m_timelineStarted(0)
+        , m_timelineCacheRead(0)
+        , m_timelineEntry(0)
 #if ENABLE(WKC_HTTPCACHE)
         , m_httpequivFlags(0)
         , m_httpequivMaxAge(0)
         , m_utilizedHTTPCache(false)
+        , m_cacheRevalidation(false)
+        , m_cacheReadFile(0)
+        , m_cacheReadRemaining(0)
 #endif
         , m_scheduledFailureType(ResourceHandle::NoFailure)
         , m_failureTimer(loader, &ResourceHandle::fireFailure)
@@ -159,8 +172,16 @@ public:
     bool m_fileLoading;
     bool m_dataLoading;
     bool m_matchProxyFilter;
+    // origin (or proxy) the connection goes to; empty for non-HTTP jobs
+    String m_connectionKey;
     int m_composition;
+    // ResourceHandleManager::JobPriority
+    int m_priority;
+    // speculative connection to an origin; its response is thrown away
+    bool m_preconnect;
     struct curl_slist* m_customHeaders;
+    // CURLOPT_RESOLVE entries given by the DNS resolver
+    struct curl_slist* m_resolveList;
     ResourceResponse m_response;
 
     FormDataStream m_formDataStream;
@@ -206,10 +227,29 @@ public:
     unsigned char m_recvData[DATA_KEEP_LENGTH];
     int m_recvDataLength;
 
+    // received data not handed to the client yet
+    Vector<char> m_receivedDataBatch;
+    double m_receivedDataBatchSince;
+    bool m_receivedDataDelivered;
+
+    // monotonicallyIncreasingTime() when queued / handed to libcurl /
+    // read from the cache; m_timelineQueuedDate is the wall clock time
+    double m_timelineQueued;
+    double m_timelineQueuedDate;
+    double m_timelineStarted;
+    double m_timelineCacheRead;
+    // NetworkTimeline entry id, 0 when not recorded
+    unsigned m_timelineEntry;
+
 #if ENABLE(WKC_HTTPCACHE)
     int m_httpequivFlags;
     int m_httpequivMaxAge;
     bool m_utilizedHTTPCache;
+    // background revalidation of a stale cached resource
+    bool m_cacheRevalidation;
+    // streaming read from the HTTP cache
+    void* m_cacheReadFile;
+    long long m_cacheReadRemaining;
 #endif
 
     RefPtr<SharedBuffer> m_receivedData;
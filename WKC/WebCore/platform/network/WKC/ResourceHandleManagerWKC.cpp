@@ -42,6 +42,7 @@
 #include "Cookie.h"
 #include "CookieJar.h"
 #include "CString.h"
+#include "CurrentTime.h"
 #include "DataURL.h"
 #include "HTTPParsers.h"
 #include "MIMETypeRegistry.h"
@@ -64,6 +65,7 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <wtf/StringExtras.h>
 #include <wtf/Threading.h>
 #include <wtf/Vector.h>
 
@@ -96,6 +98,18 @@ const double pollTimeSeconds = 0.001;
 #define WEBSOCKET_RESERVED_CONNECTIONS     1L /* WebInspector */
 #define DEFAULT_TCP_MAX_CONNECTIONS   (HTTP_DEFAULT_MAX_CONNECTIONS + HTTP_RESERVED_CONNECTIONS + WEBSOCKET_DEFAULT_MAX_CONNECTIONS + WEBSOCKET_RESERVED_CONNECTIONS)
 
+// Scheduled jobs looked at for one whose origin has an idle connection
+static const int cWarmConnectionLookahead = 8;
+// Idle connections older than this are assumed to have been closed by the server
+static const double cIdleConnectionLifetime = 15.0;
+// A preconnected connection no job has taken by then is given up
+static const double cPreconnectDeadline = 10.0;
+// Preconnects in flight at once
+static const int cMaxPreconnects = 4;
+// Received data waits no longer than this for a batch to fill up
+static const double cReceiveDataBatchDelay = 0.05;
+static const int cDefaultReceiveDataBatchSize = 32 * 1024;
+
 // for debug
 #undef DEBUG_LOADING
 #undef DEBUG_LOADING_MORE
@@ -305,6 +319,12 @@ static long ProtectionSpaceAuthSchemeTocURLType(ProtectionSpaceAuthenticationSch
 //
 ResourceHandleManager::ResourceHandleManager()
     : m_downloadTimer(this, &ResourceHandleManager::downloadTimerCallback)
+    , m_receiveDataTimer(this, &ResourceHandleManager::receiveDataTimerCallback)
+    , m_receiveDataBatchSize(cDefaultReceiveDataBatchSize)
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    , m_socketActionTimer(this, &ResourceHandleManager::socketActionTimerCallback)
+    , m_socketWatcher(0)
+#endif
     , m_rhmssl(0)
     , m_proxyPort(0)
     , m_proxyType(HTTP)
@@ -312,6 +332,8 @@ ResourceHandleManager::ResourceHandleManager()
     , m_cookieMaxEntries(20) /* default */
     , m_cookieJarFileName(0)
     , m_tryProxySingleConnect(false)
+    , m_httpPipelining(false)
+    , m_dnsResolver(0)
     , m_httpConnections(HTTP_DEFAULT_MAX_CONNECTIONS)
     , m_maxWebSocketConnections(WEBSOCKET_DEFAULT_MAX_CONNECTIONS)
     , m_harmfulSiteFilter(false)
@@ -324,13 +346,17 @@ ResourceHandleManager::ResourceHandleManager()
 #if ENABLE(WKC_HTTPCACHE)
     , m_readCacheTimer(this, &ResourceHandleManager::readCacheTimerCallback)
     , m_writeCacheTimer(this, &ResourceHandleManager::writeCacheTimerCallback)
+    , m_cacheWriter(0)
 #endif
 {
     FUNCTIONPRINTF(("<rhm>ResourceHandleManager()"));
 
+    memset(&m_dataDeliveryStat, 0, sizeof(m_dataDeliveryStat));
+
     curl_global_init(CURL_GLOBAL_ALL);
     m_curlMultiHandle = curl_multi_init();
     curl_multi_setopt(m_curlMultiHandle, CURLMOPT_MAXCONNECTS, m_httpConnections);
+    m_connectionPool.setMaxIdleConnections(m_httpConnections);
 
     sharedResourceMutexInitialize();
 
@@ -363,9 +389,18 @@ ResourceHandleManager::~ResourceHandleManager()
     delete m_rhmssl;
     m_rhmssl = 0;
 
+    delete m_dnsResolver;
+    m_dnsResolver = 0;
+
     curl_multi_cleanup(m_curlMultiHandle);
     curl_share_cleanup(m_curlShareHandle);
     curl_multi_cleanup(m_curlMultiSyncHandle);
+    m_receiveDataTimer.stop();
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    m_socketActionTimer.stop();
+    delete m_socketWatcher;
+    m_socketWatcher = 0;
+#endif
     sharedResourceMutexFinalize();
     curl_global_cleanup();
 }
@@ -394,6 +429,23 @@ bool ResourceHandleManager::construct()
     if (!m_rhmssl)
         return false;
 
+#if ENABLE(WKC_HTTPCACHE)
+    // without the writer thread, cached bodies are written on the main thread
+    m_cacheWriter = HTTPCacheWriter::create(cacheWriterFinishedCallback, 0);
+#endif
+
+    // without the resolver thread, libcurl resolves every host by itself
+    m_dnsResolver = DNSResolver::create();
+    if (m_dnsResolver)
+        m_dnsResolver->setTimeToLive(m_DNSCacheTimeout);
+
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    m_socketWatcher = CurlSocketWatcher::create(socketsReadyCallback, 0);
+    if (!m_socketWatcher)
+        return false;
+    setupMultiSocket(m_curlMultiHandle);
+#endif
+
     return true;
 }
 
@@ -447,8 +499,20 @@ void ResourceHandleManager::forceTerminate()
 #if ENABLE(WKC_HTTPCACHE)
     // should not call the function because they call delete / deref and memory related codes...
 //    resetHTTPCache();
+    if (m_cacheWriter)
+        m_cacheWriter->forceTerminate();
+    m_cacheWriter = 0;
 #endif
 
+    if (m_dnsResolver)
+        m_dnsResolver->forceTerminate();
+    m_dnsResolver = 0;
+
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    if (m_socketWatcher)
+        m_socketWatcher->forceTerminate();
+    m_socketWatcher = 0;
+#endif
     m_curlMultiHandle = 0;
     m_curlShareHandle = 0;
     m_curlMultiSyncHandle = 0;
@@ -481,6 +545,7 @@ void ResourceHandleManager::setMaxHTTPConnections(long number)
         return;
 
     curl_multi_setopt(m_curlMultiHandle, CURLMOPT_MAXCONNECTS, m_httpConnections);
+    m_connectionPool.setMaxIdleConnections(m_httpConnections);
 }
 
 void ResourceHandleManager::setMaxWebSocketConnections(long number)
@@ -520,6 +585,8 @@ void ResourceHandleManager::setRedirectInWKC(bool enable)
 void ResourceHandleManager::setDNSCacheTimeout(int sec)
 {
     m_DNSCacheTimeout = sec;
+    if (m_dnsResolver)
+        m_dnsResolver->setTimeToLive(sec);
 }
 
 void ResourceHandleManager::setServerResponseTimeout(int sec)
@@ -537,6 +604,107 @@ void ResourceHandleManager::setAcceptEncoding(const char* encodings)
     m_acceptEncoding = String::fromUTF8(encodings);
 }
 
+void ResourceHandleManager::setHTTPPipelining(bool enable)
+{
+    // libcurl only pipelines GET and HEAD requests
+    m_httpPipelining = enable;
+    curl_multi_setopt(m_curlMultiHandle, CURLMOPT_PIPELINING, enable ? 1L : 0L);
+}
+
+void ResourceHandleManager::setReceiveDataBatchSize(int bytes)
+{
+    m_receiveDataBatchSize = (bytes < 0) ? 0 : bytes;
+}
+
+//
+// Received data batching
+//
+// libcurl writes a response in chunks of a few KB, and every didReceiveData
+// goes through the resource loader and, for a document, the parser. Data
+// is held back until m_receiveDataBatchSize bytes or cReceiveDataBatchDelay
+// seconds have gathered, and always handed over before the load finishes.
+static bool isStreamingResponse(const ResourceResponse& response)
+{
+    const String& mimeType = response.mimeType();
+    return equalIgnoringCase(mimeType, "multipart/x-mixed-replace")
+        || equalIgnoringCase(mimeType, "text/event-stream");
+}
+
+void ResourceHandleManager::didReceiveData(ResourceHandle* job, const char* data, int length)
+{
+    ResourceHandleInternal* d = job->getInternal();
+    m_dataDeliveryStat.m_chunks++;
+
+    // the first data of a response goes out at once so that parsing can start
+    bool batch = m_receiveDataBatchSize > 0 && d->m_receivedDataDelivered
+        && !d->m_isSynchronous && !isStreamingResponse(d->m_response);
+
+    if (!batch && d->m_receivedDataBatch.isEmpty()) {
+        m_dataDeliveryStat.m_dispatches++;
+        d->m_receivedDataDelivered = true;
+        d->client()->didReceiveData(job, data, length, 0);
+        return;
+    }
+
+    if (d->m_receivedDataBatch.isEmpty())
+        d->m_receivedDataBatchSince = currentTime();
+    d->m_receivedDataBatch.append(data, length);
+
+    if (!batch || (int)d->m_receivedDataBatch.size() >= m_receiveDataBatchSize
+        || currentTime() - d->m_receivedDataBatchSince >= cReceiveDataBatchDelay) {
+        flushReceivedData(job);
+        return;
+    }
+    if (!m_receiveDataTimer.isActive())
+        m_receiveDataTimer.startOneShot(cReceiveDataBatchDelay);
+}
+
+void ResourceHandleManager::flushReceivedData(ResourceHandle* job)
+{
+    ResourceHandleInternal* d = job->getInternal();
+    if (!d || d->m_receivedDataBatch.isEmpty() || d->m_cancelled || !d->client())
+        return;
+
+    // the client may add to the batch again from within didReceiveData
+    Vector<char> data;
+    data.swap(d->m_receivedDataBatch);
+    m_dataDeliveryStat.m_dispatches++;
+    d->m_receivedDataDelivered = true;
+    d->client()->didReceiveData(job, data.data(), data.size(), 0);
+
+    // keep the buffer for the next batch
+    if (d->m_receivedDataBatch.isEmpty()) {
+        data.shrink(0);
+        d->m_receivedDataBatch.swap(data);
+    }
+}
+
+void ResourceHandleManager::receiveDataTimerCallback(Timer<ResourceHandleManager>*)
+{
+    double now = currentTime();
+    double next = 0;
+    Vector<RefPtr<ResourceHandle> > jobs;
+
+    for (size_t i = 0; i < m_runningJobList.size(); i++) {
+        ResourceHandleInternal* d = m_runningJobList[i]->getInternal();
+        // a deferred job gets its data when it is resumed
+        if (!d || d->m_receivedDataBatch.isEmpty() || d->m_defersLoading)
+            continue;
+        double wait = cReceiveDataBatchDelay - (now - d->m_receivedDataBatchSince);
+        if (wait <= 0)
+            jobs.append(m_runningJobList[i]);
+        else if (!next || wait < next)
+            next = wait;
+    }
+
+    // didReceiveData may change m_runningJobList
+    for (size_t i = 0; i < jobs.size(); i++)
+        flushReceivedData(jobs[i].get());
+
+    if (next && !m_receiveDataTimer.isActive())
+        m_receiveDataTimer.startOneShot(next);
+}
+
 //
 // handling HTTP
 //
@@ -569,6 +737,45 @@ static String guessMIMETypeByContent(unsigned char* data, int len)
     return wkcGuessMIMETypeByContentPeer((const unsigned char*)data, len);
 }
 
+#if ENABLE(WEB_TIMING)
+// Fills the response's ResourceLoadTiming from libcurl's times, which are
+// counted from when the transfer started.
+static void setResourceLoadTiming(ResourceHandle* job, ResourceHandleInternal* d)
+{
+    if (!job->firstRequest().reportLoadTiming() || !d->m_handle || !d->m_timelineStarted)
+        return;
+
+    double namelookup = 0;
+    double connect = 0;
+    double appconnect = 0;
+    double pretransfer = 0;
+    long connects = 0;
+    curl_easy_getinfo(d->m_handle, CURLINFO_NAMELOOKUP_TIME, &namelookup);
+    curl_easy_getinfo(d->m_handle, CURLINFO_CONNECT_TIME, &connect);
+    curl_easy_getinfo(d->m_handle, CURLINFO_APPCONNECT_TIME, &appconnect);
+    curl_easy_getinfo(d->m_handle, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+    curl_easy_getinfo(d->m_handle, CURLINFO_NUM_CONNECTS, &connects);
+
+    RefPtr<ResourceLoadTiming> timing = ResourceLoadTiming::create();
+    timing->requestTime = d->m_timelineStarted;
+    // a reused connection has no DNS, connect nor TLS phase
+    if (connects) {
+        timing->dnsStart = 0;
+        timing->dnsEnd = static_cast<int>(namelookup * 1000);
+        timing->connectStart = timing->dnsEnd;
+        timing->connectEnd = static_cast<int>((appconnect > 0 ? appconnect : connect) * 1000);
+        if (appconnect > 0) {
+            timing->sslStart = static_cast<int>(connect * 1000);
+            timing->sslEnd = timing->connectEnd;
+        }
+    }
+    timing->sendStart = static_cast<int>(pretransfer * 1000);
+    timing->sendEnd = timing->sendStart;
+    timing->receiveHeadersEnd = static_cast<int>((monotonicallyIncreasingTime() - d->m_timelineStarted) * 1000);
+    d->m_response.setResourceLoadTiming(timing.release());
+}
+#endif
+
 static void handleLocalReceiveResponse(CURL* handle, ResourceHandle* job, ResourceHandleInternal* d)
 {
     FUNCTIONPRINTF(("<rhm>handleLocalReceiveResponse()"));
@@ -594,6 +801,9 @@ static void handleLocalReceiveResponse(CURL* handle, ResourceHandle* job, Resour
         }
     }
 
+#if ENABLE(WEB_TIMING)
+    setResourceLoadTiming(job, d);
+#endif
     if (d->client())
         d->client()->didReceiveResponse(job, d->m_response);
     if (d->m_cancelled)
@@ -703,7 +913,7 @@ static size_t writeCallback(void* ptr, size_t size, size_t nmemb, void* data)
                 return 0;
             }
             if (d->client())
-                d->client()->didReceiveData(job, (const char *)d->m_recvData, d->m_recvDataLength, 0);
+                ResourceHandleManager::sharedInstance()->didReceiveData(job, (const char *)d->m_recvData, d->m_recvDataLength);
             if (d->m_cancelled)
                 return 0;
             d->m_recvDataLength = 0;
@@ -718,7 +928,7 @@ static size_t writeCallback(void* ptr, size_t size, size_t nmemb, void* data)
     }
 
     if (dataSize && d->client())
-        d->client()->didReceiveData(job, ptrData, dataSize, 0);
+        ResourceHandleManager::sharedInstance()->didReceiveData(job, ptrData, dataSize);
     if (d->m_cancelled)
         return 0;
 
@@ -894,6 +1104,127 @@ static bool isAppendableHeader(const String &key)
     return false;
 }
 
+// Header lines are tokenized in libcurl's buffer. Names of the common
+// headers come from this table, so only unknown names and the values
+// make Strings.
+enum {
+    EHeaderSet = 0,
+    EHeaderAppendable = 1,
+    EHeaderAuthenticate = 2
+};
+
+struct KnownHeader {
+    const char* m_name;
+    unsigned m_length;
+    int m_flags;
+};
+
+#define KNOWN_HEADER(name, flags) { name, sizeof(name) - 1, flags }
+static const KnownHeader cKnownHeaders[] = {
+    KNOWN_HEADER("Accept-Ranges", EHeaderSet),
+    KNOWN_HEADER("Access-Control-Allow-Credentials", EHeaderSet),
+    KNOWN_HEADER("Access-Control-Allow-Headers", EHeaderAppendable),
+    KNOWN_HEADER("Access-Control-Allow-Methods", EHeaderAppendable),
+    KNOWN_HEADER("Access-Control-Allow-Origin", EHeaderAppendable),
+    KNOWN_HEADER("Access-Control-Expose-Headers", EHeaderAppendable),
+    KNOWN_HEADER("Age", EHeaderSet),
+    KNOWN_HEADER("Allow", EHeaderAppendable),
+    KNOWN_HEADER("Cache-Control", EHeaderAppendable),
+    KNOWN_HEADER("Connection", EHeaderAppendable),
+    KNOWN_HEADER("Content-Disposition", EHeaderSet),
+    KNOWN_HEADER("Content-Encoding", EHeaderAppendable),
+    KNOWN_HEADER("Content-Language", EHeaderAppendable),
+    KNOWN_HEADER("Content-Length", EHeaderSet),
+    KNOWN_HEADER("Content-Location", EHeaderSet),
+    KNOWN_HEADER("Content-Range", EHeaderSet),
+    KNOWN_HEADER("Content-Security-Policy", EHeaderSet),
+    KNOWN_HEADER("Content-Type", EHeaderSet),
+    KNOWN_HEADER("Date", EHeaderSet),
+    KNOWN_HEADER("ETag", EHeaderSet),
+    KNOWN_HEADER("Expires", EHeaderSet),
+    KNOWN_HEADER("If-Match", EHeaderAppendable),
+    KNOWN_HEADER("If-None-Match", EHeaderAppendable),
+    KNOWN_HEADER("Keep-Alive", EHeaderAppendable),
+    KNOWN_HEADER("Last-Modified", EHeaderSet),
+    KNOWN_HEADER("Link", EHeaderSet),
+    KNOWN_HEADER("Location", EHeaderSet),
+    KNOWN_HEADER("P3P", EHeaderSet),
+    KNOWN_HEADER("Pragma", EHeaderAppendable),
+    KNOWN_HEADER("Proxy-Authenticate", EHeaderAppendable | EHeaderAuthenticate),
+    KNOWN_HEADER("Public", EHeaderAppendable),
+    KNOWN_HEADER("Refresh", EHeaderSet),
+    KNOWN_HEADER("Server", EHeaderAppendable),
+    KNOWN_HEADER("Set-Cookie", EHeaderSet),
+    KNOWN_HEADER("Strict-Transport-Security", EHeaderSet),
+    KNOWN_HEADER("TE", EHeaderAppendable),
+    KNOWN_HEADER("Timing-Allow-Origin", EHeaderSet),
+    KNOWN_HEADER("Trailer", EHeaderAppendable),
+    KNOWN_HEADER("Transfer-Encoding", EHeaderAppendable),
+    KNOWN_HEADER("Upgrade", EHeaderAppendable),
+    KNOWN_HEADER("User-Agent", EHeaderAppendable),
+    KNOWN_HEADER("Vary", EHeaderAppendable),
+    KNOWN_HEADER("Via", EHeaderAppendable),
+    KNOWN_HEADER("Warning", EHeaderAppendable),
+    KNOWN_HEADER("WWW-Authenticate", EHeaderAppendable | EHeaderAuthenticate),
+    KNOWN_HEADER("X-Content-Type-Options", EHeaderAppendable),
+    KNOWN_HEADER("X-Frame-Options", EHeaderAppendable),
+    KNOWN_HEADER("X-XSS-Protection", EHeaderAppendable),
+    { 0, 0, 0 }
+};
+#undef KNOWN_HEADER
+
+static const KnownHeader* findKnownHeader(const char* name, size_t length)
+{
+    for (const KnownHeader* header = cKnownHeaders; header->m_name; ++header) {
+        if (header->m_length == length && !strncasecmp(header->m_name, name, length))
+            return header;
+    }
+    return 0;
+}
+
+// AtomicStrings of the names in cKnownHeaders, made once on the main thread
+static const AtomicString& knownHeaderName(const KnownHeader* header)
+{
+    static AtomicString* names = 0;
+    if (!names) {
+        const size_t count = WTF_ARRAY_LENGTH(cKnownHeaders) - 1;
+        names = new AtomicString[count];
+        for (size_t i = 0; i < count; i++)
+            names[i] = AtomicString(cKnownHeaders[i].m_name);
+    }
+    return names[header - cKnownHeaders];
+}
+
+static inline bool isHeaderSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Non-ASCII bytes are kept as %xx, as the rest of the loader expects.
+static String headerString(const char* ptr, size_t length)
+{
+    size_t i;
+    for (i = 0; i < length; i++) {
+        if (!isASCII(static_cast<unsigned char>(ptr[i])))
+            break;
+    }
+    if (i == length)
+        return String(ptr, length);
+
+    Vector<char, 256> buf;
+    buf.append(ptr, i);
+    for (; i < length; i++) {
+        unsigned char c = static_cast<unsigned char>(ptr[i]);
+        if (isASCII(c))
+            buf.append(c);
+        else {
+            char escaped[4];
+            snprintf(escaped, sizeof(escaped), "%%%02x", c);
+            buf.append(escaped, 3);
+        }
+    }
+    return String(buf.data(), buf.size());
+}
 
 static size_t headerCallback(char* ptr, size_t size, size_t nmemb, void* data)
 {
@@ -920,13 +1251,14 @@ static size_t headerCallback(char* ptr, size_t size, size_t nmemb, void* data)
         return 0;
     }
 
-    String header;
-    const unsigned char* p = reinterpret_cast<const unsigned char*>(ptr);
-    for (int i=0; i<totalSize; i++) {
-        if (isASCII(p[i]))
-            header.append(p[i]);
+    // libcurl has taken the cookie into the jar before calling back
+    if (totalSize > 11 && !strncasecmp(ptr, "Set-Cookie:", 11)) {
+        const char* effectiveURL = 0;
+        curl_easy_getinfo(d->m_handle, CURLINFO_EFFECTIVE_URL, &effectiveURL);
+        if (effectiveURL)
+            rhm_self->cookieJarChanged(KURL(ParsedURLString, effectiveURL), String(ptr, totalSize));
         else
-            header.append(String::format("%%%02x", p[i]));
+            rhm_self->cookieJarChanged(KURL(), String());
     }
 
     /*
@@ -936,7 +1268,7 @@ static size_t headerCallback(char* ptr, size_t size, size_t nmemb, void* data)
      * The HTTP standard requires to use \r\n but for compatibility it recommends to
      * accept also \n.
      */
-    if (header == String("\r\n") || header == String("\n")) {
+    if ((totalSize == 2 && ptr[0] == '\r' && ptr[1] == '\n') || (totalSize == 1 && ptr[0] == '\n')) {
         LOADINGMOREPRINTF(("Header Received[%p]", job));
 
         CURL* h = d->m_handle;
@@ -999,8 +1331,8 @@ static size_t headerCallback(char* ptr, size_t size, size_t nmemb, void* data)
             }
         }
 
-        // HTTP redirection
-        if (300 <= httpCode && httpCode < 400) {
+        // HTTP redirection; a preconnect has got its connection and goes no further
+        if (300 <= httpCode && httpCode < 400 && !d->m_preconnect) {
             String location = d->m_response.httpHeaderField("location");
             if (!location.isEmpty()) {
                 KURL newURL = KURL(job->firstRequest().url(), location);
@@ -1056,6 +1388,9 @@ static size_t headerCallback(char* ptr, size_t size, size_t nmemb, void* data)
         }
 
         if (!d->m_response.mimeType().isEmpty()) {
+#if ENABLE(WEB_TIMING)
+            setResourceLoadTiming(job, d);
+#endif
             if (d->client())
                 d->client()->didReceiveResponse(job, d->m_response);
             if (d->m_cancelled)
@@ -1065,25 +1400,39 @@ static size_t headerCallback(char* ptr, size_t size, size_t nmemb, void* data)
         }
     }
     else {
-        size_t splitPos = header.find(":");
-        if (splitPos != notFound) {
-            String name = header.left(splitPos);
-            String value = header.substring(splitPos+1).stripWhiteSpace();
-
-            if (!AuthenticateHeaderDuplicate(d, name, value)) {
-                return totalSize;
-            }
-
-            if (isAppendableHeader(name)) {
-                d->m_response.addHTTPHeaderField(name, value);
-            }
-            else {
-                d->m_response.setHTTPHeaderField(name, value);
+        const char* colon = static_cast<const char*>(memchr(ptr, ':', totalSize));
+        if (colon) {
+            size_t nameLength = colon - ptr;
+            const char* value = colon + 1;
+            const char* end = ptr + totalSize;
+            while (value < end && isHeaderSpace(*value))
+                value++;
+            while (end > value && isHeaderSpace(end[-1]))
+                end--;
+            String valueString = headerString(value, end - value);
+
+            const KnownHeader* known = findKnownHeader(ptr, nameLength);
+            if (known) {
+                const AtomicString& name = knownHeaderName(known);
+                if ((known->m_flags & EHeaderAuthenticate) && !AuthenticateHeaderDuplicate(d, name, valueString))
+                    return totalSize;
+                if (known->m_flags & EHeaderAppendable)
+                    d->m_response.addHTTPHeaderField(name, valueString);
+                else
+                    d->m_response.setHTTPHeaderField(name, valueString);
+            } else {
+                AtomicString name(headerString(ptr, nameLength));
+                if (isAppendableHeader(name))
+                    d->m_response.addHTTPHeaderField(name, valueString);
+                else
+                    d->m_response.setHTTPHeaderField(name, valueString);
             }
-
+            return totalSize;
         }
+
+        String header = headerString(ptr, totalSize);
         /* find status text and set it */
-        else if (header.find("HTTP/", 0, false) != notFound) {
+        if (header.find("HTTP/", 0, false) != notFound) {
             long httpcode = 0;
             CURL* h = d->m_handle;
             int ret = curl_easy_getinfo(h, CURLINFO_RESPONSE_CODE, &httpcode);
@@ -1144,6 +1493,7 @@ static size_t readCallback(void* ptr, size_t size, size_t nmemb, void* data)
     if (!d->m_formDataStream.hasMoreElements())
         return 0;
 
+    // when the remaining elements gave nothing, the next call ends the body
     size_t sent = d->m_formDataStream.read(ptr, size, nmemb);
     if (sent == 0)
         sent = CURL_READFUNC_NODATA;
@@ -1161,6 +1511,10 @@ static curlioerr ioctlCallback(CURL *handle, int cmd, void *clientp)
     if (!d || !d->m_handle)
         return CURLIOE_OK;
 
+    // the body is sent again from the start
+    if (cmd == CURLIOCMD_RESTARTREAD)
+        d->m_formDataStream.refresh();
+
     // erase "Content-Type" header
     struct curl_slist *cur_headers = d->m_customHeaders;
     struct curl_slist *new_headers = NULL;
@@ -1315,8 +1669,19 @@ int ResourceHandleManager::_downloadTimerCallback()
     FUNCTIONMOREPRINTF(("<rhm>_downloadTimerCallback()"));
 
     int runningHandles = 0;
+#if !ENABLE(WKC_CURL_MULTI_SOCKET)
     while (curl_multi_perform(m_curlMultiHandle, &runningHandles) == CURLM_CALL_MULTI_PERFORM) { }
+#endif
+    // with WKC_CURL_MULTI_SOCKET, transfers are driven by socketAction();
+    // here we only pick up what has already completed.
+
+    processCompletedTransfers();
 
+    return runningHandles;
+}
+
+void ResourceHandleManager::processCompletedTransfers()
+{
     // check the curl messages indicating completed transfers
     // and free their resources
     while (true) {
@@ -1344,6 +1709,16 @@ int ResourceHandleManager::_downloadTimerCallback()
         if (CURLMSG_DONE != msg->msg)
             continue;
 
+        didCompleteTransfer(job, msg->data.result);
+        recordTransferTimeline(job);
+
+        // the data held back for a batch goes before the load finishes or fails
+        flushReceivedData(job);
+        if (d->m_cancelled) {
+            removeFromCurl(job);
+            continue;
+        }
+
         int httpCode = d->m_response.httpStatusCode();
         if (httpCode == 401 || 407 == httpCode) {
             didReceiveAuthenticationChallenge(job, d->m_currentWebChallenge);
@@ -1397,7 +1772,7 @@ int ResourceHandleManager::_downloadTimerCallback()
                 }
                 if (d->client()) {
 #if ENABLE(WKC_HTTPCACHE)
-                    if (!m_httpCache.disabled()) {
+                    if (!m_httpCache.disabled() && !d->m_preconnect) {
                         KURL url = job->firstRequest().url();
                         switch (d->m_response.httpStatusCode()) {
                         case 200:
@@ -1405,10 +1780,28 @@ int ResourceHandleManager::_downloadTimerCallback()
                         case 300:
                         case 301:
                         case 410:
-                            addHTTPCache(job, url, d->client()->resourceData(), d->m_response);
+                            {
+                                if (d->m_cacheRevalidation && !frameloaderclientwkc(job)) {
+                                    // sent without cookies; may be another version than the page would get
+                                    HTTPCachedResource *resource = m_httpCache.resourceForURL(url);
+                                    if (resource)
+                                        m_httpCache.remove(resource);
+                                    break;
+                                }
+                                double start = monotonicallyIncreasingTime();
+                                addHTTPCache(job, url, d->client()->resourceData(), d->m_response);
+                                if (NetworkTimelineEntry* entry = m_networkTimeline.entry(d->m_timelineEntry))
+                                    entry->m_cacheWrite = (monotonicallyIncreasingTime() - start) * 1000;
+                            }
                             break;
                         case 304:
                             {
+                                if (d->m_cacheRevalidation) {
+                                    HTTPCachedResource *resource = m_httpCache.resourceForURL(url);
+                                    if (resource)
+                                        m_httpCache.revalidated(resource, d->m_response);
+                                    break;
+                                }
                                 if (!d->m_utilizedHTTPCache)
                                     break;  // this case, do nothing since HTTP Cache does not set "If-Modified-Since".
                                 if (job->firstRequest().cachePolicy() == ReloadIgnoringCacheData)
@@ -1476,8 +1869,6 @@ int ResourceHandleManager::_downloadTimerCallback()
 
         removeFromCurl(job);
     }
-
-    return runningHandles;
 }
 
 void ResourceHandleManager::downloadTimerCallback(Timer<ResourceHandleManager>* timer)
@@ -1492,14 +1883,135 @@ void ResourceHandleManager::downloadTimerCallback(Timer<ResourceHandleManager>*
 
     bool started = startScheduledJobs(); // new jobs might have been added in the meantime
 
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    // no polling: new handles arm m_socketActionTimer through curlTimerCallback(),
+    // and running ones are woken up by m_socketWatcher.
+    (void)started;
+    (void)runningHandles;
+#else
     if (!m_downloadTimer.isActive() && (started || (runningHandles > 0))) {
         FUNCTIONMOREPRINTF(("<rhm>startOneShot(%f) by dtc", pollTimeSeconds));
         m_downloadTimer.startOneShot(pollTimeSeconds);
     }
+#endif
 
     FUNCTIONMOREPRINTF(("<dtc> EXIT"));
 }
 
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+//
+// curl_multi_socket_action() driven loop
+//
+void ResourceHandleManager::setupMultiSocket(CURLM* multi)
+{
+    curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, curlSocketCallback);
+    curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, curlTimerCallback);
+    curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+}
+
+int ResourceHandleManager::curlSocketCallback(CURL* handle, curl_socket_t socket, int what, void* userp, void* socketp)
+{
+    FUNCTIONMOREPRINTF(("<rhm>curlSocketCallback(%p, %d, %d)", handle, socket, what));
+
+    ResourceHandleManager* self = static_cast<ResourceHandleManager*>(userp);
+    if (!self || !self->m_socketWatcher)
+        return 0;
+
+    if (CURL_POLL_REMOVE == what) {
+        self->m_socketWatcher->unwatch(socket);
+        return 0;
+    }
+
+    // a transfer deferred before it connected gets its socket here
+    ResourceHandle* job = 0;
+    bool paused = false;
+    if (curl_easy_getinfo(handle, CURLINFO_PRIVATE, &job) == CURLE_OK && job && job->getInternal())
+        paused = job->getInternal()->m_defersLoading;
+    self->m_socketWatcher->watch(socket, what, paused);
+    return 0;
+}
+
+void ResourceHandleManager::setTransferPaused(ResourceHandle* job, bool paused)
+{
+    ResourceHandleInternal* d = job->getInternal();
+    if (!m_socketWatcher || !d->m_handle)
+        return;
+
+    long socket = -1;
+    if (curl_easy_getinfo(d->m_handle, CURLINFO_LASTSOCKET, &socket) != CURLE_OK || socket < 0)
+        return;
+    m_socketWatcher->setPaused(socket, paused);
+}
+
+int ResourceHandleManager::curlTimerCallback(CURLM* multi, long timeoutMs, void* userp)
+{
+    FUNCTIONMOREPRINTF(("<rhm>curlTimerCallback(%ld)", timeoutMs));
+
+    ResourceHandleManager* self = static_cast<ResourceHandleManager*>(userp);
+    if (!self || multi != self->m_curlMultiHandle)
+        return 0;
+
+    if (timeoutMs < 0)
+        self->m_socketActionTimer.stop();
+    else
+        self->m_socketActionTimer.startOneShot(timeoutMs / 1000.0);
+    return 0;
+}
+
+void ResourceHandleManager::socketsReadyCallback(void* data)
+{
+    // may be called after the instance is gone; always look it up again.
+    ResourceHandleManager* self = sharedInstance();
+    if (self)
+        self->socketsReady();
+}
+
+void ResourceHandleManager::socketAction(curl_socket_t socket, int events)
+{
+    int runningHandles = 0;
+    while (curl_multi_socket_action(m_curlMultiHandle, socket, events, &runningHandles) == CURLM_CALL_MULTI_PERFORM) { }
+}
+
+void ResourceHandleManager::socketActionTimerCallback(Timer<ResourceHandleManager>* timer)
+{
+    FUNCTIONMOREPRINTF(("<rhm>socketActionTimerCallback()"));
+
+    socketAction(CURL_SOCKET_TIMEOUT, 0);
+
+    processCompletedTransfers();
+    cancelScheduledJobs();
+    (void)startScheduledJobs();
+}
+
+void ResourceHandleManager::socketsReady()
+{
+    FUNCTIONMOREPRINTF(("<rhm>socketsReady()"));
+
+    if (!m_socketWatcher)
+        return;
+
+    Vector<CurlSocketWatcher::ReadySocket> sockets;
+    m_socketWatcher->takeReadySockets(sockets);
+    for (size_t i = 0; i < sockets.size(); i++) {
+        // looked up each time: a WebSocket may close another one from its client
+        SocketStreamHandle* webSocket = watchedWebSocket(sockets[i].m_socket);
+        if (webSocket) {
+            webSocket->socketReady(sockets[i].m_events);
+            continue;
+        }
+        socketAction(sockets[i].m_socket, sockets[i].m_events);
+    }
+
+    processCompletedTransfers();
+    cancelScheduledJobs();
+    (void)startScheduledJobs();
+
+    if (m_socketWatcher)
+        m_socketWatcher->resume();
+}
+#endif // ENABLE(WKC_CURL_MULTI_SOCKET)
+
 static CURLcode cookie_callback(curlcookiedirect direct, CURL *curl, const char *domain, bool tailmatch, void *data)
 {
     FUNCTIONPRINTF(("<rhm>cookie_callback(%s, %p, %s, %s, %p)", (direct == CURLCOOKIEDIRECT_RECEIVE)?"recv":"send", curl, domain, (tailmatch)?"True":"False", data));
@@ -1591,6 +2103,7 @@ void ResourceHandleManager::doClearCookies()
             curl_share_setopt(m_curlShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE);
             curl_share_setopt(m_curlShareHandle, CURLSHOPT_COOKIE_MAX_ENTRIES, m_cookieMaxEntries);
             m_cookiesDeleting = false;
+            m_cookieStore.invalidate();
         }
 
         wkcMutexUnlockPeer(gCookieMutex);
@@ -1612,9 +2125,18 @@ void ResourceHandleManager::setProxyInfo(const String& host, unsigned long port,
     /* renewal cURL Multi */
     CURLM* curl_multi = curl_multi_init();  // Ugh! Allocate before cleanup to make sure the adress will change.
                                             //      Needed to detect this renewal... (cf. WKC's SocketStreamHandle::platformClose())
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    m_socketActionTimer.stop();
+    m_socketWatcher->unwatchAll();
+#endif
     curl_multi_cleanup(m_curlMultiHandle);
     m_curlMultiHandle = curl_multi;
     curl_multi_setopt(m_curlMultiHandle, CURLMOPT_MAXCONNECTS, m_httpConnections);
+    curl_multi_setopt(m_curlMultiHandle, CURLMOPT_PIPELINING, m_httpPipelining ? 1L : 0L);
+    m_connectionPool.clear();
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    setupMultiSocket(m_curlMultiHandle);
+#endif
 
     if (0 == host.length()) {
         m_proxy = String("");
@@ -1687,7 +2209,7 @@ bool ResourceHandleManager::setupMethod(ResourceHandle* job, struct curl_slist**
         return false;
     }
 
-    Vector<FormDataElement> elements = job->firstRequest().httpBody()->elements();
+    const Vector<FormDataElement>& elements = job->firstRequest().httpBody()->elements();
     size_t numElements = elements.size();
     if (!numElements) {
         *headers = curl_slist_append(*headers, "Content-Length: 0");
@@ -1735,7 +2257,7 @@ bool ResourceHandleManager::setupMethod(ResourceHandle* job, struct curl_slist**
     curl_off_t size = 0;
     bool chunkedTransfer = false;
     for (size_t i = 0; i < numElements; i++) {
-        FormDataElement element = elements[i];
+        const FormDataElement& element = elements[i];
         if (element.m_type == FormDataElement::encodedFile) {
             long long fileSizeResult;
             if (getFileSize(element.m_filename, fileSizeResult)) {
@@ -1862,18 +2384,29 @@ void ResourceHandleManager::add(ResourceHandle* job)
     d->m_matchProxyFilter = m_proxyFilters.isMatchProxyFilter(kurl.host());
 
 #if ENABLE(WKC_HTTPCACHE)
-    if (!m_httpCache.disabled() && job->firstRequest().cachePolicy() != ReloadIgnoringCacheData) {
+    if (!m_httpCache.disabled() && !d->m_preconnect && job->firstRequest().cachePolicy() != ReloadIgnoringCacheData) {
         HTTPCachedResource *resource = m_httpCache.resourceForURL(kurl);
         if (resource) {
             const String& lastModified = resource->lastModifiedHeader();
             const String& etag = resource->eTagHeader();
-            if (lastModified.isEmpty() && etag.isEmpty()) {
-                if (!resource->needRevalidate()) {
+            bool hasValidator = !lastModified.isEmpty() || !etag.isEmpty();
+            if (!d->m_cacheRevalidation) {
+                bool isGET = job->firstRequest().httpMethod() == "GET";
+                if (!resource->needRevalidate() && (isGET || !hasValidator)) {
                     // read from the cached resource
                     scheduleLoadResourceFromHTTPCache(job);
                     return;
                 }
-            } else {
+                // the harmful site filter would cancel a revalidation from no frame
+                bool canRevalidate = frameloaderclientwkc(job) || !m_harmfulSiteFilter;
+                if (isGET && canRevalidate && m_httpCache.staleWhileRevalidate() && resource->isUsableWhileRevalidating()) {
+                    // read the stale one now, and update it in the background
+                    startCacheRevalidation(job);
+                    scheduleLoadResourceFromHTTPCache(job);
+                    return;
+                }
+            }
+            if (hasValidator) {
                 // get from a network unless the cached resource is up-to-date.
                 if (!lastModified.isEmpty())
                     job->firstRequest().setHTTPHeaderField("If-Modified-Since", lastModified);
@@ -2366,6 +2899,15 @@ void ResourceHandleManager::startJob(ResourceHandle* job)
 
     ResourceHandleInternal* d = job->getInternal();
 
+    // the host failed to resolve a moment ago; don't wait for the resolver again
+    if (m_dnsResolver && !(m_proxy.length() && !d->m_matchProxyFilter) && m_dnsResolver->isKnownUnresolvable(kurl.host())) {
+        job->cancel();
+        if (d->client())
+            d->client()->didFail(job, ResourceError(String(), CURLE_COULDNT_RESOLVE_HOST, kurl.string(), String(curl_easy_strerror(CURLE_COULDNT_RESOLVE_HOST)), job));
+        job->deref();
+        return;
+    }
+
     initializeHandle(job);
     if (!d->m_handle) {
         ERRORPRINTF(("<rhm>startJob(): No Memory or Something error"));
@@ -2374,6 +2916,7 @@ void ResourceHandleManager::startJob(ResourceHandle* job)
         return;
     }
 
+    d->m_timelineStarted = monotonicallyIncreasingTime();
     CURLMcode ret = curl_multi_add_handle(m_curlMultiHandle, d->m_handle);
     // don't call perform, because events must be async
     // timeout will occur and do curl_multi_perform
@@ -2469,7 +3012,7 @@ void ResourceHandleManager::initializeHandle(ResourceHandle* job)
     curl_easy_setopt(d->m_handle, CURLOPT_COOKIEFUNCTIONDATA, job);
     curl_easy_setopt(d->m_handle, CURLOPT_COOKIEFUNCTION, cookie_callback);
     // redirect
-    if (!m_redirectInWKC) {
+    if (!m_redirectInWKC && !d->m_preconnect) {
         curl_easy_setopt(d->m_handle, CURLOPT_FOLLOWLOCATION, 1);
         curl_easy_setopt(d->m_handle, CURLOPT_MAXREDIRS, 10);
     }
@@ -2593,6 +3136,17 @@ void ResourceHandleManager::initializeHandle(ResourceHandle* job)
                 curl_easy_setopt(d->m_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0);
             }
         }
+    } else if (m_dnsResolver) {
+        // hand an address resolved in advance to libcurl
+        if (d->m_resolveList) {
+            curl_easy_setopt(d->m_handle, CURLOPT_RESOLVE, NULL);
+            curl_slist_free_all(d->m_resolveList);
+            d->m_resolveList = 0;
+        }
+        int port = kurl.hasPort() ? kurl.port() : (kurl.protocolIs("https") ? 443 : 80);
+        d->m_resolveList = m_dnsResolver->resolveList(kurl.host(), port);
+        if (d->m_resolveList)
+            curl_easy_setopt(d->m_handle, CURLOPT_RESOLVE, d->m_resolveList);
     }
 
     // HTTP Authenticate
@@ -2650,6 +3204,7 @@ void ResourceHandleManager::setCookie(const String &domain, const String &path,
     wkcMutexLockPeer(gCookieMutex);
 
     curl_share_set_cookie(m_curlShareHandle, domain.utf8().data(), path.utf8().data(), cookie.utf8().data(), COOKIETYPE_HEADERLINE);
+    m_cookieStore.cookieSet(m_curlShareHandle, domain, path, cookie);
 
     wkcMutexUnlockPeer(gCookieMutex);
 }
@@ -2657,27 +3212,25 @@ void ResourceHandleManager::setCookie(const String &domain, const String &path,
 String ResourceHandleManager::getCookie(const String &domain, const String &path, bool secure, bool includehttponly)
 {
     wkcMutexLockPeer(gCookieMutex);
-    int len = 0;
-    char* buf = 0;
 
-    len = curl_share_get_cookie(m_curlShareHandle, domain.utf8().data(), path.utf8().data(), secure ? TRUE : FALSE, includehttponly ? TRUE : FALSE, NULL, 0);
-    if (len>0) {
-        buf = (char *)fastMalloc(len+1);
-        if (buf) {
-            buf[0] = 0x0;
-            len = curl_share_get_cookie(m_curlShareHandle, domain.utf8().data(), path.utf8().data(), secure ? TRUE : FALSE, includehttponly ? TRUE : FALSE, buf, len+1);
-        }
-    }
+    m_cookieStore.update(m_curlShareHandle);
+    String result = m_cookieStore.cookies(domain, path, secure, includehttponly);
 
     wkcMutexUnlockPeer(gCookieMutex);
 
-    if (buf) {
-        String result = String::fromUTF8(buf);
-        fastFree(buf);
-        return result;
-    } else {
+    if (result.isEmpty())
         return String();
-    }
+    return result;
+}
+
+void ResourceHandleManager::cookieJarChanged(const KURL& url, const String& header)
+{
+    wkcMutexLockPeer(gCookieMutex);
+    if (url.isValid())
+        m_cookieStore.cookieSet(m_curlShareHandle, url.host(), url.path(), header);
+    else
+        m_cookieStore.invalidate();
+    wkcMutexUnlockPeer(gCookieMutex);
 }
 
 int ResourceHandleManager::CookieSerializeNum()
@@ -2701,6 +3254,7 @@ int ResourceHandleManager::CookieSerialize(char* buff, int bufflen)
     struct curl_slist** cookie_array = 0;
     struct curl_slist* cookies;
     struct curl_slist* current;
+    struct curl_slist* written = 0;
     int total_len = 0;
     int remaining_bufflen = bufflen;
     int pos = 0;
@@ -2752,6 +3306,7 @@ int ResourceHandleManager::CookieSerialize(char* buff, int bufflen)
         }
     }
 
+    written = current;
     while (current) {
         int datalen = strlen(current->data);
         memcpy(buff + pos, current->data, strlen(current->data));
@@ -2769,6 +3324,9 @@ int ResourceHandleManager::CookieSerialize(char* buff, int bufflen)
     total_len = bufflen - remaining_bufflen;
 
 CookieSerializeEnd:
+    // later changes are saved relative to what made it into buff
+    if (buff)
+        m_cookieStore.didSerialize(cookies, written);
     if (cookie_array)
         fastFree(cookie_array);
     curl_slist_free_all(cookies);
@@ -2776,6 +3334,19 @@ CookieSerializeEnd:
     return total_len;
 }
 
+int ResourceHandleManager::CookieSerializeChanges(char* buff, int bufflen)
+{
+    FUNCTIONPRINTF(("<rhm>CookieSerializeChanges(%p, %d)", buff, bufflen));
+
+    wkcMutexLockPeer(gCookieMutex);
+
+    m_cookieStore.update(m_curlShareHandle);
+    int ret = m_cookieStore.serializeChanges(buff, bufflen);
+
+    wkcMutexUnlockPeer(gCookieMutex);
+    return ret;
+}
+
 void ResourceHandleManager::CookieDeserialize(const char* buff, bool restart)
 {
     FUNCTIONPRINTF(("<rhm>CookieDeserialize(%p, %s)", buff, (restart)?"restart":"initial"));
@@ -2808,6 +3379,8 @@ void ResourceHandleManager::CookieDeserialize(const char* buff, bool restart)
     }
 
 CookieDeserializeEnd:
+    // the application holds these already
+    m_cookieStore.didSerializeAll(m_curlShareHandle);
     wkcMutexUnlockPeer(gCookieMutex);
 }
 
@@ -2817,33 +3390,8 @@ bool ResourceHandleManager::getRawCookies(const String &domain, const String &pa
 
     wkcMutexLockPeer(gCookieMutex);
 
-    struct CookieJarIterator* it = curl_share_create_cookies_iterator(m_curlShareHandle, domain.utf8().data(), path.utf8().data(), secure);
-    if (!it) {
-        wkcMutexUnlockPeer(gCookieMutex);
-        return false;
-    }
-
-    rawCookies.reserveCapacity(it->length);
-
-    while (CURLSHE_OK == curl_share_advance_cookies_iterator(m_curlShareHandle, it)) {
-        String name = String::fromUTF8(it->cookie.name);
-        String value = String::fromUTF8(it->cookie.value);
-        // All domains are prefixed with a dot if they allow tailmatching. See also get_netscape_format() in cURL/lib/cookie.c.
-        String ndomain;
-        if (it->cookie.tailmatch && it->cookie.domain && it->cookie.domain[0] != '.')
-            ndomain = "." + String::fromUTF8(it->cookie.domain);
-        else
-            ndomain = String::fromUTF8(it->cookie.domain);
-        String npath = String::fromUTF8(it->cookie.path);
-        double expires = static_cast<double>(it->cookie.expires) * 1000;
-        bool isHttpOnly = it->cookie.httponly;
-        bool isSecure = it->cookie.secure;
-        bool isSession = !expires;
-
-        rawCookies.uncheckedAppend(Cookie(name, value, ndomain, npath, expires, isHttpOnly, isSecure, isSession));
-    }
-
-    curl_share_delete_cookies_iterator(m_curlShareHandle, it);
+    m_cookieStore.update(m_curlShareHandle);
+    m_cookieStore.rawCookies(domain, path, secure, rawCookies);
 
     wkcMutexUnlockPeer(gCookieMutex);
 
@@ -2866,6 +3414,7 @@ void ResourceHandleManager::deleteCookie(const String &domain, const String &pat
         // Set the cookie expired to delete.
         String expiredCookie = "Set-Cookie: " + name + "=; expires=Thu, 01-Jan-1970 00:00:00 GMT; path=" + path + "; domain=" + domain + ";";
         curl_share_set_cookie(m_curlShareHandle, domain.utf8().data(), path.utf8().data(), expiredCookie.utf8().data(), COOKIETYPE_HEADERLINE);
+        m_cookieStore.cookieSet(m_curlShareHandle, domain, path, expiredCookie);
         break;
     }
 
@@ -2934,8 +3483,22 @@ void ResourceHandleManager::appendScheduledJob(ResourceHandle* job)
     }
     d->m_url = fastStrdup(kurl.string().latin1().data());
     d->m_composition = contentComposition(job);
-
-    m_scheduledJobList.append(job);
+    d->m_connectionKey = connectionKey(job, kurl);
+    if (!d->m_timelineQueued) {
+        d->m_timelineQueued = monotonicallyIncreasingTime();
+        d->m_timelineQueuedDate = currentTime();
+    }
+    d->m_priority = jobPriority(job);
+
+    // behind every job of the same or a higher priority, ahead of the lower ones
+    size_t pos = m_scheduledJobList.size();
+    while (pos > 0) {
+        ResourceHandleInternal* prev = m_scheduledJobList[pos - 1]->getInternal();
+        if (!prev || prev->m_priority <= d->m_priority)
+            break;
+        pos--;
+    }
+    m_scheduledJobList.insert(pos, job);
 
     canPermitRequest(job);
 }
@@ -2958,6 +3521,7 @@ bool ResourceHandleManager::removeScheduledJob(ResourceHandle* job)
     for (int i = 0; i < size; i++) {
         if (job == m_readCacheJobList[i]) {
             m_readCacheJobList.remove(i);
+            closeCacheReadStream(job);
             job->deref();
             return true;
         }
@@ -2974,45 +3538,240 @@ ResourceHandle* ResourceHandleManager::shiftScheduledJob()
     if (0 == size)
         return (ResourceHandle*)0;
 
+    // The first startable job is started unless one of the next few
+    // startable jobs can go out on an idle keep-alive connection.
     ResourceHandle* job = 0;
+    int first = -1;
+    int warm = -1;
+    int startable = 0;
     int i;
-    for (i = 0; i < size; i++) {
+    for (i = 0; i < size && startable < cWarmConnectionLookahead; i++) {
         job = m_scheduledJobList[i];
         ResourceHandleInternal* d = job->getInternal();
         if (!d)
             continue;
-        if (d->m_cancelled) {
+        if (d->m_cancelled || d->m_permitSend == ResourceHandleInternal::CANCEL) {
             m_scheduledJobList.remove(i);
             return job;
         }
 
-        switch (d->m_permitSend) {
-        case ResourceHandleInternal::PERMIT:
-        case ResourceHandleInternal::CANCEL:
-            m_scheduledJobList.remove(i);
-            return job;
-        case ResourceHandleInternal::SUSPEND:
-        case ResourceHandleInternal::ASKING:
-            break;
-        default:
-            break;
+        if (d->m_permitSend != ResourceHandleInternal::PERMIT
+            && !d->m_fileLoading && !d->m_dataLoading && !d->m_matchProxyFilter
+            && m_tryProxySingleConnect && m_runningJobList.size() > 0) {
+            continue;
         }
 
-        if (d->m_fileLoading || d->m_dataLoading || d->m_matchProxyFilter) {
-            m_scheduledJobList.remove(i);
-            return job;
-        }
-        else {
-            if (m_tryProxySingleConnect && m_runningJobList.size() > 0) { 
-                continue;
-            }
-            m_scheduledJobList.remove(i);
-            return job;
+        if (first < 0)
+            first = i;
+        else if (d->m_priority != m_scheduledJobList[first]->getInternal()->m_priority)
+            break;  // never ahead of a job with a higher priority
+        if (m_connectionPool.hasIdleConnection(d->m_connectionKey)) {
+            warm = i;
+            break;
         }
+        startable++;
+    }
+
+    if (warm >= 0) {
+        job = m_scheduledJobList[warm];
+        m_scheduledJobList.remove(warm);
+        m_connectionPool.takeIdleConnection(job->getInternal()->m_connectionKey);
+        if (warm != first)
+            m_connectionPool.didWarmStart();
+        return job;
+    }
+    if (first >= 0) {
+        job = m_scheduledJobList[first];
+        m_scheduledJobList.remove(first);
+        return job;
     }
     return (ResourceHandle*)0;
 }
 
+static String originKey(const KURL& url)
+{
+    String key = url.protocol().lower() + "://" + url.host().lower();
+    if (url.hasPort())
+        key += ":" + String::number(url.port());
+    return key;
+}
+
+String ResourceHandleManager::connectionKey(ResourceHandle* job, const KURL& url)
+{
+    if (!url.protocolIsInHTTPFamily())
+        return String();
+
+    ResourceHandleInternal* d = job->getInternal();
+    if (m_proxy.length() && !d->m_matchProxyFilter)
+        return m_proxy;
+
+    return originKey(url);
+}
+
+bool ResourceHandleManager::hasJobForConnection(const String& key)
+{
+    for (size_t i = 0; i < m_runningJobList.size(); i++) {
+        ResourceHandleInternal* d = m_runningJobList[i]->getInternal();
+        if (d && d->m_connectionKey == key)
+            return true;
+    }
+    for (size_t i = 0; i < m_scheduledJobList.size(); i++) {
+        ResourceHandleInternal* d = m_scheduledJobList[i]->getInternal();
+        if (d && d->m_connectionKey == key)
+            return true;
+    }
+    return false;
+}
+
+// HEAD request to the root of an origin, made only for the keep-alive
+// connection it leaves in libcurl's connection cache. It belongs to no
+// frame and sends no cookies; the response is neither cached nor followed.
+class HTTPPreconnector : public ResourceHandle, public ResourceHandleClient {
+public:
+    static PassRefPtr<HTTPPreconnector> create(const ResourceRequest& request, const String& key)
+    {
+        return adoptRef(new HTTPPreconnector(request, key));
+    }
+
+    virtual ~HTTPPreconnector()
+    {
+        if (ResourceHandleManager::sharedInstance())
+            ResourceHandleManager::sharedInstance()->didFinishPreconnect(m_key);
+    }
+
+private:
+    HTTPPreconnector(const ResourceRequest& request, const String& key)
+        : ResourceHandle(request, 0, false, false)
+        , m_key(key)
+    {
+        getInternal()->m_preconnect = true;
+        setClient(this);
+    }
+
+    String m_key;
+};
+
+void ResourceHandleManager::preconnect(const KURL& url)
+{
+    if (!url.protocolIsInHTTPFamily() || url.host().isEmpty())
+        return;
+    // every origin shares the connection to the proxy
+    if (m_proxy.length())
+        return;
+    if (m_preconnectingOrigins.size() >= cMaxPreconnects)
+        return;
+    // never take a connection slot from a real load
+    if (m_httpConnections && (int)m_runningJobList.size() >= m_httpConnections)
+        return;
+
+    String key = originKey(url);
+    if (m_preconnectingOrigins.contains(key) || m_connectionPool.hasIdleConnection(key) || hasJobForConnection(key))
+        return;
+
+    ResourceRequest request(KURL(ParsedURLString, key + "/"));
+    request.setHTTPMethod("HEAD");
+    request.setAllowCookies(false);
+    // behind every load in the job queue
+    request.setTargetType(ResourceRequest::TargetIsPrefetch);
+    RefPtr<HTTPPreconnector> preconnector = HTTPPreconnector::create(request, key);
+    if (!preconnector)
+        return;
+
+    m_preconnectingOrigins.add(key);
+    m_connectionPool.didStartPreconnect();
+    add(preconnector.get());
+}
+
+void ResourceHandleManager::didFinishPreconnect(const String& key)
+{
+    m_preconnectingOrigins.remove(key);
+}
+
+void ResourceHandleManager::recordTransferTimeline(ResourceHandle* job)
+{
+    if (!m_networkTimeline.enabled())
+        return;
+
+    ResourceHandleInternal* d = job->getInternal();
+    if (!job->firstRequest().url().protocolIsInHTTPFamily() || !d->m_timelineStarted)
+        return;
+
+    // seconds from the start of the transfer
+    double namelookup = 0;
+    double connect = 0;
+    double appconnect = 0;
+    double pretransfer = 0;
+    double starttransfer = 0;
+    double total = 0;
+    double downloaded = 0;
+    long connects = 0;
+    curl_easy_getinfo(d->m_handle, CURLINFO_NAMELOOKUP_TIME, &namelookup);
+    curl_easy_getinfo(d->m_handle, CURLINFO_CONNECT_TIME, &connect);
+    curl_easy_getinfo(d->m_handle, CURLINFO_APPCONNECT_TIME, &appconnect);
+    curl_easy_getinfo(d->m_handle, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+    curl_easy_getinfo(d->m_handle, CURLINFO_STARTTRANSFER_TIME, &starttransfer);
+    curl_easy_getinfo(d->m_handle, CURLINFO_TOTAL_TIME, &total);
+    curl_easy_getinfo(d->m_handle, CURLINFO_SIZE_DOWNLOAD, &downloaded);
+    curl_easy_getinfo(d->m_handle, CURLINFO_NUM_CONNECTS, &connects);
+
+    NetworkTimelineEntry entry;
+    entry.m_url = job->firstRequest().url().string();
+    entry.m_method = job->firstRequest().httpMethod();
+    entry.m_status = d->m_response.httpStatusCode();
+    entry.m_reusedConnection = !connects;
+    entry.m_bodySize = static_cast<long long>(downloaded);
+    entry.m_startedDateTime = d->m_timelineQueuedDate;
+    entry.m_blocked = (d->m_timelineStarted - d->m_timelineQueued) * 1000;
+
+    double connected = 0;
+    if (connects) {
+        connected = (appconnect > 0) ? appconnect : connect;
+        entry.m_dns = namelookup * 1000;
+        entry.m_connect = (connected - namelookup) * 1000;
+        if (appconnect > 0)
+            entry.m_ssl = (appconnect - connect) * 1000;
+    }
+    // libcurl does not tell when the request went out
+    entry.m_send = std::max(pretransfer - connected, 0.0) * 1000;
+    if (starttransfer > 0) {
+        entry.m_wait = std::max(starttransfer - pretransfer, 0.0) * 1000;
+        entry.m_receive = std::max(total - starttransfer, 0.0) * 1000;
+    }
+
+    d->m_timelineEntry = m_networkTimeline.add(entry);
+}
+
+void ResourceHandleManager::didCompleteTransfer(ResourceHandle* job, CURLcode result)
+{
+    ResourceHandleInternal* d = job->getInternal();
+    if (d->m_connectionKey.isEmpty())
+        return;
+
+    long connects = 0;
+    double ttfb = 0;
+    curl_easy_getinfo(d->m_handle, CURLINFO_NUM_CONNECTS, &connects);
+    curl_easy_getinfo(d->m_handle, CURLINFO_STARTTRANSFER_TIME, &ttfb);
+    if (!d->m_preconnect)
+        m_connectionPool.didCompleteTransfer(connects == 0, ttfb);
+
+    if (m_dnsResolver && !(m_proxy.length() && !d->m_matchProxyFilter)) {
+        const char* url = 0;
+        char* ip = 0;
+        curl_easy_getinfo(d->m_handle, CURLINFO_EFFECTIVE_URL, &url);
+        String host = url ? KURL(ParsedURLString, url).host() : job->firstRequest().url().host();
+        if (result == CURLE_COULDNT_RESOLVE_HOST)
+            m_dnsResolver->didFailToResolve(host);
+        else if (connects && curl_easy_getinfo(d->m_handle, CURLINFO_PRIMARY_IP, &ip) == CURLE_OK && ip)
+            m_dnsResolver->didResolve(host, String(ip));
+    }
+
+    // -1 when libcurl closed the connection instead of keeping it in its cache
+    long lastSocket = -1;
+    curl_easy_getinfo(d->m_handle, CURLINFO_LASTSOCKET, &lastSocket);
+    if (result == CURLE_OK && lastSocket != -1)
+        m_connectionPool.putIdleConnection(d->m_connectionKey, d->m_preconnect && connects);
+}
+
 //
 // Running job control
 //
@@ -3397,6 +4156,36 @@ int ResourceHandleManager::contentComposition(ResourceHandle* job)
     return WKC::EInclusionContentComposition;
 }
 
+int ResourceHandleManager::jobPriority(ResourceHandle* job)
+{
+    ResourceHandleInternal* d = job->getInternal();
+
+    // set from CachedResource::Type by CachedResource::load()
+    switch (d->m_firstRequest.targetType()) {
+    case ResourceRequest::TargetIsMainFrame:
+    case ResourceRequest::TargetIsSubframe:
+        return EPriorityMainResource;
+    case ResourceRequest::TargetIsStyleSheet:
+        return EPriorityStyleSheet;
+    case ResourceRequest::TargetIsScript:
+    case ResourceRequest::TargetIsWorker:
+    case ResourceRequest::TargetIsSharedWorker:
+        return EPriorityScript;
+    case ResourceRequest::TargetIsImage:
+    case ResourceRequest::TargetIsFavicon:
+        return EPriorityImage;
+    case ResourceRequest::TargetIsPrefetch:
+    case ResourceRequest::TargetIsPrerender:
+        return EPriorityPrefetch;
+    default:
+        break;
+    }
+
+    if (d->m_composition == WKC::ERootFrameRootContentComposition || d->m_composition == WKC::ESubFrameRootContentComposition)
+        return EPriorityMainResource;
+    return EPriorityOther;
+}
+
 bool ResourceHandleManager::oneShotDownloadTimer(void)
 {
     if (!m_downloadTimer.isActive()) {
@@ -3439,6 +4228,11 @@ void ResourceHandleManager::SSLRootCADeleteAll(void)
     m_rhmssl->SSLRootCADeleteAll();
 }
 
+void ResourceHandleManager::getSSLSessionStatistics(SSLSessionStatistics& stat)
+{
+    m_rhmssl->getSSLSessionStatistics(stat);
+}
+
 void* ResourceHandleManager::SSLRegisterCRL(const char* crl, int crl_len)
 {
     return m_rhmssl->SSLRegisterCRL(crl, crl_len);
@@ -3521,6 +4315,95 @@ bool ResourceHandleManager::isMatchProxyFilter(const String& host)
 //
 //  Proxy Filter
 //
+ResourceHandleManager::ConnectionPool::ConnectionPool()
+    : m_maxIdleConnections(HTTP_DEFAULT_MAX_CONNECTIONS)
+{
+    memset(&m_stat, 0, sizeof(m_stat));
+}
+
+ResourceHandleManager::ConnectionPool::~ConnectionPool()
+{
+}
+
+void ResourceHandleManager::ConnectionPool::setMaxIdleConnections(int number)
+{
+    m_maxIdleConnections = number;
+    while (m_maxIdleConnections > 0 && (int)m_idleConnections.size() > m_maxIdleConnections)
+        removeIdleConnection(0);
+}
+
+void ResourceHandleManager::ConnectionPool::removeIdleConnection(size_t index)
+{
+    if (m_idleConnections[index].m_preconnected)
+        m_stat.m_unusedPreconnects++;
+    m_idleConnections.remove(index);
+}
+
+void ResourceHandleManager::ConnectionPool::expire()
+{
+    // libcurl does not let a cached connection be closed by itself; an
+    // unused preconnected one is no longer counted on after the deadline,
+    // and being the least recently used it is the first libcurl closes.
+    double now = currentTime();
+    for (size_t i = m_idleConnections.size(); i > 0; i--) {
+        const IdleConnection& connection = m_idleConnections[i - 1];
+        double lifetime = connection.m_preconnected ? cPreconnectDeadline : cIdleConnectionLifetime;
+        if (now - connection.m_since > lifetime)
+            removeIdleConnection(i - 1);
+    }
+}
+
+bool ResourceHandleManager::ConnectionPool::hasIdleConnection(const String& key)
+{
+    if (key.isEmpty() || m_idleConnections.isEmpty())
+        return false;
+
+    expire();
+    for (size_t i = 0; i < m_idleConnections.size(); i++) {
+        if (m_idleConnections[i].m_key == key)
+            return true;
+    }
+    return false;
+}
+
+void ResourceHandleManager::ConnectionPool::takeIdleConnection(const String& key)
+{
+    // the most recently used one is the least likely to have been closed by the server
+    for (size_t i = m_idleConnections.size(); i > 0; i--) {
+        if (m_idleConnections[i - 1].m_key == key) {
+            if (m_idleConnections[i - 1].m_preconnected)
+                m_stat.m_usedPreconnects++;
+            m_idleConnections.remove(i - 1);
+            return;
+        }
+    }
+}
+
+void ResourceHandleManager::ConnectionPool::putIdleConnection(const String& key, bool preconnected)
+{
+    // libcurl closes the oldest connection when its cache is full
+    if (m_maxIdleConnections > 0 && (int)m_idleConnections.size() >= m_maxIdleConnections)
+        removeIdleConnection(0);
+
+    IdleConnection connection = { key, currentTime(), preconnected };
+    m_idleConnections.append(connection);
+}
+
+void ResourceHandleManager::ConnectionPool::clear()
+{
+    m_idleConnections.clear();
+}
+
+void ResourceHandleManager::ConnectionPool::didCompleteTransfer(bool reused, double ttfb)
+{
+    m_stat.m_transfers++;
+    if (reused) {
+        m_stat.m_reusedTransfers++;
+        m_stat.m_reusedConnectionTTFB += ttfb;
+    } else
+        m_stat.m_newConnectionTTFB += ttfb;
+}
+
 ResourceHandleManager::ProxyFilter::ProxyFilter()
     : m_proxyFilters(0)
 {
@@ -3914,6 +4797,7 @@ void ResourceHandleManager::clearHTTPCache()
     while (num--) {
         job = m_readCacheJobList[num];
         m_readCacheJobList.remove(num);
+        closeCacheReadStream(job);
         job->deref();
     }
     
@@ -3927,6 +4811,19 @@ void ResourceHandleManager::clearHTTPCache()
         delete resource;
     }
 
+    if (m_cacheWriter) {
+        Vector<HTTPCacheWriter::Finished> finished;
+        m_cacheWriter->waitForIdle();
+        m_cacheWriter->takeFinished(finished);
+    }
+    num = m_writingCacheList.size();
+    while (num--) {
+        resource = m_writingCacheList[num];
+        m_writingCacheList.remove(num);
+        m_httpCache.finishWrite(resource, false, 0);
+        delete resource;
+    }
+
     m_httpCache.removeAll();
     m_httpCache.purgeBySize(0);
     m_httpCache.writeFATFile();
@@ -3947,6 +4844,12 @@ HTTPCachedResource* ResourceHandleManager::updateCacheResource(KURL &url, RefPtr
         }
     }
     
+    // a body being written by m_cacheWriter can not be updated any more
+    for (size_t num = 0; num < m_writingCacheList.size(); num++) {
+        if (m_httpCache.equalHTTPCachedResourceURL(m_writingCacheList[num], url))
+            m_writingCacheList[num]->setWriteCancelled();
+    }
+
     for(int num = 0; num < m_writeCacheList.size(); num++) {
         if (m_httpCache.equalHTTPCachedResourceURL(m_writeCacheList[num], url)) {
             if (noStore) {
@@ -3963,6 +4866,9 @@ HTTPCachedResource* ResourceHandleManager::updateCacheResource(KURL &url, RefPtr
 }
 
 
+// Responses waiting for m_cacheWriter beyond this are not cached.
+static const size_t cWriteCacheListLimit = 32;
+
 bool ResourceHandleManager::addHTTPCache(ResourceHandle *handle, KURL &url, RefPtr<SharedBuffer> resourceData, ResourceResponse &response)
 {
     if (!resourceData)
@@ -3998,6 +4904,9 @@ bool ResourceHandleManager::addHTTPCache(ResourceHandle *handle, KURL &url, RefP
 
     HTTPCachedResource *resource = updateCacheResource(url, resourceData, response, noCache, noStore, mustRevalidate, expires, maxAge);
     if (!resource && !noStore) {
+        // back-pressure: do not keep more bodies in memory than the writer can catch up with
+        if (m_writeCacheList.size() >= cWriteCacheListLimit)
+            return false;
         resource = m_httpCache.createHTTPCachedResource(url, resourceData, response, noCache, mustRevalidate, expires, maxAge);
         if (!resource)
             return false;
@@ -4012,8 +4921,81 @@ bool ResourceHandleManager::addHTTPCache(ResourceHandle *handle, KURL &url, RefP
     return true;
 }
 
+// Loads a cached resource again, with If-None-Match / If-Modified-Since
+// from add(), while the stale copy is read by the page. It is sent as the
+// page's request, from the frame of the page, so that cookies, the
+// harmful site filter and cancelling the frame apply to it as well. The
+// reference taken by add() keeps it until the transfer is done, and
+// processCompletedTransfers() updates the cache from it.
+class HTTPCacheRevalidator : public ResourceHandle, public ResourceHandleClient {
+public:
+    static PassRefPtr<HTTPCacheRevalidator> create(const ResourceRequest& request, ResourceHandle* job)
+    {
+        return adoptRef(new HTTPCacheRevalidator(request, job));
+    }
+
+    virtual ~HTTPCacheRevalidator()
+    {
+        if (ResourceHandleManager::sharedInstance())
+            ResourceHandleManager::sharedInstance()->didFinishCacheRevalidation(m_url);
+    }
+
+    virtual void didReceiveData(ResourceHandle*, const char* data, int length, int)
+    {
+        m_data->append(data, length);
+    }
+
+    virtual PassRefPtr<SharedBuffer> resourceData() { return m_data; }
+
+private:
+    HTTPCacheRevalidator(const ResourceRequest& request, ResourceHandle* job)
+        : ResourceHandle(request, 0, false, false)
+        , m_url(request.url())
+        , m_data(SharedBuffer::create())
+    {
+        getInternal()->m_cacheRevalidation = true;
+        setClient(this);
+        setFrame(const_cast<Frame*>(job->frame()));
+        setMainFrame(const_cast<Frame*>(job->mainFrame()), const_cast<FrameLoaderClient*>(job->frameloaderclient()));
+    }
+
+    KURL m_url;
+    RefPtr<SharedBuffer> m_data;
+};
+
+void ResourceHandleManager::startCacheRevalidation(ResourceHandle* job)
+{
+    const KURL& url = job->firstRequest().url();
+    if (m_revalidatingURLs.contains(url.string()))
+        return;
+
+    // the headers, first party and cookie policy of the page's request
+    ResourceRequest request(job->firstRequest());
+    request.setCachePolicy(UseProtocolCachePolicy);
+    // as low as a prefetch in the job queue
+    request.setTargetType(ResourceRequest::TargetIsPrefetch);
+    RefPtr<HTTPCacheRevalidator> revalidator = HTTPCacheRevalidator::create(request, job);
+    if (!revalidator)
+        return;
+
+    m_revalidatingURLs.add(url.string());
+    add(revalidator.get());
+}
+
+void ResourceHandleManager::didFinishCacheRevalidation(const KURL& url)
+{
+    m_revalidatingURLs.remove(url.string());
+}
+
 void ResourceHandleManager::scheduleLoadResourceFromHTTPCache(ResourceHandle *job)
 {
+    ResourceHandleInternal* d = job->getInternal();
+    d->m_timelineCacheRead = monotonicallyIncreasingTime();
+    if (!d->m_timelineQueued) {
+        d->m_timelineQueued = d->m_timelineCacheRead;
+        d->m_timelineQueuedDate = currentTime();
+    }
+
     job->ref();
     m_readCacheJobList.append(job);
     if (!m_readCacheTimer.isActive()) {
@@ -4021,20 +5003,35 @@ void ResourceHandleManager::scheduleLoadResourceFromHTTPCache(ResourceHandle *jo
     }
 }
 
-void ResourceHandleManager::readCacheTimerCallback(Timer<ResourceHandleManager>* timer)
-{
-    ResourceHandle* job;
+// Cached bodies are delivered in chunks of this size, and one tick serves
+// up to cReadCacheBytesPerTick over several jobs, so a large cached resource
+// neither needs a body-sized buffer nor holds back the other jobs.
+static const int cReadCacheChunkSize = 32 * 1024;
+static const int cReadCacheBytesPerTick = 128 * 1024;
 
-    if (m_readCacheJobList.size() == 0)
+void ResourceHandleManager::closeCacheReadStream(ResourceHandle *job)
+{
+    ResourceHandleInternal* d = job->getInternal();
+    if (!d || !d->m_cacheReadFile)
         return;
 
-    job = m_readCacheJobList.first();
-    KURL kurl = job->firstRequest().url();
+    m_httpCache.closeForRead(d->m_cacheReadFile);
+    d->m_cacheReadFile = 0;
+    d->m_cacheReadRemaining = 0;
+}
 
-    HTTPCachedResource *resource = m_httpCache.resourceForURL(kurl);
+// returns true when the job has finished (successfully or not)
+bool ResourceHandleManager::readCacheChunk(ResourceHandle *job)
+{
     ResourceHandleInternal* d = job->getInternal();
     const Frame* frame = job->frame();
-    if (frameloaderclientwkc(job) && resource) {
+
+    if (!d->m_cacheReadFile) {
+        KURL kurl = job->firstRequest().url();
+        HTTPCachedResource *resource = m_httpCache.resourceForURL(kurl);
+        if (!frameloaderclientwkc(job) || !resource)
+            return true;
+
         if (!frameloaderclientwkc(job)->dispatchWillReceiveData(job, resource->resourceSize()))
             goto cancel;
         if (d->client() && !d->client()->willReceiveData(job, resource->resourceSize()))
@@ -4047,6 +5044,8 @@ void ResourceHandleManager::readCacheTimerCallback(Timer<ResourceHandleManager>*
         d->m_response.setSuggestedFilename(resource->suggestedFilename());
         d->m_response.setHTTPStatusCode(resource->httpStatusCode());
         d->m_response.setHTTPHeaderField("Last-Modified", resource->lastModifiedHeader());
+        if (!resource->eTagHeader().isEmpty())
+            d->m_response.setHTTPHeaderField("ETag", resource->eTagHeader());
         d->m_response.setWasCached(true);
         if (!d->client())
             goto cancel;
@@ -4061,31 +5060,59 @@ void ResourceHandleManager::readCacheTimerCallback(Timer<ResourceHandleManager>*
         if (!d->client()->willReceiveData(job, resource->contentLength()))
             goto cancel;
 
-        char *buf;
-        buf = (char*)fastMalloc(resource->contentLength());
-        if (buf) {
-            if (m_httpCache.read(resource, buf)) {
-                d->client()->didReceiveData(job, buf, resource->contentLength(), 0);
-                d->client()->didFinishLoading(job, currentTime());
-            } else {
-                d->client()->didFail(job, ResourceError(String(), CURLE_READ_ERROR, String(d->m_url), String("cache read error"), 0));
-            }
-            fastFree(buf);
+        d->m_cacheReadFile = m_httpCache.openForRead(resource);
+        if (!d->m_cacheReadFile) {
+            d->client()->didFail(job, ResourceError(String(), CURLE_READ_ERROR, String(d->m_url), String("cache read error"), 0));
+            return true;
         }
+        d->m_cacheReadRemaining = resource->contentLength();
     }
 
-    if (m_readCacheJobList.size()) {
-        m_readCacheJobList.remove(0);
-        job->deref();
-    }
+    if (d->m_cacheReadRemaining > 0) {
+        if (m_readCacheBuffer.isEmpty())
+            m_readCacheBuffer.resize(cReadCacheChunkSize);
 
-    if (m_readCacheJobList.size() == 0)
-        return;
+        int length = (d->m_cacheReadRemaining < cReadCacheChunkSize) ? (int)d->m_cacheReadRemaining : cReadCacheChunkSize;
+        int read = m_httpCache.readChunk(d->m_cacheReadFile, m_readCacheBuffer.data(), length);
+        if (read <= 0) {
+            if (d->client())
+                d->client()->didFail(job, ResourceError(String(), CURLE_READ_ERROR, String(d->m_url), String("cache read error"), 0));
+            return true;
+        }
+        d->m_cacheReadRemaining -= read;
+        if (!d->client())
+            goto cancel;
+        d->client()->didReceiveData(job, m_readCacheBuffer.data(), read, 0);
+        if (d->m_cancelled)
+            goto cancel;
+        if (d->m_cacheReadRemaining > 0)
+            return false;
+    }
 
-    if (!m_readCacheTimer.isActive())
-        m_readCacheTimer.startOneShot(pollTimeSeconds);
+    if (m_networkTimeline.enabled()) {
+        double cacheRead = (monotonicallyIncreasingTime() - d->m_timelineCacheRead) * 1000;
+        // after a 304 the load is already recorded
+        NetworkTimelineEntry* entry = m_networkTimeline.entry(d->m_timelineEntry);
+        if (entry) {
+            entry->m_fromCache = true;
+            entry->m_cacheRead = cacheRead;
+        } else {
+            NetworkTimelineEntry newEntry;
+            newEntry.m_url = job->firstRequest().url().string();
+            newEntry.m_method = job->firstRequest().httpMethod();
+            newEntry.m_status = d->m_response.httpStatusCode();
+            newEntry.m_fromCache = true;
+            newEntry.m_bodySize = d->m_response.expectedContentLength();
+            newEntry.m_startedDateTime = d->m_timelineQueuedDate;
+            newEntry.m_blocked = 0;
+            newEntry.m_cacheRead = cacheRead;
+            d->m_timelineEntry = m_networkTimeline.add(newEntry);
+        }
+    }
 
-    return;
+    if (d->client())
+        d->client()->didFinishLoading(job, currentTime());
+    return true;
 
 cancel:
     if (!d->m_cancelled) {
@@ -4094,8 +5121,51 @@ cancel:
         if (d->client())
             d->client()->didFail(job, ResourceError(String(), CURLE_READ_ERROR, String(d->m_url), String("cache read error"), 0));
     }
+    return true;
+}
 
-    if (m_readCacheJobList.size() == 0)
+void ResourceHandleManager::readCacheTimerCallback(Timer<ResourceHandleManager>* timer)
+{
+    int budget = cReadCacheBytesPerTick;
+    size_t num = 0;
+
+    while (num < m_readCacheJobList.size() && budget > 0) {
+        ResourceHandle* job = m_readCacheJobList[num];
+        // a deferred job gets its data when it is resumed
+        if (job->getInternal()->m_defersLoading) {
+            num++;
+            continue;
+        }
+        RefPtr<ResourceHandle> protect(job);
+
+        bool finished = readCacheChunk(job);
+        budget -= cReadCacheChunkSize;
+
+        // the clients may have cancelled jobs in the list
+        size_t pos = m_readCacheJobList.find(job);
+        if (pos == notFound)
+            continue;
+        if (finished) {
+            m_readCacheJobList.remove(pos);
+            closeCacheReadStream(job);
+            job->deref();
+            num = pos;
+        } else
+            num = pos + 1;
+    }
+
+    for (size_t i = 0; i < m_readCacheJobList.size(); i++) {
+        if (m_readCacheJobList[i]->getInternal()->m_defersLoading)
+            continue;
+        if (!m_readCacheTimer.isActive())
+            m_readCacheTimer.startOneShot(pollTimeSeconds);
+        return;
+    }
+}
+
+void ResourceHandleManager::resumeCacheRead(ResourceHandle *job)
+{
+    if (m_readCacheJobList.find(job) == notFound)
         return;
 
     if (!m_readCacheTimer.isActive())
@@ -4107,27 +5177,82 @@ void ResourceHandleManager::writeCacheTimerCallback(Timer<ResourceHandleManager>
     if (m_writeCacheList.size() == 0)
         return;
 
-    if (m_scheduledJobList.size() > 0 || m_runningJobList.size() > 0) {
-        m_writeCacheTimer.startOneShot(pollTimeSeconds);
+    if (!m_cacheWriter) {
+        if (m_scheduledJobList.size() > 0 || m_runningJobList.size() > 0) {
+            m_writeCacheTimer.startOneShot(pollTimeSeconds);
+            return;
+        }
+
+        HTTPCachedResource *resource;
+        resource = m_writeCacheList.first();
+
+        bool write = m_httpCache.write(resource);
+        m_writeCacheList.remove(0);
+        if (!write) {
+            delete resource;
+        }
+
+        if (m_writeCacheList.size() == 0) {
+            m_httpCache.flushJournal();
+            return;
+        }
+
+        if (!m_writeCacheTimer.isActive())
+            m_writeCacheTimer.startOneShot(pollTimeSeconds);
         return;
     }
 
-    HTTPCachedResource *resource;
-    resource = m_writeCacheList.first();
+    // the rest is handed over from cacheWriterFinished() as the writer makes progress
+    while (m_writeCacheList.size() && m_cacheWriter->canEnqueue(m_writeCacheList.first()->contentLength())) {
+        HTTPCachedResource *resource = m_writeCacheList.first();
+        m_writeCacheList.remove(0);
 
-    bool write = m_httpCache.write(resource);
-    m_writeCacheList.remove(0);
-    if (!write) {
-        delete resource;
+        // the writer thread gets its own copy of the bytes
+        SharedBuffer* data = resource->resourceData();
+        if (!data) {
+            delete resource;
+            continue;
+        }
+        String fileFullPath = m_httpCache.prepareWrite(resource);
+        if (!m_cacheWriter->enqueue(resource, fileFullPath.utf8().data(), data->data(), data->size())) {
+            m_httpCache.finishWrite(resource, false, 0);
+            delete resource;
+            continue;
+        }
+        m_writingCacheList.append(resource);
     }
+}
 
-    if (m_writeCacheList.size() == 0) {
-        m_httpCache.writeFATFile();
-        return;
+void ResourceHandleManager::cacheWriterFinishedCallback(void* data)
+{
+    // may be called after the instance is gone; always look it up again.
+    ResourceHandleManager* self = sharedInstance();
+    if (self && self->m_cacheWriter)
+        self->cacheWriterFinished();
+}
+
+void ResourceHandleManager::cacheWriterFinished()
+{
+    Vector<HTTPCacheWriter::Finished> finished;
+    m_cacheWriter->takeFinished(finished);
+
+    for (size_t i = 0; i < finished.size(); i++) {
+        HTTPCachedResource *resource = finished[i].m_resource;
+        size_t pos = m_writingCacheList.find(resource);
+        if (pos == notFound)
+            continue;
+        m_writingCacheList.remove(pos);
+        if (!m_httpCache.finishWrite(resource, finished[i].m_written, finished[i].m_digest))
+            delete resource;
     }
 
-    if (!m_writeCacheTimer.isActive())
-        m_writeCacheTimer.startOneShot(pollTimeSeconds);
+    if (m_writeCacheList.size()) {
+        if (!m_writeCacheTimer.isActive())
+            m_writeCacheTimer.startOneShot(pollTimeSeconds);
+        return;
+    }
+    if (m_writingCacheList.isEmpty())
+        m_httpCache.flushJournal();
 }
 
 void ResourceHandleManager::resetHTTPCache()
@@ -4139,6 +5264,7 @@ void ResourceHandleManager::resetHTTPCache()
     while (num--) {
         job = m_readCacheJobList[num];
         m_readCacheJobList.remove(num);
+        closeCacheReadStream(job);
         job->deref();
     }
     
@@ -4151,6 +5277,14 @@ void ResourceHandleManager::resetHTTPCache()
         m_writeCacheList.remove(num);
         delete resource;
     }
+
+    if (m_cacheWriter) {
+        // let the bodies already handed over reach the index
+        m_cacheWriter->waitForIdle();
+        cacheWriterFinished();
+        delete m_cacheWriter;
+        m_cacheWriter = 0;
+    }
     
     m_httpCache.reset();
 }
@@ -4310,4 +5444,37 @@ ResourceHandleManager::getCurrentWebSocketConnectionsNum()
 {
     return m_socketStreamHandleList.size();
 }
+
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+bool
+ResourceHandleManager::watchWebSocket(SocketStreamHandle* handle, bool write)
+{
+    if (!m_socketWatcher || !handle || handle->socket() < 0)
+        return false;
+    if (!m_socketStreamHandleList.contains(handle))
+        return false;
+
+    m_socketWatcher->watch(handle->socket(), write ? CURL_POLL_INOUT : CURL_POLL_IN, false);
+    return true;
+}
+
+void
+ResourceHandleManager::unwatchWebSocket(SocketStreamHandle* handle)
+{
+    if (!m_socketWatcher || !handle || handle->socket() < 0)
+        return;
+    m_socketWatcher->unwatch(handle->socket());
+}
+
+SocketStreamHandle*
+ResourceHandleManager::watchedWebSocket(curl_socket_t socket)
+{
+    for (size_t num = 0; num < m_socketStreamHandleList.size(); num++) {
+        SocketStreamHandle* item = m_socketStreamHandleList[num];
+        if (item && item->isWatched() && item->socket() == socket)
+            return item;
+    }
+    return 0;
+}
+#endif // ENABLE(WKC_CURL_MULTI_SOCKET)
 } // namespace WebCore
@@ -35,8 +35,15 @@
 #include "Timer.h"
 #include "ResourceHandleClient.h"
 #include "AuthenticationJarWKC.h"
+#include "CookieStoreWKC.h"
+#include "DNSResolverWKC.h"
 #include "HTTPCacheWKC.h"
+#include "HTTPCacheWriterWKC.h"
+#include "NetworkTimelineWKC.h"
 #include "SocketStreamHandle.h"
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+#include "CurlSocketWatcherWKC.h"
+#endif
 
 #if PLATFORM(WIN)
 #include <winsock2.h>
@@ -44,15 +51,38 @@
 #endif
 
 #include <curl/curl.h>
+#include <wtf/HashSet.h>
 #include <wtf/Vector.h>
 
 namespace WebCore {
 
 class ResourceHandleInternal;
 class ResourceHandleManagerSSL;
+struct SSLSessionStatistics;
 class Document;
 struct Cookie;
 
+struct HTTPConnectionStatistics {
+    // completed HTTP transfers / those which did not open a new connection
+    int m_transfers;
+    int m_reusedTransfers;
+    // sum of the time to the first response byte, in seconds
+    double m_newConnectionTTFB;
+    double m_reusedConnectionTTFB;
+    // jobs started ahead of older ones because their origin had an idle connection
+    int m_warmStarts;
+    // speculative connections opened / taken by a job / dropped unused at the deadline
+    int m_preconnects;
+    int m_usedPreconnects;
+    int m_unusedPreconnects;
+};
+
+struct DataDeliveryStatistics {
+    // chunks written by libcurl / didReceiveData calls made for them
+    int m_chunks;
+    int m_dispatches;
+};
+
 class ResourceHandleManager {
 public:
     enum ProxyType {
@@ -85,6 +115,8 @@ public:
     void setServerResponseTimeout(int sec);
     void setConnectTimeout(int sec);
     void setAcceptEncoding(const char* encodings);
+    void setHTTPPipelining(bool enable);
+    void setReceiveDataBatchSize(int bytes);
 
     // Authentication Challenge
     void didReceiveAuthenticationChallenge(ResourceHandle*, const AuthenticationChallenge&);
@@ -105,6 +137,9 @@ public:
     int CookieSerializeNum();
     int CookieSerialize(char* buff, int bufflen);
     void CookieDeserialize(const char* buff, bool restart);
+    int CookieSerializeChanges(char* buff, int bufflen);
+    // a Set-Cookie header of a response to url has been given to the jar
+    void cookieJarChanged(const KURL& url, const String& header);
     bool getRawCookies(const String &domain, const String &path, bool secure, Vector<Cookie>& rawCookies);
     void deleteCookie(const String &domain, const String &path, bool secure, const String &name);
 
@@ -132,6 +167,28 @@ public:
     // MaxTCPConnection per Window
     unsigned maximumTCPConnectionCountPerHostWindow();
 
+    void getConnectionStatistics(HTTPConnectionStatistics& stat) { m_connectionPool.getStatistics(stat); }
+
+    // Received data is handed to the client in batches
+    void didReceiveData(ResourceHandle* job, const char* data, int length);
+    void flushReceivedData(ResourceHandle* job);
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    // from setDefersLoading(): a paused transfer's socket is not watched
+    void setTransferPaused(ResourceHandle* job, bool paused);
+#endif
+    void getDataDeliveryStatistics(DataDeliveryStatistics& stat) { stat = m_dataDeliveryStat; }
+
+    // per load phase timings
+    NetworkTimeline* networkTimeline() { return &m_networkTimeline; }
+
+    // Opens a connection to the origin of url ahead of the loads which are
+    // expected to use it; does nothing when one is already open or coming.
+    void preconnect(const KURL& url);
+    void didFinishPreconnect(const String& key);
+
+    // DNS resolver; 0 when its thread could not be started
+    DNSResolver* dnsResolver() { return m_dnsResolver; }
+
     // ResourceHandleManagerSSL Class
     ResourceHandleManagerSSL* rhmssl(void){ return m_rhmssl; }
 
@@ -144,6 +201,18 @@ public:
     // Content Composition
     int contentComposition(ResourceHandle* job);
 
+    // Scheduling priority, highest first. m_scheduledJobList is kept
+    // ordered by priority and FIFO within a priority.
+    enum JobPriority {
+        EPriorityMainResource = 0,
+        EPriorityStyleSheet,
+        EPriorityScript,
+        EPriorityOther,
+        EPriorityImage,
+        EPriorityPrefetch,
+    };
+    int jobPriority(ResourceHandle* job);
+
     // OneShot m_downloadTimer
     bool oneShotDownloadTimer(void);
 
@@ -169,14 +238,23 @@ public:
     const char** getServerCertChain(const char* url, int& outCertNum);
     void freeServerCertChain(const char** chain, int num);
     void setAllowServerHost(const char *host_w_port);
+    void getSSLSessionStatistics(SSLSessionStatistics& stat);
 
 #if ENABLE(WKC_HTTPCACHE)
     // HTTPCache
     HTTPCachedResource* updateCacheResource(KURL &url, RefPtr<SharedBuffer> resourceData, ResourceResponse &response, bool noCache, bool noStore, bool mustRevalidate, double expires, double maxAge);
     bool addHTTPCache(ResourceHandle *handle, KURL &url, RefPtr<SharedBuffer> resourceData, ResourceResponse &resopnse);
     void scheduleLoadResourceFromHTTPCache(ResourceHandle *job);
+    void startCacheRevalidation(ResourceHandle* job);
+    void didFinishCacheRevalidation(const KURL& url);
     void readCacheTimerCallback(Timer<ResourceHandleManager>* timer);
+    bool readCacheChunk(ResourceHandle *job);
+    void closeCacheReadStream(ResourceHandle *job);
+    // from setDefersLoading(): a deferred job is skipped until it is resumed
+    void resumeCacheRead(ResourceHandle *job);
     void writeCacheTimerCallback(Timer<ResourceHandleManager>* timer);
+    static void cacheWriterFinishedCallback(void* data);
+    void cacheWriterFinished();
     HTTPCache* httpCache() { return &m_httpCache; }
     void clearHTTPCache();
     void resetHTTPCache();
@@ -188,6 +266,11 @@ public:
     void releaseWebSocketConnection(SocketStreamHandle*);
     bool canStartWebSocketConnecting(SocketStreamHandle* handle);
     int getCurrentWebSocketConnectionsNum();
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    // WebSocket sockets are watched together with libcurl's
+    bool watchWebSocket(SocketStreamHandle* handle, bool write);
+    void unwatchWebSocket(SocketStreamHandle* handle);
+#endif
 
     bool isMatchProxyFilter(const String& host);
 
@@ -203,6 +286,7 @@ private:
     void updateProxyAuthenticate(ResourceHandleInternal* d);
     int _downloadTimerCallback();
     void downloadTimerCallback(Timer<ResourceHandleManager>*);
+    void processCompletedTransfers();
     void removeFromCurl(ResourceHandle*);
     void startJob(ResourceHandle*);
     bool startScheduledJobs();
@@ -227,8 +311,27 @@ private:
     void setupPOST(ResourceHandle*, struct curl_slist**);
     void setupPUT(ResourceHandle*, struct curl_slist**);
     void setupOPTIONS(ResourceHandle*, struct curl_slist**);
+    void receiveDataTimerCallback(Timer<ResourceHandleManager>*);
 
     Timer<ResourceHandleManager> m_downloadTimer;
+    Timer<ResourceHandleManager> m_receiveDataTimer;
+    // 0 to hand every chunk to the client as it comes
+    int m_receiveDataBatchSize;
+    DataDeliveryStatistics m_dataDeliveryStat;
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    // curl_multi_socket_action() driven loop
+    static int curlSocketCallback(CURL* handle, curl_socket_t socket, int what, void* userp, void* socketp);
+    static int curlTimerCallback(CURLM* multi, long timeoutMs, void* userp);
+    static void socketsReadyCallback(void* data);
+    void setupMultiSocket(CURLM* multi);
+    void socketAction(curl_socket_t socket, int events);
+    void socketActionTimerCallback(Timer<ResourceHandleManager>*);
+    void socketsReady();
+    SocketStreamHandle* watchedWebSocket(curl_socket_t socket);
+
+    Timer<ResourceHandleManager> m_socketActionTimer;
+    CurlSocketWatcher* m_socketWatcher;
+#endif
     CURLM* m_curlMultiHandle;
     CURLSH* m_curlShareHandle;
     char* m_cookieJarFileName;
@@ -240,6 +343,8 @@ private:
     // delete cookie
     void doClearCookies();
 
+    CookieStore m_cookieStore;
+
     // from add() to startScheduledJobs() or cancel()
     Vector<ResourceHandle*> m_scheduledJobList;
     void appendScheduledJob(ResourceHandle*);
@@ -306,6 +411,45 @@ private:
         bool hasProhibitCharactor(String filter);
     };
 
+    // Mirrors the idle keep-alive connections libcurl most likely still
+    // holds in its connection cache, per origin, so that scheduled jobs for
+    // an origin with a warm connection can be started first.
+    class ConnectionPool {
+    public:
+        ConnectionPool();
+        ~ConnectionPool();
+
+        void setMaxIdleConnections(int number);
+        bool hasIdleConnection(const String& key);
+        void takeIdleConnection(const String& key);
+        void putIdleConnection(const String& key, bool preconnected = false);
+        void clear();
+
+        void didCompleteTransfer(bool reused, double ttfb);
+        void didWarmStart() { m_stat.m_warmStarts++; }
+        void didStartPreconnect() { m_stat.m_preconnects++; }
+        void getStatistics(HTTPConnectionStatistics& stat) { stat = m_stat; }
+
+    private:
+        void expire();
+        void removeIdleConnection(size_t index);
+
+        struct IdleConnection {
+            String m_key;
+            double m_since;
+            // opened by preconnect() and not used by any job yet
+            bool m_preconnected;
+        };
+        // oldest first
+        Vector<IdleConnection> m_idleConnections;
+        int m_maxIdleConnections;
+        HTTPConnectionStatistics m_stat;
+    };
+    String connectionKey(ResourceHandle* job, const KURL& url);
+    bool hasJobForConnection(const String& key);
+    void recordTransferTimeline(ResourceHandle* job);
+    void didCompleteTransfer(ResourceHandle* job, CURLcode result);
+
 private:
     ResourceHandleManagerSSL* m_rhmssl;
 
@@ -316,6 +460,14 @@ private:
     ProxyType m_proxyType;
     ProxyFilter m_proxyFilters;
 
+    ConnectionPool m_connectionPool;
+    // origins preconnect() is connecting to
+    HashSet<String> m_preconnectingOrigins;
+    bool m_httpPipelining;
+
+    DNSResolver* m_dnsResolver;
+    NetworkTimeline m_networkTimeline;
+
     // cookie
     bool m_cookiesDeleting;
     int m_cookieMaxEntries;
@@ -350,8 +502,14 @@ private:
     HTTPCache m_httpCache;
     Timer<ResourceHandleManager> m_readCacheTimer;
     Vector<ResourceHandle*> m_readCacheJobList;
+    Vector<char> m_readCacheBuffer;
     Timer<ResourceHandleManager> m_writeCacheTimer;
     Vector<HTTPCachedResource*> m_writeCacheList;
+    // handed to m_cacheWriter, not yet finished
+    HTTPCacheWriter* m_cacheWriter;
+    Vector<HTTPCachedResource*> m_writingCacheList;
+    // URLs being revalidated in the background
+    HashSet<String> m_revalidatingURLs;
 #endif
 
     // SocketStreamHandle
@@ -26,6 +26,7 @@
 #include "config.h"
 
 #include "CString.h"
+#include "CurrentTime.h"
 #include "ResourceHandle.h"
 #include "ResourceHandleInternalWKC.h"
 #include "ResourceHandleManagerWKC.h"
@@ -40,6 +41,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #if !PLATFORM(WIN_OS)
 #include <sys/param.h>
@@ -56,6 +58,7 @@
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/pkcs12.h>
+#include <openssl/err.h>
 
 #include <stdarg.h>
 #include <peer_openssl.h>
@@ -394,9 +397,14 @@ ResourceHandleManagerSSL::ResourceHandleManagerSSL(ResourceHandleManager* rhm, C
     : m_curlMultiHandle(curlMultiHandle)
     , m_curlShareHandle(curlShareHandle)
     , m_rhm(rhm)
+    , m_verifyStore(0)
+    , m_sslSessionKeyIndex(-1)
+    , m_sslSessionOfferIndex(-1)
 {
     RHMSSL_DP(("<rhmssl>ResourceHandleManagerSSL()"));
 
+    memset(&m_sslSessionStat, 0, sizeof(m_sslSessionStat));
+
     RAND_pseudo_bytes(gMagic, RHMSSL_AES_LEN);
     RAND_pseudo_bytes(gIV, RHMSSL_AES_LEN);
 
@@ -429,7 +437,8 @@ ResourceHandleManagerSSL::~ResourceHandleManagerSSL()
     if (m_ocsp_handle)
         curl_easy_cleanup(m_ocsp_handle);
 
-    clearRootCACache();
+    clearSSLSessions();
+    clearVerifyStore();
     m_serverCertChain.clear();
     m_clientCertCache.clear();
     SSLClientCertDeleteAll();
@@ -541,6 +550,14 @@ ssl_app_verify_callback(X509_STORE_CTX *ctx, void *data)
 static void
 ssl_cert_request_callback(const SSL *ssl, int type, int val)
 {
+    if (type == SSL_CB_HANDSHAKE_START) {
+        ResourceHandleManager::sharedInstance()->rhmssl()->sslHandshakeStarted(const_cast<SSL*>(ssl));
+        return;
+    }
+    if (type == SSL_CB_HANDSHAKE_DONE) {
+        ResourceHandleManager::sharedInstance()->rhmssl()->sslHandshakeDone(const_cast<SSL*>(ssl));
+        return;
+    }
     if (type != SSL_CB_CONNECT_LOOP || val != 1)
         return;
 
@@ -578,6 +595,7 @@ sslctx_callback(CURL* handle, void* sslctx, void* data)
 
     SSL_CTX_set_info_callback(sslCtx, ssl_cert_request_callback);
     SSL_CTX_set_app_data(sslCtx, job);
+    ResourceHandleManager::sharedInstance()->rhmssl()->setSSLSessionKey(sslCtx, SSLhostAndPort(kurl), d->m_enableOCSP, d->m_enableCRLDP);
     SSL_CTX_set_verify(sslCtx, SSL_CTX_get_verify_mode(sslCtx), ssl_verify_callback);
     //SSL_CTX_set_cert_verify_callback(sslCtx, ssl_app_verify_callback, data);
 
@@ -590,8 +608,7 @@ sslctx_callback(CURL* handle, void* sslctx, void* data)
     if (d->m_enableCRLDP) online_check_flag |= X509_V_FLAG_CHECK_CRLDP;
     X509_VERIFY_PARAM_set_flags(sslCtx->param, online_check_flag);
 
-    X509_STORE* store = SSL_CTX_get_cert_store(sslCtx);
-    if (!ResourceHandleManager::sharedInstance()->rhmssl()->exportRootCACacheIntoStore(store))
+    if (!ResourceHandleManager::sharedInstance()->rhmssl()->attachVerifyStore(sslCtx))
         return CURLE_OUT_OF_MEMORY;
 
     return CURLE_OK;
@@ -608,9 +625,8 @@ void ResourceHandleManagerSSL::initializeHandleSSL(ResourceHandle* job)
     ResourceHandleInternal* d = job->getInternal();
     KURL kurl = job->firstRequest().url();
 
+    // root CAs and CRLs come from the shared store; see attachVerifyStore()
     curl_easy_setopt(d->m_handle, CURLOPT_CAINFO, NULL);
-    if (wkcOsslCRLIsRegistPeer())
-        curl_easy_setopt(d->m_handle, CURLOPT_CRLFILE, WKCOSSL_CRL_FILE);
 
     curl_easy_setopt(d->m_handle, CURLOPT_RANDOM_FILE, WKCOSSL_RANDFILE);
 
@@ -1005,16 +1021,20 @@ void ResourceHandleManagerSSL::ClientCertSelectCallback(void *data)
 void* ResourceHandleManagerSSL::SSLRegisterRootCA(const char* cert, int cert_len)
 {
     void* certid = wkcSSLRegisterRootCAPeer(cert, cert_len);
-    if (certid)
-        clearRootCACache();
+    if (certid) {
+        clearVerifyStore();
+        clearSSLSessions();
+    }
     return certid;
 }
 
 int ResourceHandleManagerSSL::SSLUnregisterRootCA(void* certid)
 {
     int ret = wkcSSLUnregisterRootCAPeer(certid);
-    if (ret == 0)
-        clearRootCACache();
+    if (ret == 0) {
+        clearVerifyStore();
+        clearSSLSessions();
+    }
     return ret;
 }
 
@@ -1039,6 +1059,10 @@ void* ResourceHandleManagerSSL::SSLRegisterRootCAByDER(const char* cert, int cer
 
     BIO_get_mem_ptr(bio, &buf);
     ret = wkcSSLRegisterRootCAPeer(buf->data, buf->length);
+    if (ret) {
+        clearVerifyStore();
+        clearSSLSessions();
+    }
 
 end:
     if (x) X509_free(x);
@@ -1050,38 +1074,185 @@ end:
 void ResourceHandleManagerSSL::SSLRootCADeleteAll(void)
 {
     wkcSSLRootCADeleteAllPeer();
-    clearRootCACache();
+    clearVerifyStore();
+    clearSSLSessions();
 }
 
-bool ResourceHandleManagerSSL::buildRootCACache()
+//
+// TLS session cache
+//
+// libcurl keeps a handful of sessions in the share handle; this keeps more,
+// for longer, and counts how often handshakes are resumed. A session is
+// offered as soon as libcurl creates the SSL, before the handshake; a
+// session libcurl sets afterwards wins.
+// A resumed handshake skips verification, so a session is only offered
+// under the settings it was verified with, and sessions made without
+// verification or with a client certificate are not kept at all.
+//
+static void sslSessionKeyFree(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp)
 {
-    ASSERT(m_rootCACache.isEmpty());
+    if (ptr)
+        fastFree(ptr);
+}
 
-    // load cert using wkcOsslCertfOpenPeer() etc.
+// called by SSL_new() once the SSL has its SSL_CTX
+static int sslSessionOffer(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp)
+{
+    if (parent && ResourceHandleManager::sharedInstance())
+        ResourceHandleManager::sharedInstance()->rhmssl()->offerSSLSession(static_cast<SSL*>(parent));
+    return 1;
+}
+
+void ResourceHandleManagerSSL::setSSLSessionKey(SSL_CTX* ctx, const String& hostAndPort, bool enableOCSP, bool enableCRLDP)
+{
+    if (m_sslSessionKeyIndex < 0) {
+        m_sslSessionKeyIndex = SSL_CTX_get_ex_new_index(0, 0, 0, 0, sslSessionKeyFree);
+        if (m_sslSessionKeyIndex < 0)
+            return;
+    }
+    if (m_sslSessionOfferIndex < 0)
+        m_sslSessionOfferIndex = SSL_get_ex_new_index(0, 0, sslSessionOffer, 0, 0);
+    char* old = static_cast<char*>(SSL_CTX_get_ex_data(ctx, m_sslSessionKeyIndex));
+    if (old)
+        fastFree(old);
+
+    // No key, no caching. libcurl has set the verify mode from
+    // CURLOPT_SSL_VERIFYPEER before calling back, whether it was turned off
+    // for an allowed host or for a reconnect after a failed handshake.
+    if (!(SSL_CTX_get_verify_mode(ctx) & SSL_VERIFY_PEER)) {
+        SSL_CTX_set_ex_data(ctx, m_sslSessionKeyIndex, 0);
+        return;
+    }
+    String key = hostAndPort.lower() + "\t" + String::number(m_enableVersion) + (enableOCSP ? "\tOCSP" : "\t") + (enableCRLDP ? "\tCRLDP" : "\t");
+    SSL_CTX_set_ex_data(ctx, m_sslSessionKeyIndex, fastStrdup(key.utf8().data()));
+}
+
+const char* ResourceHandleManagerSSL::sslSessionKey(SSL* ssl)
+{
+    if (m_sslSessionKeyIndex < 0)
+        return 0;
+    return static_cast<const char*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), m_sslSessionKeyIndex));
+}
+
+void ResourceHandleManagerSSL::offerSSLSession(SSL* ssl)
+{
+    const char* key = sslSessionKey(ssl);
+    if (!key)
+        return;
+
+    HashMap<String, SSLSessionEntry>::iterator it = m_sslSessions.find(String(key));
+    if (it == m_sslSessions.end())
+        return;
+
+    SSL_SESSION* session = it->second.m_session;
+    if ((long)time(0) > SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session)) {
+        SSL_SESSION_free(session);
+        m_sslSessions.remove(it);
+        return;
+    }
+
+    if (SSL_set_session(ssl, session))
+        it->second.m_lastUsed = currentTime();
+}
+
+void ResourceHandleManagerSSL::sslHandshakeStarted(SSL* ssl)
+{
+    SSL_SESSION* session = SSL_get_session(ssl);
+    if (!session) {
+        m_sslSessionStat.m_misses++;
+        return;
+    }
+
+    const char* key = sslSessionKey(ssl);
+    if (key) {
+        HashMap<String, SSLSessionEntry>::iterator it = m_sslSessions.find(String(key));
+        if (it != m_sslSessions.end() && it->second.m_session == session) {
+            m_sslSessionStat.m_hits++;
+            return;
+        }
+    }
+    m_sslSessionStat.m_curlHits++;
+}
+
+void ResourceHandleManagerSSL::sslHandshakeDone(SSL* ssl)
+{
+    m_sslSessionStat.m_handshakes++;
+    if (SSL_session_reused(ssl)) {
+        m_sslSessionStat.m_resumedHandshakes++;
+        return;
+    }
+
+    const char* key = sslSessionKey(ssl);
+    if (!key)
+        return;
+    // only sessions whose server certificate was verified and accepted
+    if (!(SSL_get_verify_mode(ssl) & SSL_VERIFY_PEER) || SSL_get_verify_result(ssl) != X509_V_OK)
+        return;
+    // would let a later handshake present the certificate without asking
+    if (SSL_get_certificate(ssl))
+        return;
+    SSL_SESSION* session = SSL_get1_session(ssl);
+    if (!session)
+        return;
+
+    String sessionKey(key);
+    HashMap<String, SSLSessionEntry>::iterator it = m_sslSessions.find(sessionKey);
+    if (it != m_sslSessions.end()) {
+        SSL_SESSION_free(it->second.m_session);
+        m_sslSessions.remove(it);
+    } else if (m_sslSessions.size() >= cMaxSSLSessions) {
+        // the least recently used one goes
+        HashMap<String, SSLSessionEntry>::iterator oldest = m_sslSessions.begin();
+        HashMap<String, SSLSessionEntry>::iterator end = m_sslSessions.end();
+        for (HashMap<String, SSLSessionEntry>::iterator i = m_sslSessions.begin(); i != end; ++i) {
+            if (i->second.m_lastUsed < oldest->second.m_lastUsed)
+                oldest = i;
+        }
+        SSL_SESSION_free(oldest->second.m_session);
+        m_sslSessions.remove(oldest);
+        m_sslSessionStat.m_evictions++;
+    }
+
+    SSLSessionEntry entry;
+    entry.m_session = session;
+    entry.m_lastUsed = currentTime();
+    m_sslSessions.set(sessionKey, entry);
+}
+
+void ResourceHandleManagerSSL::clearSSLSessions()
+{
+    HashMap<String, SSLSessionEntry>::iterator end = m_sslSessions.end();
+    for (HashMap<String, SSLSessionEntry>::iterator it = m_sslSessions.begin(); it != end; ++it)
+        SSL_SESSION_free(it->second.m_session);
+    m_sslSessions.clear();
+}
+
+static bool addPEMFileIntoStore(X509_STORE* store, const char* path)
+{
     STACK_OF(X509_INFO) *inf;
     X509_INFO *itmp;
     BIO *in;
     int i, ret = false;
 
-    if (!wkcOsslCertfIsRegistPeer())
-        return true;
-
-    in = BIO_new_file(WKCOSSL_CERT_FILE, "r");
+    in = BIO_new_file(path, "r");
     if (!in)
         return false;
     inf = PEM_X509_INFO_read_bio(in, NULL, NULL, NULL);
     BIO_free(in);
     if (!inf)
         return false;
-    for(i = 0; i < sk_X509_INFO_num(inf); i++) {
+    for (i = 0; i < sk_X509_INFO_num(inf); i++) {
         itmp = sk_X509_INFO_value(inf, i);
-        ASSERT(itmp->x509);
-        X509* clone = X509_dup(itmp->x509);
-        if (!clone) {
-            clearRootCACache();
-            goto end;
+        if (itmp->x509 && !X509_STORE_add_cert(store, itmp->x509)) {
+            if (ERR_GET_REASON(ERR_peek_last_error()) != X509_R_CERT_ALREADY_IN_HASH_TABLE)
+                goto end;
+            ERR_clear_error();
+        }
+        if (itmp->crl && !X509_STORE_add_crl(store, itmp->crl)) {
+            if (ERR_GET_REASON(ERR_peek_last_error()) != X509_R_CERT_ALREADY_IN_HASH_TABLE)
+                goto end;
+            ERR_clear_error();
         }
-        m_rootCACache.append(clone);
     }
     ret = true;
 end:
@@ -1089,49 +1260,79 @@ end:
     return ret;
 }
 
-bool ResourceHandleManagerSSL::exportRootCACacheIntoStore(X509_STORE* store)
+bool ResourceHandleManagerSSL::buildVerifyStore()
 {
-    ASSERT(store);
+    ASSERT(!m_verifyStore);
+
+    X509_STORE* store = X509_STORE_new();
+    if (!store)
+        return false;
 
-    if (m_rootCACache.isEmpty()) {
-        if (!buildRootCACache())
+    // load cert using wkcOsslCertfOpenPeer() etc.
+    if (wkcOsslCertfIsRegistPeer() && !addPEMFileIntoStore(store, WKCOSSL_CERT_FILE)) {
+        X509_STORE_free(store);
+        return false;
+    }
+    if (wkcOsslCRLIsRegistPeer()) {
+        if (!addPEMFileIntoStore(store, WKCOSSL_CRL_FILE)) {
+            X509_STORE_free(store);
             return false;
+        }
+        // as libcurl does for CURLOPT_CRLFILE
+        X509_STORE_set_flags(store, X509_V_FLAG_CRL_CHECK | X509_V_FLAG_CRL_CHECK_ALL);
     }
 
-    Vector<X509*>::const_iterator it  = m_rootCACache.begin();
-    Vector<X509*>::const_iterator end = m_rootCACache.end();
-    for (; it != end; ++it) {
-        if (!X509_STORE_add_cert(store, *it))
+    m_verifyStore = store;
+    return true;
+}
+
+bool ResourceHandleManagerSSL::attachVerifyStore(SSL_CTX* ctx)
+{
+    ASSERT(ctx);
+
+    if (!m_verifyStore) {
+        if (!buildVerifyStore())
             return false;
     }
 
+    // the SSL_CTX releases its reference when it is freed
+    CRYPTO_add(&m_verifyStore->references, 1, CRYPTO_LOCK_X509_STORE);
+    SSL_CTX_set_cert_store(ctx, m_verifyStore);
     return true;
 }
 
-void ResourceHandleManagerSSL::clearRootCACache()
+void ResourceHandleManagerSSL::clearVerifyStore()
 {
-    Vector<X509*>::const_iterator it  = m_rootCACache.begin();
-    Vector<X509*>::const_iterator end = m_rootCACache.end();
-    for (; it != end; ++it) {
-        X509_free(*it);
+    // connections still holding the old store keep it alive
+    if (m_verifyStore) {
+        X509_STORE_free(m_verifyStore);
+        m_verifyStore = 0;
     }
-    m_rootCACache.clear();
 }
 
 // CRL
 void* ResourceHandleManagerSSL::SSLRegisterCRL(const char* crl, int crl_len)
 {
-    return wkcSSLRegisterCRLPeer(crl, crl_len);
+    void* crlid = wkcSSLRegisterCRLPeer(crl, crl_len);
+    if (crlid) {
+        clearVerifyStore();
+        clearSSLSessions();
+    }
+    return crlid;
 }
 
 int ResourceHandleManagerSSL::SSLUnregisterCRL(void* crlid)
 {
-    return wkcSSLUnregisterCRLPeer(crlid);
+    int ret = wkcSSLUnregisterCRLPeer(crlid);
+    if (ret == 0)
+        clearVerifyStore();
+    return ret;
 }
 
 void ResourceHandleManagerSSL::SSLCRLDeleteAll(void)
 {
-    return wkcSSLCRLDeleteAllPeer();
+    wkcSSLCRLDeleteAllPeer();
+    clearVerifyStore();
 }
 
 // Client Certificate
@@ -1169,6 +1370,7 @@ int ResourceHandleManagerSSL::SSLUnregisterClientCert(void* certid)
             m_clientCerts.remove(cert);
             deleteClientCertCache(cert);
             delete cert;
+            clearSSLSessions();
             return 0;
         }
     }
@@ -1187,6 +1389,7 @@ void ResourceHandleManagerSSL::SSLClientCertDeleteAll(void)
         delete clicert;
     }
     m_clientCerts.clear();
+    clearSSLSessions();
 }
 
 // Certificate Black List
@@ -1237,6 +1440,8 @@ bool ResourceHandleManagerSSL::SSLRegisterBlackCert(const char* issuerCommonName
     }
 
     m_certBlackList.add(black);
+    // a resumed session would skip the check
+    clearSSLSessions();
     return true;
 }
 
@@ -1354,6 +1559,8 @@ void ResourceHandleManagerSSL::SSLEVSSLOIDDeleteAll(void)
 bool ResourceHandleManagerSSL::isWellKnownTrustedEVCert(const char *server_name, ASN1_INTEGER *serial, const unsigned char *sha1, const char *server_oid)
 {
     RootCA_OID* oid;
+    String name(server_name);
+    String oidString(server_oid);
 
     HashSet<RootCA_OID*>::const_iterator it  = m_rootOIDList.begin();
     HashSet<RootCA_OID*>::const_iterator end = m_rootOIDList.end();
@@ -1364,9 +1571,9 @@ bool ResourceHandleManagerSSL::isWellKnownTrustedEVCert(const char *server_name,
             continue;
         if (memcmp(oid->fingerprint, sha1, 20))
             continue;
-        if (oid->issuerCommonName != String(server_name))
+        if (oid->issuerCommonName != name)
             continue;
-        if (oid->OID != String(server_oid))
+        if (oid->OID != oidString)
             continue;
 
         return true;
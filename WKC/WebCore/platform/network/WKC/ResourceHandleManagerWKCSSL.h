@@ -35,6 +35,7 @@
 #endif
 
 #include <curl/curl.h>
+#include <openssl/ssl.h>
 #include <openssl/x509v3.h>
 
 namespace WebCore {
@@ -102,6 +103,18 @@ public:
     int serial_len;
 };
 
+struct SSLSessionStatistics {
+    // completed TLS handshakes, and how many of them resumed a session
+    int m_handshakes;
+    int m_resumedHandshakes;
+    // handshakes offered a session by libcurl / by our cache / by neither
+    int m_curlHits;
+    int m_hits;
+    int m_misses;
+    // sessions dropped to make room
+    int m_evictions;
+};
+
 class ResourceHandleManagerSSL {
 public:
     static ResourceHandleManagerSSL* create(ResourceHandleManager* rhm, CURLM* curlMultiHandle, CURLSH* curlShareHandle);
@@ -125,7 +138,8 @@ public:
     void* SSLRegisterRootCAByDER(const char* cert, int cert_len);
     int   SSLUnregisterRootCA(void* certid);
     void  SSLRootCADeleteAll(void);
-    bool  exportRootCACacheIntoStore(X509_STORE* store);
+    // shares the verification store with an SSL_CTX of libcurl
+    bool  attachVerifyStore(SSL_CTX* ctx);
 
     // CRL
     void* SSLRegisterCRL(const char* crl, int crl_len);
@@ -162,6 +176,14 @@ public:
     // Enable Online Certificate Check
     void SSLEnableOnlineCertChecks(bool enableOCSP, bool enableCRLDP);
 
+    // TLS session cache
+    void setSSLSessionKey(SSL_CTX* ctx, const String& hostAndPort, bool enableOCSP, bool enableCRLDP);
+    void offerSSLSession(SSL* ssl);
+    void sslHandshakeStarted(SSL* ssl);
+    void sslHandshakeDone(SSL* ssl);
+    void clearSSLSessions();
+    void getSSLSessionStatistics(SSLSessionStatistics& stat) { stat = m_sslSessionStat; }
+
 private:
     ResourceHandleManagerSSL(ResourceHandleManager* rhm, CURLM* curlMultiHandle, CURLSH* curlShareHandle);
     bool construct();
@@ -176,10 +198,11 @@ private:
     // Allows Server Host
     HashSet<String> m_AllowServerHost;
 
-    // Root CA Cache
-    Vector<X509*> m_rootCACache;
-    bool buildRootCACache();
-    void clearRootCACache();
+    // Root CAs and CRLs, loaded once and shared by every SSL_CTX.
+    // Never modified once built; replaced when the trust material changes.
+    X509_STORE* m_verifyStore;
+    bool buildVerifyStore();
+    void clearVerifyStore();
 
     // Server Certificate Chain
     static const int cMaxChains = 32;
@@ -206,6 +229,19 @@ private:
     bool m_enableOCSP;
     bool m_enableCRLDP;
     CURL *m_ocsp_handle;
+
+    // TLS sessions by host:port and verification settings, in addition to
+    // the few libcurl keeps
+    struct SSLSessionEntry {
+        SSL_SESSION* m_session;
+        double m_lastUsed;
+    };
+    static const int cMaxSSLSessions = 32;
+    HashMap<String, SSLSessionEntry> m_sslSessions;
+    SSLSessionStatistics m_sslSessionStat;
+    int m_sslSessionKeyIndex;
+    int m_sslSessionOfferIndex;
+    const char* sslSessionKey(SSL* ssl);
 };
 
 }
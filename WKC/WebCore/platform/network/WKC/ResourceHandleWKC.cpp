@@ -151,6 +151,10 @@ ResourceHandleInternal::~ResourceHandleInternal()
         curl_slist_free_all(m_customHeaders);
         m_customHeaders = 0;
     }
+    if (m_resolveList) {
+        curl_slist_free_all(m_resolveList);
+        m_resolveList = 0;
+    }
 
     m_client = 0;
 }
@@ -244,25 +248,38 @@ void ResourceHandle::setDefersLoading(bool defers)
         return;
 
 #if LIBCURL_VERSION_NUM > 0x071200
-    if (!d->m_handle)
+    if (!d->m_handle) {
         d->m_defersLoading = defers;
-    else if (defers) {
+#if ENABLE(WKC_HTTPCACHE)
+        if (!defers)
+            ResourceHandleManager::sharedInstance()->resumeCacheRead(this);
+#endif
+    } else if (defers) {
         CURLcode error = curl_easy_pause(d->m_handle, CURLPAUSE_ALL);
         // If we could not defer the handle, so don't do it.
         if (error != CURLE_OK)
             return;
 
         d->m_defersLoading = defers;
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+        ResourceHandleManager::sharedInstance()->setTransferPaused(this, true);
+#endif
     } else {
         // We need to set defersLoading before restarting a connection
         // or libcURL will call the callbacks in curl_easy_pause and
         // we would ASSERT.
         d->m_defersLoading = defers;
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+        // before CURLPAUSE_CONT, which may update the socket right away
+        ResourceHandleManager::sharedInstance()->setTransferPaused(this, false);
+#endif
 
         CURLcode error = curl_easy_pause(d->m_handle, CURLPAUSE_CONT);
         if (error != CURLE_OK)
             // Restarting the handle has failed so just cancel it.
             cancel();
+        else
+            ResourceHandleManager::sharedInstance()->flushReceivedData(this);
     }
 #else
     d->m_defersLoading = defers;
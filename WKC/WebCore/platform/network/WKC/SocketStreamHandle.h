@@ -72,6 +72,13 @@ namespace WebCore {
         };
         int socketState() const { return m_socketState; }
 
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+        // readiness of the socket, reported by the ResourceHandleManager's socket watcher
+        int socket() const { return m_socket; }
+        bool isWatched() const { return m_watched; }
+        void socketReady(int events);
+#endif
+
     protected:
         virtual int platformSend(const char* data, int length);
         virtual void platformClose();
@@ -99,6 +106,12 @@ namespace WebCore {
         void nextProgress(bool refresh);
         float m_interval;
         unsigned int m_lastUpdate;
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+        // once open, the socket is watched instead of polled by m_progressTimer
+        bool m_watched;
+        void watchSocket(bool write);
+        void unwatchSocket();
+#endif
 
         bool m_isProxy;
         const static int m_recvDataLen = 32768;
@@ -106,6 +119,7 @@ namespace WebCore {
 
         void* m_handle;      // CURL handle
         void* m_multiHandle; // CURLM handle
+        void* m_resolveList; // CURLOPT_RESOLVE list
     };
 
 }  // namespace WebCore
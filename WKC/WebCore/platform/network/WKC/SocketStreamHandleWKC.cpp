@@ -69,10 +69,14 @@ SocketStreamHandle::SocketStreamHandle(const KURL& url, SocketStreamHandleClient
     , m_progressTimer(this, &SocketStreamHandle::progressTimerFired)
     , m_interval(BASE_INTERVAL)
     , m_lastUpdate(0)
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    , m_watched(false)
+#endif
     , m_isProxy(false)
     , m_recvData(0)
     , m_handle(0)
     , m_multiHandle(0)
+    , m_resolveList(0)
 {
     LOG(Network, "SocketStreamHandle %p new client %p", this, m_client);
     construct();
@@ -121,6 +125,16 @@ static curl_socket_t opensocketcallback(void *clientp, curlsocktype purpose, str
     return handle->OpenSocketCallback((void*)address);
 }
 
+static CURLcode sslctxcallback(CURL* handle, void* sslctx, void* data)
+{
+    ResourceHandleManager* rhm = ResourceHandleManager::sharedInstance();
+    if (!rhm || !rhm->rhmssl())
+        return CURLE_OK;
+    if (!rhm->rhmssl()->attachVerifyStore(static_cast<SSL_CTX*>(sslctx)))
+        return CURLE_OUT_OF_MEMORY;
+    return CURLE_OK;
+}
+
 bool SocketStreamHandle::isClosingSocketStreamChannel(void)
 {
     if (m_client)
@@ -202,10 +216,9 @@ void SocketStreamHandle::construct(void)
     if (equalIgnoringCase(m_url.protocol(), "wss")) {
         httpurl.setProtocol("https");
 
-        if (wkcOsslCertfIsRegistPeer())
-            curl_easy_setopt(handle, CURLOPT_CAINFO, WKCOSSL_CERT_FILE);
-        if (wkcOsslCRLIsRegistPeer())
-            curl_easy_setopt(handle, CURLOPT_CRLFILE, WKCOSSL_CRL_FILE);
+        // root CAs and CRLs come from the store shared with the resource handles
+        curl_easy_setopt(handle, CURLOPT_CAINFO, NULL);
+        curl_easy_setopt(handle, CURLOPT_SSL_CTX_FUNCTION, sslctxcallback);
 
         curl_easy_setopt(handle, CURLOPT_RANDOM_FILE, WKCOSSL_RANDFILE);
 
@@ -263,6 +276,14 @@ void SocketStreamHandle::construct(void)
         curl_easy_setopt(handle, CURLOPT_HTTPPROXYTUNNEL, 1L);
         m_isProxy = true;
     }
+    else if (rhm->dnsResolver()) {
+        int port = m_url.hasPort() ? m_url.port() : (equalIgnoringCase(httpurl.protocol(), "https") ? 443 : 80);
+        struct curl_slist* list = rhm->dnsResolver()->resolveList(m_url.host(), port);
+        if (list) {
+            curl_easy_setopt(handle, CURLOPT_RESOLVE, list);
+            m_resolveList = (void*)list;
+        }
+    }
 
     // connect only
     curl_easy_setopt(handle, CURLOPT_CONNECT_ONLY, 1L);
@@ -296,6 +317,11 @@ void SocketStreamHandle::nextProgress(bool refresh)
 
     _LOG(Network, "SocketStreamHandle %p nextProgress(%s)", this, (refresh)?"true":"false");
 
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    if (m_watched)
+        return;
+#endif
+
     if (refresh) {
         m_lastUpdate = wkcGetTickCountPeer();
         m_interval = BASE_INTERVAL;
@@ -367,9 +393,12 @@ SocketStreamHandle::progressTimerFired(Timer<SocketStreamHandle>* timer)
         // socket opened
         RefPtr<SocketStreamHandle> protect(static_cast<SocketStreamHandle*>(this)); // platformClose calls the client, which may make the handle get deallocated immediately.
         m_state = Open;
+        m_socketState = Connected;
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+        watchSocket(false);
+#endif
         if (m_client)
             m_client->didOpenSocketStream(this);
-        m_socketState = Connected;
         nextProgress(true); 
         break;
     }
@@ -500,10 +529,86 @@ int SocketStreamHandle::platformSend(const char* data, int len)
         return -1;
     }
 
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    // what is not written now is buffered by SocketStreamHandleBase
+    if (m_watched)
+        watchSocket(outLen < len);
+#endif
     nextProgress(true);
     return outLen;
 }
 
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+void SocketStreamHandle::watchSocket(bool write)
+{
+    ResourceHandleManager* rhm = ResourceHandleManager::sharedInstance();
+    if (!rhm || m_socket < 0)
+        return;
+    m_watched = rhm->watchWebSocket(this, write);
+    if (m_watched && m_progressTimer.isActive())
+        m_progressTimer.stop();
+}
+
+void SocketStreamHandle::unwatchSocket()
+{
+    if (!m_watched)
+        return;
+    m_watched = false;
+    ResourceHandleManager* rhm = ResourceHandleManager::sharedInstance();
+    if (rhm)
+        rhm->unwatchWebSocket(this);
+}
+
+void SocketStreamHandle::socketReady(int events)
+{
+    if (!m_watched || !m_handle || m_socket < 0)
+        return;
+
+    _LOG(Network, "SocketStreamHandle %p socketReady(%d)", this, events);
+
+    RefPtr<SocketStreamHandle> protect(static_cast<SocketStreamHandle*>(this)); // platformClose calls the client, which may make the handle get deallocated immediately.
+    m_socketState = Active;
+
+    // platformSend() stops watching for writability once the buffer is empty
+    if ((events & CURL_CSELECT_OUT) && (bufferedAmount() || m_state == Closing)) {
+        if (!sendPendingData() && m_state == Open && m_client)
+            m_client->didFailSocketStream(this, SocketStreamError(-1));
+    }
+
+    if (!(events & (CURL_CSELECT_IN | CURL_CSELECT_ERR)))
+        return;
+
+    // drain everything available, including what TLS has already decrypted
+    while (m_watched && m_handle && m_socket != -1) {
+        size_t inoutLen = 0;
+        CURLcode ret = curl_easy_recv((CURL*)m_handle, m_recvData, m_recvDataLen, &inoutLen);
+        if (CURLE_OK == ret) {
+            _LOG(Network, "SocketStreamHandle::socketReady() Recved(%d)", inoutLen);
+            if (0 < inoutLen && m_client)
+                m_client->didReceiveSocketStreamData(this, (const char*)m_recvData, inoutLen);
+            if (inoutLen==0)
+                break;
+        } else if (CURLE_AGAIN == ret) {
+            _LOG(Network, "SocketStreamHandle::socketReady() Recv AGAIN");
+            break;
+        } else if (CURLE_UNSUPPORTED_PROTOCOL == ret) {
+            // FIN recv
+            _LOG(Network, "SocketStreamHandle::socketReady() Recv FIN");
+            unwatchSocket();
+            if (m_client)
+                m_client->didFailSocketStream(this, SocketStreamError(-1));
+            break;
+        } else {
+            _LOG(Network, "SocketStreamHandle::socketReady() Recv ERROR(%d)", ret);
+            unwatchSocket();
+            if (m_client)
+                m_client->didFailSocketStream(this, SocketStreamError(-1));
+            break;
+        }
+    }
+}
+#endif // ENABLE(WKC_CURL_MULTI_SOCKET)
+
 void SocketStreamHandle::platformClose()
 {
     _LOG(Network, "SocketStreamHandle %p platformClose()", this);
@@ -516,11 +621,18 @@ void SocketStreamHandle::platformClose()
     if (!m_handle || !m_multiHandle) {
         return;
     }
+#if ENABLE(WKC_CURL_MULTI_SOCKET)
+    unwatchSocket();
+#endif
 
     _LOG(Network, "SocketStreamHandle::platformClose() cleanup cURL");
     curl_multi_remove_handle(multiHandle, handle);
     curl_easy_cleanup(handle);
     curl_multi_cleanup(multiHandle);
+    if (m_resolveList) {
+        curl_slist_free_all((struct curl_slist*)m_resolveList);
+        m_resolveList = 0;
+    }
     if (0 < m_socket)
         wkcNetClosePeer(m_socket);
 
@@ -26,6 +26,7 @@
 #include "WKCWebView.h"
 
 #include "CString.h"
+#include "DownloadFileWriterWKC.h"
 #include "Noncopyable.h"
 #include "NotImplemented.h"
 #include "ResourceError.h"
@@ -54,6 +55,7 @@ public:
 
     bool setResponse(WebCore::ResourceHandle*, const WebCore::ResourceResponse&);
     bool start();
+    bool startToFile(const char* path, bool resume);
     void cancel();
     const char* getUri() const;
     const char* getSuggestedFilename() const;
@@ -77,9 +79,16 @@ private:
 
     void setStatus(int);
 
+    // download to a file
+    bool openFile(long long offset);
+    bool closeFile();
+    void failWithFileError();
+    static void writerNotify(void*);
+
 private:
     friend class WKCDownloadClientPrivate;
     void setResponseInfo(const WebCore::ResourceResponse&);
+    void notifyReceivedResponse(const WebCore::ResourceResponse&);
     void notifyReceivedData(const char* data, size_t length);
     void notifyFinishedLoading();
     void notifyErrorInLoading(const WebCore::ResourceError& error);
@@ -103,6 +112,14 @@ private:
     int m_error;
 
     bool m_createdResourceHandle;
+
+    // download to a file
+    char* m_path;
+    long long m_resumeOffset;
+    WebCore::DownloadFileWriter* m_writer;
+    bool m_deferred;
+    // the file is already complete
+    bool m_discardBody;
 };
 
 class WKCDownloadClientPrivate : public WebCore::ResourceHandleClient {
@@ -151,6 +168,11 @@ WKCDownloadPrivate::WKCDownloadPrivate(WKCDownload* in_parent, WKCWebView* in_vi
      , m_contentLength(0)
      , m_error(WKCDownload::EErrorNone)
      , m_createdResourceHandle(false)
+     , m_path(0)
+     , m_resumeOffset(0)
+     , m_writer(0)
+     , m_deferred(false)
+     , m_discardBody(false)
 {
 }
 
@@ -168,7 +190,12 @@ WKCDownloadPrivate::~WKCDownloadPrivate()
         }
     }
     delete m_client;
+    // the queued data is dropped: the file is still a prefix of the resource
+    delete m_writer;
 
+    if (m_path) {
+        wkc_free(m_path);
+    }
     if (m_uri) {
         wkc_free(m_uri);
     }
@@ -218,6 +245,9 @@ WKCDownloadPrivate::notifyForceTerminate()
             m_resourceHandle->cancel();
         }
     }
+    if (m_writer) {
+        m_writer->forceTerminate();
+    }
 }
 
 bool
@@ -271,7 +301,11 @@ bool
 WKCDownloadPrivate::start()
 {
     if (!m_resourceHandle) {
-        m_resourceHandle = WebCore::ResourceHandle::create(0, m_request.priv().webcore(), m_client, false, false);
+        WebCore::ResourceRequest request = m_request.priv().webcore();
+        if (m_resumeOffset) {
+            request.setHTTPHeaderField("Range", WTF::String::format("bytes=%lld-", m_resumeOffset));
+        }
+        m_resourceHandle = WebCore::ResourceHandle::create(0, request, m_client, false, false);
         if (!m_resourceHandle) return false;
         m_createdResourceHandle = true;
     } else {
@@ -284,12 +318,83 @@ WKCDownloadPrivate::start()
     return true;
 }
 
+bool
+WKCDownloadPrivate::startToFile(const char* path, bool resume)
+{
+    if (!path || m_path || m_status != WKCDownload::ECreated) return false;
+
+    m_path = strdup(path);
+    if (!m_path) return false;
+
+    if (m_resourceHandle) {
+        // the response has already been received by setResponse()
+        if (!openFile(0)) return false;
+    } else if (resume) {
+        long long size = WebCore::DownloadFileWriter::fileSize(m_path);
+        if (size > 0) {
+            m_resumeOffset = size;
+        }
+    }
+    return start();
+}
+
+bool
+WKCDownloadPrivate::openFile(long long offset)
+{
+    m_writer = WebCore::DownloadFileWriter::create(m_path, offset, writerNotify, this);
+    if (!m_writer) return false;
+    m_currentLength = offset;
+    return true;
+}
+
+bool
+WKCDownloadPrivate::closeFile()
+{
+    if (!m_writer) return true;
+    bool ret = m_writer->finish();
+    delete m_writer;
+    m_writer = 0;
+    m_deferred = false;
+    return ret;
+}
+
+void
+WKCDownloadPrivate::failWithFileError()
+{
+    if (m_resourceHandle) {
+        m_resourceHandle->cancel();
+    }
+    closeFile();
+    setStatus(WKCDownload::EError);
+    m_error = WKCDownload::EErrorFile;
+
+    m_appclient.didFail(parent(), WKCDownload::EErrorFile);
+}
+
+void
+WKCDownloadPrivate::writerNotify(void* data)
+{
+    WKCDownloadPrivate* self = static_cast<WKCDownloadPrivate*>(data);
+    if (self->m_status != WKCDownload::EStarted) return;
+
+    if (self->m_writer->failed()) {
+        self->failWithFileError();
+        return;
+    }
+    // a buffer has been written out
+    if (self->m_deferred && self->m_resourceHandle) {
+        self->m_deferred = false;
+        self->m_resourceHandle->setDefersLoading(false);
+    }
+}
+
 void
 WKCDownloadPrivate::cancel()
 {
     if (m_resourceHandle) {
         m_resourceHandle->cancel();
     }
+    closeFile();
     setStatus(WKCDownload::ECancelled);
     m_error = WKCDownload::EErrorCancelled;
 
@@ -341,9 +446,71 @@ WKCDownloadPrivate::getError() const
     return m_error;
 }
 
+void
+WKCDownloadPrivate::notifyReceivedResponse(const WebCore::ResourceResponse& response)
+{
+    setResponseInfo(response);
+    if (!m_path || m_writer) return;
+
+    long long offset = 0;
+    if (m_resumeOffset) {
+        int status = response.httpStatusCode();
+        if (status == 416) {
+            // nothing is left to download
+            m_discardBody = true;
+            m_currentLength = m_contentLength = m_resumeOffset;
+            return;
+        }
+        if (status == 206) {
+            WTF::String range = response.httpHeaderField("Content-Range");
+            if (!range.startsWith(WTF::String::format("bytes %lld-", m_resumeOffset))) {
+                m_resourceHandle->cancel();
+                notifyErrorInLoading(WebCore::ResourceError());
+                return;
+            }
+            offset = m_resumeOffset;
+        } else if (status != 200) {
+            // an error page must not replace what has been received
+            m_resourceHandle->cancel();
+            notifyErrorInLoading(WebCore::ResourceError());
+            return;
+        }
+        // 200 carries the whole resource
+    }
+    if (!openFile(offset)) {
+        failWithFileError();
+        return;
+    }
+    if (offset && m_contentLength > 0) {
+        m_contentLength += offset;
+    }
+}
+
 void
 WKCDownloadPrivate::notifyReceivedData(const char* data, size_t length)
 {
+    if (m_path) {
+        if (m_discardBody || m_status != WKCDownload::EStarted) return;
+        if (!m_writer && !openFile(0)) {
+            failWithFileError();
+            return;
+        }
+        WebCore::DownloadFileWriter::WriteResult result = m_writer->write(data, length);
+        if (result == WebCore::DownloadFileWriter::EWriteFailed) {
+            failWithFileError();
+            return;
+        }
+        m_currentLength += length;
+        m_appclient.didReceiveData(parent(), 0, length, m_currentLength);
+
+        // stop the transfer until the writer has room again
+        if (result == WebCore::DownloadFileWriter::EWriteFull && m_status == WKCDownload::EStarted && !m_deferred && m_resourceHandle) {
+            m_deferred = true;
+            m_resourceHandle->setDefersLoading(true);
+        }
+        return;
+    }
+
     m_currentLength += length;
     m_appclient.didReceiveData(parent(), data, length, m_currentLength);
 }
@@ -351,6 +518,12 @@ WKCDownloadPrivate::notifyReceivedData(const char* data, size_t length)
 void
 WKCDownloadPrivate::notifyFinishedLoading()
 {
+    if (m_path && !m_discardBody) {
+        if ((!m_writer && !openFile(0)) || !closeFile()) {
+            failWithFileError();
+            return;
+        }
+    }
     m_status = WKCDownload::EFinished;
     m_appclient.didFinishLoading(parent());
 }
@@ -358,6 +531,8 @@ WKCDownloadPrivate::notifyFinishedLoading()
 void
 WKCDownloadPrivate::notifyErrorInLoading(const WebCore::ResourceError& error)
 {
+    // keep what has been received, to be resumed
+    closeFile();
     m_status = WKCDownload::EError;
     m_error = WKCDownload::EErrorNetwork;
     m_appclient.didFail(parent(), WKCDownload::EErrorNetwork);
@@ -390,7 +565,7 @@ WKCDownloadClientPrivate::create(WKCDownloadPrivate* parent)
 void
 WKCDownloadClientPrivate::didReceiveResponse(WebCore::ResourceHandle*, const WebCore::ResourceResponse& response)
 {
-    m_download->setResponseInfo(response);
+    m_download->notifyReceivedResponse(response);
 }
 
 void
@@ -536,6 +711,12 @@ WKCDownload::start()
     return m_private->start();
 }
 
+bool
+WKCDownload::startToFile(const char* path, bool resume)
+{
+    return m_private->startToFile(path, resume);
+}
+
 void
 WKCDownload::cancel()
 {
@@ -147,6 +147,19 @@ public:
        Calling this API starts download processing. To check with the user whether to continue before starting download processing, perform the confirmation before calling this API.
     */
     bool start();
+    /**
+       @brief Requests to start download processing into a file
+       @param path Path of file to save to
+       @param resume true to continue a download into an existing file
+       @retval "!= false" Succeeded
+       @retval "== false" Failed
+       @details
+       Works as WKC::WKCDownload::start(), except that the received data is written to path through a fixed set of buffers, so that the memory used does not grow with the size of the download. WKC::WKCDownloadClient::didReceiveData() is still called for the progress, with 0 as the data.@n
+       If resume is true and path exists, only the rest of the resource is requested, with a Range header. If the server sends the whole resource instead, the file is written again from the start.@n
+       resume has no effect after WKC::WKCDownload::setResponse(), as the request has already been sent.@n
+       The file is kept when the download fails or is cancelled, so that it can be resumed.
+    */
+    bool startToFile(const char* path, bool resume);
     /**
        @brief Notifies of canceling download processing
        @return None
@@ -246,6 +259,8 @@ public:
         EErrorCancelled,
         /** @brief Error code when download processing failed due to network problem */
         EErrorNetwork,
+        /** @brief Error code when the file given to WKC::WKCDownload::startToFile() could not be written */
+        EErrorFile,
         /** @brief Error numbers */
         EErrors
     };
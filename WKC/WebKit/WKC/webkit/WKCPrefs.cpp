@@ -179,6 +179,24 @@ setMaxWebSocketConnections(long num)
     }
 }
 
+void
+setHTTPPipelining(bool enable)
+{
+    using WebCore::ResourceHandleManager;
+    if (WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance()) {
+        mgr->setHTTPPipelining(enable);
+    }
+}
+
+void
+setReceiveDataBatchSize(int bytes)
+{
+    using WebCore::ResourceHandleManager;
+    if (WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance()) {
+        mgr->setReceiveDataBatchSize(bytes);
+    }
+}
+
 void
 setMaxCookieEntries(long number)
 {
@@ -477,6 +495,17 @@ setHTTPCache(bool enable, long long limitTotalSize, long limitContentSize, int l
 #endif
 }
 
+void
+setHTTPCacheStaleWhileRevalidate(bool enable)
+{
+#if ENABLE(WKC_HTTPCACHE)
+    if (WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance())
+        mgr->httpCache()->setStaleWhileRevalidate(enable);
+#else
+    (void)enable;
+#endif
+}
+
 void
 setDecodeAfterDownloading(bool decodeAfterLoading)
 {
@@ -265,6 +265,25 @@ namespace WKCPrefs {
        - It must never be set during communication.
     */
     WKC_API void setMaxWebSocketConnections(long number);
+    /**
+       @brief Enables / disables HTTP/1.1 pipelining
+       @param enable Enables / disables pipelining
+       @return None
+       @details
+       When enabled, GET and HEAD requests may be sent on a connection which is still receiving an earlier response.@n
+       It is disabled by default.
+    */
+    WKC_API void setHTTPPipelining(bool enable);
+    /**
+       @brief Sets the minimum size of received data handed to the page at once
+       @param bytes Size in bytes; 0 hands over every chunk as it is received
+       @return None
+       @details
+       Received data is held back until this size has gathered, for 50 ms at most, and always handed over at the end of the response.@n
+       The first data of a response, multipart/x-mixed-replace and text/event-stream responses are not held back.@n
+       It is 32KB by default.
+    */
+    WKC_API void setReceiveDataBatchSize(int bytes);
     /**
        @brief Sets maximum number of cookies that can be saved internally
        @param number Maximum number of cookies @n
@@ -498,6 +517,14 @@ namespace WKCPrefs {
        Sets parameters of HTTP cache.
     */
     WKC_API void setHTTPCache(bool enable, long long limitTotalSize, long limitContentSize, int limitEntries, const char *filePath);
+    /**
+       @brief Enables / disables stale-while-revalidate of HTTP cache.
+       @param enable Enables / disables stale-while-revalidate
+       @retval None
+       @details
+       When enabled (default), an expired cached resource within the stale-while-revalidate period given by the server is read from the cache at once and revalidated in the background.
+    */
+    WKC_API void setHTTPCacheStaleWhileRevalidate(bool enable);
 
     WKC_API void setDecodeAfterDownloading(bool decodeAfterLoading);
     /**
@@ -111,6 +111,8 @@
 #include "HitTestRequest.h"
 #include "HitTestResult.h"
 #include "ImageBufferData.h"
+#include "ImageDecodingServiceWKC.h"
+#include "DecodedImageBudgetWKC.h"
 #include "ImageWKC.h"
 #include "RenderView.h"
 #include "RenderText.h"
@@ -152,6 +154,7 @@
 #include "FontCache.h"
 #include "CrossOriginPreflightResultCache.h"
 #include "ResourceHandleManagerWKC.h"
+#include "ResourceHandleManagerWKCSSL.h"
 #include "SharedTimer.h"
 #include "GCController.h"
 #include "SQLiteFileSystem.h"
@@ -892,7 +895,16 @@ WKCWebViewPrivate::notifyPaintOffscreenFrom(const WebCore::IntRect& rect, const
     ctx.clip(cr);
     ctx.translate(-transX, -transY);
     NF4_DP(("Paint(%d, %d, %d, %d)", scrolledRect.x(), scrolledRect.y(), scrolledRect.width(), scrolledRect.height()));
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    WebCore::ImageDecodingService* decodingService = WebCore::ImageDecodingService::sharedInstance();
+    if (decodingService)
+        decodingService->beginPaint(m_drawContext, WebCore::IntRect(WebCore::IntPoint(), frame->view()->visibleContentRect().size()));
+#endif
     frame->view()->paintContents(&ctx, scrolledRect);
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    if (decodingService)
+        decodingService->endPaint();
+#endif
     if (m_overlayList && !m_rootGraphicsLayer) {
         // WKCOverlayList::paintOffscreen will translate (-visibleRect.x(), -visibleRect.y()), so cancel out the offset here.
         WebCore::FloatRect visibleRect = frame->view()->visibleContentRect();
@@ -929,7 +941,16 @@ WKCWebViewPrivate::notifyPaintOffscreen(const WebCore::IntRect& rect)
     wkcDrawContextSetOpticalZoomPeer(m_drawContext, m_opticalZoomLevel, &m_opticalZoomOffset);
 #endif
     ctx.clip(cr);
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    WebCore::ImageDecodingService* decodingService = WebCore::ImageDecodingService::sharedInstance();
+    if (decodingService)
+        decodingService->beginPaint(m_drawContext, WebCore::IntRect(WebCore::IntPoint(), frame->view()->visibleContentRect().size()));
+#endif
     frame->view()->paint(&ctx, rect);
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    if (decodingService)
+        decodingService->endPaint();
+#endif
     if (m_overlayList && !m_rootGraphicsLayer)
         m_overlayList->paintOffscreen(ctx);
     ctx.restore();
@@ -3358,6 +3379,25 @@ void WKCWebView::setInternalColorFormat(int fmt)
 #endif
 }
 
+void WKCWebView::setDitherRGB565(bool flag)
+{
+    WebCore::ImageWKC::setDitherRGB565(flag);
+}
+
+void WKCWebView::setImageDecodingThreads(int count)
+{
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    WebCore::ImageDecodingService::setThreadCount(count);
+#endif
+}
+
+void WKCWebView::setDecodedImageBudget(unsigned int bytes)
+{
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    WebCore::DecodedImageBudget::setBudget(bytes);
+#endif
+}
+
 void WKCWebView::setUseAntiAliasForDrawings(bool flag)
 {
     m_private->setUseAntiAliasForDrawings(flag);
@@ -3403,6 +3443,11 @@ int WKCWebKitCookieSerialize(char* buff, int bufflen)
     return WebCore::ResourceHandleManager::sharedInstance()->CookieSerialize(buff, bufflen);
 }
 
+int WKCWebKitCookieSerializeChanges(char* buff, int bufflen)
+{
+    return WebCore::ResourceHandleManager::sharedInstance()->CookieSerializeChanges(buff, bufflen);
+}
+
 void WKCWebKitCookieDeserialize(const char* buff, bool restart)
 {
     WebCore::ResourceHandleManager::sharedInstance()->CookieDeserialize(buff, restart);
@@ -3508,6 +3553,138 @@ int WKCWebKitGetSocketStatistics(int in_numberOfArray, SocketStatistics* out_sta
     return wkcNetGetSocketStatisticsPeer(in_numberOfArray, (WKCSocketStatistics*)out_statistics);
 }
 
+bool WKCWebKitGetHTTPCacheStatistics(HTTPCacheStatistics* out_statistics)
+{
+#if ENABLE(WKC_HTTPCACHE)
+    WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance();
+    if (!mgr || !out_statistics)
+        return false;
+
+    WebCore::HTTPCacheStatistics stat;
+    mgr->httpCache()->getStatistics(stat);
+    out_statistics->fEntries = stat.m_entries;
+    out_statistics->fBodyFiles = stat.m_bodyFiles;
+    out_statistics->fTotalContentsSize = stat.m_totalContentsSize;
+    out_statistics->fDedupLookups = stat.m_dedupLookups;
+    out_statistics->fDedupHits = stat.m_dedupHits;
+    out_statistics->fDedupBytesSaved = stat.m_dedupBytesSaved;
+    return true;
+#else
+    (void)out_statistics;
+    return false;
+#endif
+}
+
+bool WKCWebKitGetHTTPConnectionStatistics(HTTPConnectionStatistics* out_statistics)
+{
+    WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance();
+    if (!mgr || !out_statistics)
+        return false;
+
+    WebCore::HTTPConnectionStatistics stat;
+    mgr->getConnectionStatistics(stat);
+    out_statistics->fTransfers = stat.m_transfers;
+    out_statistics->fReusedTransfers = stat.m_reusedTransfers;
+    out_statistics->fNewConnectionTTFB = stat.m_newConnectionTTFB;
+    out_statistics->fReusedConnectionTTFB = stat.m_reusedConnectionTTFB;
+    out_statistics->fWarmStarts = stat.m_warmStarts;
+    out_statistics->fPreconnects = stat.m_preconnects;
+    out_statistics->fUsedPreconnects = stat.m_usedPreconnects;
+    out_statistics->fUnusedPreconnects = stat.m_unusedPreconnects;
+    return true;
+}
+
+bool WKCWebKitGetDataDeliveryStatistics(DataDeliveryStatistics* out_statistics)
+{
+    WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance();
+    if (!mgr || !out_statistics)
+        return false;
+
+    WebCore::DataDeliveryStatistics stat;
+    mgr->getDataDeliveryStatistics(stat);
+    out_statistics->fChunks = stat.m_chunks;
+    out_statistics->fDispatches = stat.m_dispatches;
+    return true;
+}
+
+void WKCWebKitEnableNetworkTimeline(bool enable)
+{
+    WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance();
+    if (!mgr)
+        return;
+    mgr->networkTimeline()->setEnabled(enable);
+}
+
+int WKCWebKitNetworkTimelineSerialize(char* buff, int bufflen)
+{
+    WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance();
+    if (!mgr)
+        return 0;
+    return mgr->networkTimeline()->serialize(buff, bufflen);
+}
+
+void WKCWebKitClearNetworkTimeline(void)
+{
+    WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance();
+    if (!mgr)
+        return;
+    mgr->networkTimeline()->clear();
+}
+
+bool WKCWebKitGetDNSStatistics(DNSStatistics* out_statistics)
+{
+    WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance();
+    if (!mgr || !mgr->dnsResolver() || !out_statistics)
+        return false;
+
+    WebCore::DNSResolverStatistics stat;
+    mgr->dnsResolver()->getStatistics(stat);
+    out_statistics->fHits = stat.m_hits;
+    out_statistics->fNegativeHits = stat.m_negativeHits;
+    out_statistics->fMisses = stat.m_misses;
+    out_statistics->fResolved = stat.m_resolved;
+    out_statistics->fFailed = stat.m_failed;
+    return true;
+}
+
+bool WKCWebKitGetSSLSessionStatistics(SSLSessionStatistics* out_statistics)
+{
+    WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance();
+    if (!mgr || !mgr->rhmssl() || !out_statistics)
+        return false;
+
+    WebCore::SSLSessionStatistics stat;
+    mgr->getSSLSessionStatistics(stat);
+    out_statistics->fHandshakes = stat.m_handshakes;
+    out_statistics->fResumedHandshakes = stat.m_resumedHandshakes;
+    out_statistics->fCurlHits = stat.m_curlHits;
+    out_statistics->fHits = stat.m_hits;
+    out_statistics->fMisses = stat.m_misses;
+    out_statistics->fEvictions = stat.m_evictions;
+    return true;
+}
+
+bool WKCWebKitGetDecodedImageStatistics(DecodedImageStatistics* out_statistics)
+{
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    WebCore::DecodedImageBudget* budget = WebCore::DecodedImageBudget::sharedInstance();
+    if (!budget || !out_statistics)
+        return false;
+
+    WebCore::DecodedImageBudgetStatistics stat;
+    budget->getStatistics(stat);
+    out_statistics->fBudget = stat.m_budget;
+    out_statistics->fUsage = stat.m_usage;
+    out_statistics->fPeakUsage = stat.m_peakUsage;
+    out_statistics->fImages = stat.m_images;
+    out_statistics->fEvictions = stat.m_evictions;
+    out_statistics->fRedecodes = stat.m_redecodes;
+    return true;
+#else
+    return false;
+#endif
+}
+
 void WKCWebView::permitSendRequest(void *handle, bool permit)
 {
     WebCore::ResourceHandleManager* mgr = WebCore::ResourceHandleManager::sharedInstance();
@@ -3851,6 +4028,13 @@ WKCWebKitFinalize()
     if (WebCore::ResourceHandleManager::isExistSharedInstance())
         WebCore::ResourceHandleManager::deleteSharedInstance();
 
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    WebCore::ImageDecodingService::deleteSharedInstance();
+#endif
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    WebCore::DecodedImageBudget::deleteSharedInstance();
+#endif
+
 #if ENABLE(ICONDATABASE)
     if (WebCore::iconDatabase().isEnabled()) {
         WebCore::iconDatabase().close();
@@ -4293,6 +4477,13 @@ WKCWebKitForceTerminate()
     if (WKCGlobalSettings::isAutomatic())
         WKCGlobalSettings::deleteSharedInstance();
 
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    WebCore::ImageDecodingService::forceTerminate();
+#endif
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    WebCore::DecodedImageBudget::forceTerminate();
+#endif
+
 #if ENABLE(ICONDATABASE)
     if (WebCore::iconDatabase().isEnabled())
         WebCore::iconDatabase().forceTerminate();
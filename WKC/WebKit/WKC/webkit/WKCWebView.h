@@ -619,6 +619,18 @@ Loads serialized cookies.
 */
 WKC_API int  WKCWebKitCookieSerialize(char* buff, int bufflen);
 /**
+@brief Serializing changed cookies
+@param buff Buffer for data to load
+@param bufflen Length of buffer for data to load
+@return write length, or -1 if buff is too short
+@details
+Loads the cookies added, changed or removed since the last call of this function, WKCWebKitCookieSerialize() or WKCWebKitCookieDeserialize(). Removed cookies are written as expired ones.
+@attention
+- If buff is null, just return buffer length to write.
+- Passing the saved data followed by the changes to WKCWebKitCookieDeserialize() restores the current cookies.
+*/
+WKC_API int  WKCWebKitCookieSerializeChanges(char* buff, int bufflen);
+/**
 @brief Deserializing cookies
 @param buff Buffer for data to register
 @param restart Specify true when restarting the engine due to insufficient memory, etc.
@@ -696,6 +708,176 @@ typedef struct SocketStatistics_ SocketStatistics;
 */
 WKC_API int WKCWebKitGetSocketStatistics(int in_numberOfArray, SocketStatistics* out_statistics);
 
+/** @brief Structure that contains the HTTP cache statistics */
+struct HTTPCacheStatistics_ {
+    /** @brief Number of cached entries */
+    int fEntries;
+    /** @brief Number of body files on storage */
+    int fBodyFiles;
+    /** @brief Total size of body files on storage */
+    long long fTotalContentsSize;
+    /** @brief Number of bodies written since startup */
+    int fDedupLookups;
+    /** @brief Number of written bodies which were identical to a stored one */
+    int fDedupHits;
+    /** @brief Number of bytes currently saved by sharing identical bodies */
+    long long fDedupBytesSaved;
+};
+/** @brief Type definition of WKC::HTTPCacheStatistics */
+typedef struct HTTPCacheStatistics_ HTTPCacheStatistics;
+/**
+@brief Get the statistics of HTTP cache
+@param out_statistics Statistics of HTTP cache
+@retval true Succeeded
+@retval false HTTP cache is not available
+*/
+WKC_API bool WKCWebKitGetHTTPCacheStatistics(HTTPCacheStatistics* out_statistics);
+
+/** @brief Structure that contains the HTTP connection statistics */
+struct HTTPConnectionStatistics_ {
+    /** @brief Number of completed HTTP transfers */
+    int fTransfers;
+    /** @brief Number of transfers which reused a kept-alive connection */
+    int fReusedTransfers;
+    /** @brief Total time to the first response byte of transfers on new connections, in seconds */
+    double fNewConnectionTTFB;
+    /** @brief Total time to the first response byte of transfers on reused connections, in seconds */
+    double fReusedConnectionTTFB;
+    /** @brief Number of requests started ahead of older ones because of an idle connection */
+    int fWarmStarts;
+    /** @brief Number of connections opened ahead of the loads for preconnect and resource hints */
+    int fPreconnects;
+    /** @brief Number of preconnected connections used by a request */
+    int fUsedPreconnects;
+    /** @brief Number of preconnected connections no request used within the deadline */
+    int fUnusedPreconnects;
+};
+/** @brief Type definition of WKC::HTTPConnectionStatistics */
+typedef struct HTTPConnectionStatistics_ HTTPConnectionStatistics;
+/**
+@brief Get the statistics of HTTP connections
+@param out_statistics Statistics of HTTP connections
+@retval true Succeeded
+@retval false Not available
+*/
+WKC_API bool WKCWebKitGetHTTPConnectionStatistics(HTTPConnectionStatistics* out_statistics);
+
+/** @brief Structure that contains the received data delivery statistics */
+struct DataDeliveryStatistics_ {
+    /** @brief Number of chunks of received data */
+    int fChunks;
+    /** @brief Number of times received data was handed to the loaders */
+    int fDispatches;
+};
+/** @brief Type definition of WKC::DataDeliveryStatistics */
+typedef struct DataDeliveryStatistics_ DataDeliveryStatistics;
+/**
+@brief Get the statistics of received data delivery
+@param out_statistics Statistics of received data delivery
+@retval true Succeeded
+@retval false Not available
+*/
+WKC_API bool WKCWebKitGetDataDeliveryStatistics(DataDeliveryStatistics* out_statistics);
+
+/**
+@brief Enables / disables recording of the network timeline
+@param enable Enables / disables recording
+@return None
+@details
+While enabled, the DNS, connect, TLS, send, wait and receive times of every HTTP load, and the time spent reading it from or handing it to the HTTP cache, are recorded for the latest 256 loads.@n
+Disabling it discards the recorded loads. It is disabled by default.
+*/
+WKC_API void WKCWebKitEnableNetworkTimeline(bool enable);
+/**
+@brief Serializing the network timeline
+@param buff Buffer for data to load
+@param bufflen Length of buffer for data to load
+@return write length, or -1 if buff is too short
+@details
+Loads the recorded loads as HAR-like JSON, oldest first. Times are in milliseconds, and -1 for a phase the load did not go through.
+@attention
+- If buff is null, just return buffer length to write.
+*/
+WKC_API int WKCWebKitNetworkTimelineSerialize(char* buff, int bufflen);
+/**
+@brief Discards the recorded network timeline
+@return None
+*/
+WKC_API void WKCWebKitClearNetworkTimeline(void);
+
+/** @brief Structure that contains the DNS resolver statistics */
+struct DNSStatistics_ {
+    /** @brief Number of requests given a cached address */
+    int fHits;
+    /** @brief Number of requests failed at once by a cached resolution failure */
+    int fNegativeHits;
+    /** @brief Number of requests whose host was not cached */
+    int fMisses;
+    /** @brief Number of host names resolved in the background */
+    int fResolved;
+    /** @brief Number of background resolutions which failed */
+    int fFailed;
+};
+/** @brief Type definition of WKC::DNSStatistics */
+typedef struct DNSStatistics_ DNSStatistics;
+/**
+@brief Get the statistics of the DNS resolver
+@param out_statistics Statistics of the DNS resolver
+@retval true Succeeded
+@retval false DNS resolver is not available
+*/
+WKC_API bool WKCWebKitGetDNSStatistics(DNSStatistics* out_statistics);
+
+/** @brief Structure that contains the TLS session cache statistics */
+struct SSLSessionStatistics_ {
+    /** @brief Number of completed TLS handshakes */
+    int fHandshakes;
+    /** @brief Number of completed TLS handshakes which resumed a session */
+    int fResumedHandshakes;
+    /** @brief Number of handshakes offered a session by libcurl */
+    int fCurlHits;
+    /** @brief Number of handshakes offered a session from the session cache */
+    int fHits;
+    /** @brief Number of handshakes with no session to offer */
+    int fMisses;
+    /** @brief Number of sessions dropped to make room for new ones */
+    int fEvictions;
+};
+/** @brief Type definition of WKC::SSLSessionStatistics */
+typedef struct SSLSessionStatistics_ SSLSessionStatistics;
+/**
+@brief Get the statistics of the TLS session cache
+@param out_statistics Statistics of the TLS session cache
+@retval true Succeeded
+@retval false TLS session cache is not available
+*/
+WKC_API bool WKCWebKitGetSSLSessionStatistics(SSLSessionStatistics* out_statistics);
+
+/** @brief Structure that contains the decoded image budget statistics */
+struct DecodedImageStatistics_ {
+    /** @brief Budget for decoded images in bytes */
+    unsigned int fBudget;
+    /** @brief Bytes of decoded images counted against the budget */
+    unsigned int fUsage;
+    /** @brief Highest fUsage so far */
+    unsigned int fPeakUsage;
+    /** @brief Number of images whose decoded frames are counted */
+    int fImages;
+    /** @brief Number of times the decoded frames of an image were dropped */
+    int fEvictions;
+    /** @brief Number of dropped images decoded again */
+    int fRedecodes;
+};
+/** @brief Type definition of WKC::DecodedImageStatistics */
+typedef struct DecodedImageStatistics_ DecodedImageStatistics;
+/**
+@brief Get the statistics of the decoded image budget
+@param out_statistics Statistics of the decoded image budget
+@retval true Succeeded
+@retval false No budget is set
+*/
+WKC_API bool WKCWebKitGetDecodedImageStatistics(DecodedImageStatistics* out_statistics);
+
 /** @brief Class that corresponds to the content display screen of the browser. */
 class WKC_API WKCWebView
 {
@@ -1849,6 +2031,27 @@ public:
        For fmt, specify WKC::WKCWebView::EInternalColorFormat8888 or WKC::WKCWebView::EInternalColorFormat5515withMask.
     */
     static void setInternalColorFormat(int fmt);
+    /**
+       @brief Sets ordered dithering of images stored in RGB565 to be enabled/disabled
+       @param flag true: enabled, false: disabled
+       @details
+       Applies to images decoded into RGB565 and to images reduced to RGB565 with WKC::WKCWebView::EInternalColorFormat8888or565. Disabled by default.
+    */
+    static void setDitherRGB565(bool flag);
+    /**
+       @brief Sets the number of threads decoding images off the main thread
+       @param count Number of threads, 0 to decode on the main thread
+       @details
+       Large single frame images drawn while painting the view are decoded on these threads, nearest to the viewport first. Nothing is drawn for such an image until its decode is done, then its rect is repainted. The threads call the wkcMemory peers, which must allow it. At most 4 threads. 0 by default.
+    */
+    static void setImageDecodingThreads(int count);
+    /**
+       @brief Sets the budget for decoded images
+       @param bytes Budget in bytes, 0 for no budget
+       @details
+       When decoding an image would go over the budget, the decoded frames of the least recently drawn images are dropped. Their encoded data is kept, and they are decoded again when drawn next. The decoded frames of other images are also dropped when an image cannot be allocated, before WKC::WKCMemoryEventHandler::notifyMemoryAllocationError() is called. Images decoded before the budget is set are not counted. 0 by default.
+    */
+    static void setDecodedImageBudget(unsigned int bytes);
     /**
        @brief Sets bilinear complement while zooming in/out images to be enabled/disabled
        @param flag true: enabled, false: disabled
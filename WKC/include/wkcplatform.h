@@ -686,8 +686,10 @@
 #define ENABLE_WKC_ANDROID_FIXED_ELEMENTS 0
 // enable to notify scroll position even if scroll position is not changed
 #define ENABLE_WKC_FORCE_NOTIFY_SCROLL 1
-// enable shrink decode
-#define ENABLE_WKC_IMAGE_DECODER_DOWN_SAMPLING 1
+// decode large images on worker threads while painting the view (see WKCWebView::setImageDecodingThreads)
+#define ENABLE_WKC_ASYNC_IMAGE_DECODING 1
+// keep decoded images under a budget, decoding evicted ones again when drawn (see WKCWebView::setDecodedImageBudget)
+#define ENABLE_WKC_DECODED_IMAGE_BUDGET 1
 
 // enable optimization to ignore fixed background images when scrolling a page.
 #define ENABLE_FAST_MOBILE_SCROLLING 1
@@ -701,6 +703,9 @@
 // enable HTTPCache
 //#define ENABLE_WKC_HTTPCACHE 1
 
+// drive the network loop by curl_multi_socket_action() instead of polling curl_multi_perform()
+#define ENABLE_WKC_CURL_MULTI_SOCKET 1
+
 #define JS_EXPORTDATA
 #define __N p__N
 
@@ -39,6 +39,9 @@ LinkRelAttribute::LinkRelAttribute()
     , m_iconType(InvalidIcon)
     , m_isAlternate(false)
     , m_isDNSPrefetch(false)
+#if PLATFORM(WKC)
+    , m_isPreconnect(false)
+#endif
 #if ENABLE(LINK_PREFETCH)
     , m_isLinkPrefetch(false)
     , m_isLinkPrerender(false)
@@ -52,6 +55,9 @@ LinkRelAttribute::LinkRelAttribute(const String& rel)
     , m_iconType(InvalidIcon)
     , m_isAlternate(false)
     , m_isDNSPrefetch(false)
+#if PLATFORM(WKC)
+    , m_isPreconnect(false)
+#endif
 #if ENABLE(LINK_PREFETCH)
     , m_isLinkPrefetch(false)
     , m_isLinkPrerender(false)
@@ -70,6 +76,10 @@ LinkRelAttribute::LinkRelAttribute(const String& rel)
 #endif
     else if (equalIgnoringCase(rel, "dns-prefetch"))
         m_isDNSPrefetch = true;
+#if PLATFORM(WKC)
+    else if (equalIgnoringCase(rel, "preconnect"))
+        m_isPreconnect = true;
+#endif
     else if (equalIgnoringCase(rel, "alternate stylesheet") || equalIgnoringCase(rel, "stylesheet alternate")) {
         m_isStyleSheet = true;
         m_isAlternate = true;
@@ -87,6 +97,10 @@ LinkRelAttribute::LinkRelAttribute(const String& rel)
                 m_isAlternate = true;
             else if (equalIgnoringCase(*it, "icon"))
                 m_iconType = Favicon;
+#if PLATFORM(WKC)
+            else if (equalIgnoringCase(*it, "preconnect"))
+                m_isPreconnect = true;
+#endif
 #if ENABLE(TOUCH_ICON_LOADING)
             else if (equalIgnoringCase(*it, "apple-touch-icon"))
                 m_iconType = TouchIcon;
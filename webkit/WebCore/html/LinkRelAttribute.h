@@ -42,6 +42,9 @@ public:
     IconType m_iconType;
     bool m_isAlternate;
     bool m_isDNSPrefetch;
+#if PLATFORM(WKC)
+    bool m_isPreconnect;
+#endif
 #if ENABLE(LINK_PREFETCH)
     bool m_isLinkPrefetch;
     bool m_isLinkPrerender;
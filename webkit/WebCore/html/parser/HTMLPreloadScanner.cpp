@@ -38,6 +38,11 @@
 #include "LinkRelAttribute.h"
 #include "MediaList.h"
 #include "MediaQueryEvaluator.h"
+#if PLATFORM(WKC)
+#include "DNS.h"
+#include "HTMLElement.h"
+#include "Settings.h"
+#endif
 
 namespace WebCore {
 
@@ -52,6 +57,9 @@ public:
         , m_linkIsStyleSheet(false)
         , m_linkMediaAttributeIsScreen(true)
         , m_inputIsImage(false)
+#if PLATFORM(WKC)
+        , m_linkIsPreconnect(false)
+#endif
     {
         processAttributes(token.attributes());
     }
@@ -79,8 +87,12 @@ public:
             } else if (m_tagName == linkTag) {
                 if (attributeName == hrefAttr)
                     setUrlToLoad(attributeValue);
-                else if (attributeName == relAttr)
+                else if (attributeName == relAttr) {
                     m_linkIsStyleSheet = relAttributeIsStyleSheet(attributeValue);
+#if PLATFORM(WKC)
+                    m_linkIsPreconnect = LinkRelAttribute(attributeValue).m_isPreconnect;
+#endif
+                }
                 else if (attributeName == mediaAttr)
                     m_linkMediaAttributeIsScreen = linkMediaAttributeIsScreen(attributeValue);
             } else if (m_tagName == inputTag) {
@@ -130,6 +142,20 @@ public:
 
         CachedResourceLoader* cachedResourceLoader = document->cachedResourceLoader();
         ResourceRequest request = document->completeURL(m_urlToLoad, baseURL);
+#if PLATFORM(WKC)
+        Settings* settings = document->settings();
+        if (settings && settings->dnsPrefetchingEnabled()) {
+            // Images are held back by preload() until the body is rendered; the
+            // connection to another origin is opened meanwhile. Other loads
+            // start right away and would only race a second connection.
+            // <link rel=preconnect> is seen here before the parser gets to it.
+            bool heldBack = (m_tagName == imgTag || (m_tagName == inputTag && m_inputIsImage))
+                && !(document->body() && document->body()->renderer());
+            if ((heldBack && !protocolHostAndPortAreEqual(request.url(), document->url()))
+                || (m_tagName == linkTag && m_linkIsPreconnect))
+                preconnect(request.url());
+        }
+#endif
         if (m_tagName == scriptTag)
             cachedResourceLoader->preload(CachedResource::Script, request, m_charset, scanningBody);
         else if (m_tagName == imgTag || (m_tagName == inputTag && m_inputIsImage))
@@ -149,6 +175,9 @@ private:
     bool m_linkIsStyleSheet;
     bool m_linkMediaAttributeIsScreen;
     bool m_inputIsImage;
+#if PLATFORM(WKC)
+    bool m_linkIsPreconnect;
+#endif
 };
 
 } // namespace
@@ -102,6 +102,14 @@ bool LinkLoader::loadLink(const LinkRelAttribute& relAttribute, const String& ty
             prefetchDNS(href.host());
     }
 
+#if PLATFORM(WKC)
+    if (relAttribute.m_isPreconnect) {
+        Settings* settings = document->settings();
+        if (settings && settings->dnsPrefetchingEnabled() && href.isValid() && !href.isEmpty())
+            preconnect(href);
+    }
+#endif
+
 #if ENABLE(LINK_PREFETCH)
     if ((relAttribute.m_isLinkPrefetch || relAttribute.m_isLinkPrerender || relAttribute.m_isLinkSubresource) && href.isValid() && document->frame()) {
         if (!m_client->shouldLoadLink())
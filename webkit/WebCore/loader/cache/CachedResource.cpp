@@ -198,7 +198,12 @@ void CachedResource::load(CachedResourceLoader* cachedResourceLoader, const Reso
     m_loading = true;
 
 #if PLATFORM(CHROMIUM) || PLATFORM(BLACKBERRY) || PLATFORM(WKC)
+#if PLATFORM(WKC)
+    // WKC's ResourceRequest starts out as TargetIsSubresource
+    if (m_resourceRequest.targetType() == ResourceRequest::TargetIsUnspecified || m_resourceRequest.targetType() == ResourceRequest::TargetIsSubresource)
+#else
     if (m_resourceRequest.targetType() == ResourceRequest::TargetIsUnspecified)
+#endif
         m_resourceRequest.setTargetType(cachedResourceTypeToTargetType(type()));
 #endif
 
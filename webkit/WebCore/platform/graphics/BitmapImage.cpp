@@ -41,6 +41,17 @@
 #include "ImageWKC.h"
 #include "ImageDecoder.h"
 #endif
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+#include "GraphicsContext.h"
+#include "ImageDecodingServiceWKC.h"
+#endif
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+#include "DecodedImageBudgetWKC.h"
+// around every call into m_source that may decode
+#define DECODED_IMAGE_BUDGET_DECODING_SCOPE() DecodedImageBudget::DecodingScope decodingScope(this)
+#else
+#define DECODED_IMAGE_BUDGET_DECODING_SCOPE()
+#endif
 
 namespace WebCore {
 
@@ -56,6 +67,7 @@ void BitmapImage::syncFrameData(size_t index)
         return;
     }
 
+    DECODED_IMAGE_BUDGET_DECODING_SCOPE();
     ImageFrame* buffer = m_source.frameAtIndex(index);
     if (buffer) {
         delete iw;
@@ -74,6 +86,66 @@ static int frameBytes(const IntSize& frameSize, NativeImagePtr img)
 
     return frameSize.width() * frameSize.height() * bpp;
 }
+
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+bool BitmapImage::decodeAsynchronously(GraphicsContext* context, const FloatRect& dstRect)
+{
+    if (m_asynchronousDecodeFailed || m_currentFrame)
+        return false;
+    if (!m_frames.isEmpty() && m_frames[0].m_frame)
+        return false;
+
+    ImageDecodingService* service = ImageDecodingService::sharedInstance();
+    if (!service || !service->isPaintingView(context->platformContext()))
+        return false;
+    // animations and partial images stay with the decoder of m_source
+    if (!m_allDataReceived || !data() || isThreeDImage())
+        return false;
+    if (!isSizeAvailable() || frameCount() != 1 || !ImageDecodingService::shouldDecodeAsynchronously(size()))
+        return false;
+
+    service->request(this, data(), enclosingIntRect(context->getCTM().mapRect(dstRect)));
+    m_decodingAsynchronously = true;
+    return true;
+}
+
+void BitmapImage::didDecodeAsynchronously(NativeImagePtr frame, bool hasAlpha)
+{
+    m_decodingAsynchronously = false;
+
+    if (!frame)
+        m_asynchronousDecodeFailed = true;
+    else if (!m_frames.isEmpty() && m_frames[0].m_frame) {
+        // decoded on the main thread meanwhile
+        ((ImageWKC*)frame)->unref();
+        return;
+    } else {
+        if (m_frames.isEmpty())
+            m_frames.grow(1);
+        FrameData& frameData = m_frames[0];
+        frameData.m_frame = frame;
+        frameData.m_orientation = DefaultImageOrientation;
+        frameData.m_haveMetadata = true;
+        frameData.m_isComplete = true;
+        frameData.m_hasAlpha = hasAlpha;
+        checkForSolidColor();
+
+        int deltaBytes = frameBytes(m_size, frame);
+        m_decodedSize += deltaBytes;
+        deltaBytes -= m_decodedPropertiesSize;
+        m_decodedPropertiesSize = 0;
+        if (imageObserver())
+            imageObserver()->decodedSizeChanged(this, deltaBytes);
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+        if (DecodedImageBudget* budget = DecodedImageBudget::sharedInstance())
+            budget->setDecodedSize(this, m_decodedSize);
+#endif
+    }
+
+    if (imageObserver())
+        imageObserver()->changedInRect(this, IntRect(IntPoint(), size()));
+}
+#endif
 #else
 static int frameBytes(const IntSize& frameSize)
 {
@@ -101,12 +173,26 @@ BitmapImage::BitmapImage(ImageObserver* observer)
     , m_sizeAvailable(false)
     , m_hasUniformFrameSize(true)
     , m_haveFrameCount(false)
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    , m_decodingAsynchronously(false)
+    , m_asynchronousDecodeFailed(false)
+#endif
 {
     initPlatformData();
 }
 
 BitmapImage::~BitmapImage()
 {
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    if (m_decodingAsynchronously) {
+        if (ImageDecodingService* service = ImageDecodingService::sharedInstance())
+            service->cancel(this);
+    }
+#endif
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    if (DecodedImageBudget* budget = DecodedImageBudget::sharedInstance())
+        budget->remove(this);
+#endif
     invalidatePlatformData();
     stopAnimation();
 }
@@ -184,10 +270,15 @@ void BitmapImage::destroyMetadataAndNotify(int framesCleared)
     }
     if (deltaBytes && imageObserver())
         imageObserver()->decodedSizeChanged(this, deltaBytes);
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    if (DecodedImageBudget* budget = DecodedImageBudget::sharedInstance())
+        budget->setDecodedSize(this, m_decodedSize);
+#endif
 }
 
 void BitmapImage::cacheFrame(size_t index)
 {
+    DECODED_IMAGE_BUDGET_DECODING_SCOPE();
     size_t numFrames = frameCount();
     ASSERT(m_decodedSize == 0 || numFrames > 1);
 
@@ -200,6 +291,12 @@ void BitmapImage::cacheFrame(size_t index)
     if (m_frames.size() < numFrames)
         m_frames.grow(numFrames);
 
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    // makes room for a full size frame at 4 bytes per pixel, the most it takes
+    DecodedImageBudget* budget = DecodedImageBudget::sharedInstance();
+    if (budget)
+        budget->willDecode(this, static_cast<unsigned>(m_size.width()) * m_size.height() * 4);
+#endif
     m_frames[index].m_frame = m_source.createFrameAtIndex(index);
 #if PLATFORM(WKC)
     if (!m_frames[index].m_frame) {
@@ -236,6 +333,10 @@ void BitmapImage::cacheFrame(size_t index)
             imageObserver()->decodedSizeChanged(this, deltaBytes);
     }
 
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    if (budget)
+        budget->setDecodedSize(this, m_decodedSize);
+#endif
 #if PLATFORM(WKC)
     wkcMemorySetAllocationForAnimeGifPeer(false);
 #endif
@@ -262,6 +363,7 @@ void BitmapImage::didDecodeProperties() const
 IntSize BitmapImage::size() const
 {
     if (m_sizeAvailable && !m_haveSize) {
+        DECODED_IMAGE_BUDGET_DECODING_SCOPE();
         m_size = m_source.size();
         m_sizeRespectingOrientation = m_source.size(RespectImageOrientation);
         m_haveSize = true;
@@ -273,6 +375,7 @@ IntSize BitmapImage::size() const
 IntSize BitmapImage::sizeRespectingOrientation() const
 {
     if (m_sizeAvailable && !m_haveSize) {
+        DECODED_IMAGE_BUDGET_DECODING_SCOPE();
         m_size = m_source.size();
         m_sizeRespectingOrientation = m_source.size(RespectImageOrientation);
         m_haveSize = true;
@@ -285,6 +388,7 @@ IntSize BitmapImage::currentFrameSize() const
 {
     if (!m_currentFrame || m_hasUniformFrameSize)
         return size();
+    DECODED_IMAGE_BUDGET_DECODING_SCOPE();
     IntSize frameSize = m_source.frameSizeAtIndex(m_currentFrame);
     didDecodeProperties();
     return frameSize;
@@ -292,6 +396,7 @@ IntSize BitmapImage::currentFrameSize() const
 
 bool BitmapImage::getHotSpot(IntPoint& hotSpot) const
 {
+    DECODED_IMAGE_BUDGET_DECODING_SCOPE();
     bool result = m_source.getHotSpot(hotSpot);
     didDecodeProperties();
     return result;
@@ -335,6 +440,7 @@ bool BitmapImage::dataChanged(bool allDataReceived)
     
     // Feed all the data we've seen so far to the image decoder.
     m_allDataReceived = allDataReceived;
+    DECODED_IMAGE_BUDGET_DECODING_SCOPE();
     m_source.setData(data(), allDataReceived);
     
     m_haveFrameCount = false;
@@ -350,6 +456,7 @@ String BitmapImage::filenameExtension() const
 size_t BitmapImage::frameCount()
 {
     if (!m_haveFrameCount) {
+        DECODED_IMAGE_BUDGET_DECODING_SCOPE();
         m_haveFrameCount = true;
 #if PLATFORM(WKC)
         if (m_frames.size() > 1) {
@@ -377,6 +484,7 @@ bool BitmapImage::isSizeAvailable()
     if (m_sizeAvailable)
         return true;
 
+    DECODED_IMAGE_BUDGET_DECODING_SCOPE();
     m_sizeAvailable = m_source.isSizeAvailable();
     didDecodeProperties();
 
@@ -395,6 +503,10 @@ bool BitmapImage::ensureFrameIsCached(size_t index)
 
 NativeImagePtr BitmapImage::frameAtIndex(size_t index)
 {
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    if (DecodedImageBudget* budget = DecodedImageBudget::sharedInstance())
+        budget->touch(this);
+#endif
     if (!ensureFrameIsCached(index))
         return 0;
     return m_frames[index].m_frame;
@@ -422,6 +534,7 @@ NativeImagePtr BitmapImage::nativeImageForCurrentFrame()
 #if PLATFORM(WKC)
 bool BitmapImage::isThreeDImage() const
 {
+    DECODED_IMAGE_BUDGET_DECODING_SCOPE();
     return m_source.isThreeDImage();
 }
 #endif
@@ -488,6 +601,7 @@ bool BitmapImage::notSolidColor()
 int BitmapImage::repetitionCount(bool imageKnownToBeComplete)
 {
     if ((m_repetitionCountStatus == Unknown) || ((m_repetitionCountStatus == Uncertain) && imageKnownToBeComplete)) {
+        DECODED_IMAGE_BUDGET_DECODING_SCOPE();
         // Snag the repetition count.  If |imageKnownToBeComplete| is false, the
         // repetition count may not be accurate yet for GIFs; in this case the
         // decoder will default to cAnimationLoopOnce, and we'll try and read
@@ -104,6 +104,12 @@ class BitmapImage : public Image {
     friend class CrossfadeGeneratedImage;
     friend class GeneratorGeneratedImage;
     friend class GraphicsContext;
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    friend class ImageDecodingService;
+#endif
+#if ENABLE(WKC_DECODED_IMAGE_BUDGET)
+    friend class DecodedImageBudget;
+#endif
 public:
     static PassRefPtr<BitmapImage> create(NativeImagePtr nativeImage, ImageObserver* observer = 0)
     {
@@ -276,6 +282,14 @@ protected:
 #if PLATFORM(WKC)
     void syncFrameData(size_t index);
 #endif
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    // Hands the first frame to ImageDecodingService when the view is being
+    // painted and the frame is worth a worker. Returns whether the frame is
+    // on its way, and nothing is to be drawn for now.
+    bool decodeAsynchronously(GraphicsContext*, const FloatRect& dstRect);
+    // The frame from the worker, 0 when it could not decode it.
+    void didDecodeAsynchronously(NativeImagePtr frame, bool hasAlpha);
+#endif
     
     ImageSource m_source;
     mutable IntSize m_size; // The size to use for the overall image (will just be the size of the first image).
@@ -311,6 +325,10 @@ protected:
     bool m_sizeAvailable : 1; // Whether or not we can obtain the size of the first image frame yet from ImageIO.
     mutable bool m_hasUniformFrameSize : 1;
     mutable bool m_haveFrameCount : 1;
+#if ENABLE(WKC_ASYNC_IMAGE_DECODING)
+    bool m_decodingAsynchronously : 1; // Whether ImageDecodingService has a request for the first frame.
+    bool m_asynchronousDecodeFailed : 1; // Whether the first frame is to be decoded on the main thread.
+#endif
 };
 
 }
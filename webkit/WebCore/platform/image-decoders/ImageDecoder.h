@@ -152,6 +152,11 @@ namespace WebCore {
         {
             m_image->setRGBLine(xStart, xEnd, y, src, colorChannels);
         }
+        // returns whether any pixel is not opaque
+        inline bool setRGBALine(int xStart, int xEnd, int y, unsigned char *src)
+        {
+            return m_image->setRGBALine(xStart, xEnd, y, src, m_premultiplyAlpha);
+        }
         void setAllowReduceColor(bool flag);
 #endif
 
@@ -385,6 +390,9 @@ namespace WebCore {
 
 #if ENABLE(IMAGE_DECODER_DOWN_SAMPLING)
         void setMaxNumPixels(int m) { m_maxNumPixels = m; }
+#if PLATFORM(WKC)
+        int maxNumPixels() const { return m_maxNumPixels; }
+#endif
 #endif
 
     protected:
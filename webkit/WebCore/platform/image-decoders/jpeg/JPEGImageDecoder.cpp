@@ -279,8 +279,21 @@ public:
             // image is a sequential JPEG.
             m_info.buffered_image = jpeg_has_multiple_scans(&m_info);
 
+#if PLATFORM(WKC) && ENABLE(IMAGE_DECODER_DOWN_SAMPLING)
+            // The scaled size is known from the header alone, so that the
+            // IDCT can do most of the downsampling and the sample array and
+            // the decoding work are those of the smaller image.
+            if (!m_decoder->setSize(m_info.image_width, m_info.image_height))
+                return false;
+            m_info.scale_num = 1;
+            m_info.scale_denom = m_decoder->idctScaleDenominator();
+#endif
+
             // Used to set up image size so arrays can be allocated.
             jpeg_calc_output_dimensions(&m_info);
+#if PLATFORM(WKC) && ENABLE(IMAGE_DECODER_DOWN_SAMPLING)
+            m_decoder->setIDCTOutputSize(m_info.output_width, m_info.output_height);
+#endif
 
             // Make a one-row-high sample array that will go away when done with
             // image. Always make it big enough to hold an RGB row.  Since this
@@ -290,9 +303,11 @@ public:
 
             m_state = JPEG_START_DECOMPRESS;
 
+#if !(PLATFORM(WKC) && ENABLE(IMAGE_DECODER_DOWN_SAMPLING))
             // We can fill in the size now that the header is available.
             if (!m_decoder->setSize(m_info.image_width, m_info.image_height))
                 return false;
+#endif
 
             // Allow color management of the decoded RGBA pixels if possible.
             if (!m_decoder->ignoresGammaAndColorProfile()) {
@@ -486,6 +501,48 @@ bool JPEGImageDecoder::setSize(unsigned width, unsigned height)
     return true;
 }
 
+#if PLATFORM(WKC) && ENABLE(IMAGE_DECODER_DOWN_SAMPLING)
+unsigned JPEGImageDecoder::idctScaleDenominator() const
+{
+    if (!m_scaled)
+        return 1;
+
+    // the largest reduction that still leaves at least scaledSize()
+    unsigned width = size().width();
+    unsigned height = size().height();
+    unsigned scaledWidth = m_scaledColumns.size();
+    unsigned scaledHeight = m_scaledRows.size();
+    unsigned denom;
+    for (denom = 8; denom > 1; denom /= 2) {
+        // libjpeg rounds the output size up
+        if ((width + denom - 1) / denom >= scaledWidth && (height + denom - 1) / denom >= scaledHeight)
+            break;
+    }
+    return denom;
+}
+
+// Picks scaledValues.size() evenly spaced samples, in ascending order, out of
+// length pixels of the IDCT output.
+static void sampleIDCTOutput(Vector<int>& scaledValues, unsigned length)
+{
+    unsigned long long count = scaledValues.size();
+    for (unsigned long long i = 0; i < count; ++i)
+        scaledValues[i] = static_cast<int>(((2 * i + 1) * length) / (2 * count));
+}
+
+void JPEGImageDecoder::setIDCTOutputSize(unsigned width, unsigned height)
+{
+    if (!m_scaled)
+        return;
+
+    // m_scaledColumns and m_scaledRows now index the IDCT output rather than
+    // the full size image. outputScanlines() and scaledY() work on it as is.
+    ASSERT(width >= m_scaledColumns.size() && height >= m_scaledRows.size());
+    sampleIDCTOutput(m_scaledColumns, width);
+    sampleIDCTOutput(m_scaledRows, height);
+}
+#endif
+
 ImageFrame* JPEGImageDecoder::frameBufferAtIndex(size_t index)
 {
     if (index)
@@ -560,7 +617,8 @@ bool JPEGImageDecoder::outputScanlines()
             continue;
         int width = m_scaled ? m_scaledColumns.size() : info->output_width;
 #if PLATFORM(WKC)
-        if (m_scaled == false && info->out_color_space == JCS_RGB) {
+        // the IDCT may have done all of the downsampling
+        if (width == static_cast<int>(info->output_width) && info->out_color_space == JCS_RGB) {
             JSAMPLE* jsample = *samples;
             buffer.setRGBLine(0, width, destY, (unsigned char*)jsample, 3);
         } else {
@@ -53,6 +53,13 @@ namespace WebCore {
         bool outputScanlines();
         void jpegComplete();
 
+#if PLATFORM(WKC) && ENABLE(IMAGE_DECODER_DOWN_SAMPLING)
+        // libjpeg can downscale by 1/2, 1/4 or 1/8 in the IDCT. The rest of
+        // the way to scaledSize() is sampled from its output.
+        unsigned idctScaleDenominator() const;
+        void setIDCTOutputSize(unsigned width, unsigned height);
+#endif
+
         void setColorProfile(const ColorProfile& colorProfile) { m_colorProfile = colorProfile; }
 
     private:
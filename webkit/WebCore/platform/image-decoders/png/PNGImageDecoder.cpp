@@ -483,12 +483,9 @@ void PNGImageDecoder::rowAvailable(unsigned char* rowBuffer, unsigned rowIndex,
     ASSERT(!m_scaled);
     png_bytep pixel = row;
 #if PLATFORM(WKC)
-    if (hasAlpha) {
-        for (int x = 0; x < width; ++x, pixel += colorChannels) {
-            buffer.setRGBA(x, y, pixel[0], pixel[1], pixel[2], pixel[3]);
-            nonTrivialAlpha |= pixel[3] < 255;
-        }
-    } else
+    if (hasAlpha)
+        nonTrivialAlpha = buffer.setRGBALine(0, width, y, pixel);
+    else
         buffer.setRGBLine(0, width, y, pixel, colorChannels);
 #else
     for (int x = 0; x < width; ++x, pixel += colorChannels) {
@@ -31,6 +31,10 @@
 namespace WebCore {
 
 void prefetchDNS(const String& hostname);
+#if PLATFORM(WKC)
+class KURL;
+void preconnect(const KURL&);
+#endif
 }
 
 #endif